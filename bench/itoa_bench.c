@@ -0,0 +1,98 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+/*
+ * Compare the integer formatting of libtbl with snprintf().
+ */
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "libtbl.h"
+
+#define NUMBER_OF_VALUES (1 << 20)
+#define ROUNDS 8
+
+static double now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+/* values of every magnitude, as found in table columns */
+static uint64_t random_value(void)
+{
+	uint64_t v = ((uint64_t)rand() << 33) ^ ((uint64_t)rand() << 11) ^ rand();
+
+	return v >> (rand() % 64);
+}
+
+int main(int argc, char **argv)
+{
+	uint64_t *values;
+	char buf[TBL_INT_BUF_SIZE];
+	char ref[TBL_INT_BUF_SIZE];
+	double t, t_snprintf_s, t_snprintf_u, t_tbl_s, t_tbl_u;
+	volatile size_t sink = 0;
+	int i, r, len;
+
+	values = malloc(NUMBER_OF_VALUES * sizeof(*values));
+	if (!values)
+		return 1;
+
+	srand(1);
+	for (i = 0; i < NUMBER_OF_VALUES; i++)
+		values[i] = random_value();
+
+	for (i = 0; i < NUMBER_OF_VALUES; i++) {
+		len = tbl_u64toa(buf, values[i]);
+		buf[len] = '\0';
+		snprintf(ref, sizeof(ref), "%" PRIu64, values[i]);
+		if (strcmp(buf, ref)) {
+			fprintf(stderr, "mismatch: %s != %s\n", buf, ref);
+			return 1;
+		}
+		len = tbl_i64toa(buf, (int32_t)values[i]);
+		buf[len] = '\0';
+		snprintf(ref, sizeof(ref), "%d", (int32_t)values[i]);
+		if (strcmp(buf, ref)) {
+			fprintf(stderr, "mismatch: %s != %s\n", buf, ref);
+			return 1;
+		}
+	}
+
+	t = now_ns();
+	for (r = 0; r < ROUNDS; r++)
+		for (i = 0; i < NUMBER_OF_VALUES; i++)
+			sink += snprintf(buf, sizeof(buf), "%d", (int32_t)values[i]);
+	t_snprintf_s = (now_ns() - t) / ROUNDS / NUMBER_OF_VALUES;
+
+	t = now_ns();
+	for (r = 0; r < ROUNDS; r++)
+		for (i = 0; i < NUMBER_OF_VALUES; i++)
+			sink += tbl_i64toa(buf, (int32_t)values[i]);
+	t_tbl_s = (now_ns() - t) / ROUNDS / NUMBER_OF_VALUES;
+
+	t = now_ns();
+	for (r = 0; r < ROUNDS; r++)
+		for (i = 0; i < NUMBER_OF_VALUES; i++)
+			sink += snprintf(buf, sizeof(buf), "%" PRIu64, values[i]);
+	t_snprintf_u = (now_ns() - t) / ROUNDS / NUMBER_OF_VALUES;
+
+	t = now_ns();
+	for (r = 0; r < ROUNDS; r++)
+		for (i = 0; i < NUMBER_OF_VALUES; i++)
+			sink += tbl_u64toa(buf, values[i]);
+	t_tbl_u = (now_ns() - t) / ROUNDS / NUMBER_OF_VALUES;
+
+	printf("%-12s %12s %12s %8s\n", "type", "snprintf ns", "libtbl ns", "speedup");
+	printf("%-12s %12.2f %12.2f %7.1fx\n", "int32", t_snprintf_s, t_tbl_s,
+	       t_snprintf_s / t_tbl_s);
+	printf("%-12s %12.2f %12.2f %7.1fx\n", "uint64", t_snprintf_u, t_tbl_u,
+	       t_snprintf_u / t_tbl_u);
+
+	free(values);
+
+	return 0;
+}
@@ -0,0 +1,393 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+/*
+ * Rendering throughput of libtbl: synthetic tables of FIELD_STR, FIELD_NUM
+ * and FIELD_LLU columns are printed in every format to /dev/null, a pipe
+ * and a heap buffer. One tab separated line is printed per run, so that
+ * the results of two commits can be compared with e.g. join(1).
+ *
+ * usage: libtbl_bench [-r rows,...] [-c columns,...] [-f formats] [-t targets]
+ */
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include "libtbl.h"
+
+/* distinct rows, the row pointers of larger tables repeat them */
+#define POOL_ROWS 4096
+/* rows rendered per run at least, small tables are rendered repeatedly */
+#define MIN_RENDERED 100000
+#define STR_SIZE 24
+
+/* heap allocations, counted by wrapping the glibc allocator */
+static unsigned long nallocs;
+
+/* rows printed one at a time by print_table_single_row_sink() (-s) */
+static bool single_rows;
+
+extern void *__libc_malloc(size_t size);
+extern void *__libc_calloc(size_t nmemb, size_t size);
+extern void *__libc_realloc(void *ptr, size_t size);
+
+void *malloc(size_t size)
+{
+	__atomic_add_fetch(&nallocs, 1, __ATOMIC_RELAXED);
+	return __libc_malloc(size);
+}
+
+void *calloc(size_t nmemb, size_t size)
+{
+	__atomic_add_fetch(&nallocs, 1, __ATOMIC_RELAXED);
+	return __libc_calloc(nmemb, size);
+}
+
+void *realloc(void *ptr, size_t size)
+{
+	__atomic_add_fetch(&nallocs, 1, __ATOMIC_RELAXED);
+	return __libc_realloc(ptr, size);
+}
+
+static const char * const format_names[] = {
+	[FORMAT_TERM] = "term",
+	[FORMAT_CSV] = "csv",
+	[FORMAT_JSON] = "json",
+	[FORMAT_XML] = "xml",
+	[FORMAT_ARROW] = "arrow",
+	[FORMAT_JSONL] = "jsonl",
+};
+
+#define NUMBER_OF_FORMATS (sizeof(format_names) / sizeof(format_names[0]))
+
+enum target {
+	TARGET_NULL,
+	TARGET_PIPE,
+	TARGET_MEM,
+};
+
+static const char * const target_names[] = {
+	[TARGET_NULL] = "null",
+	[TARGET_PIPE] = "pipe",
+	[TARGET_MEM] = "mem",
+};
+
+struct bench_table {
+	int			ncols;
+	size_t			row_size;
+	struct table_column	*clm;
+	struct table_column	**cs;
+	char			*pool;
+	void			**rows;
+	long			nrows;
+};
+
+struct bench_result {
+	double		ns;
+	size_t		bytes;
+	unsigned long	writes;
+	unsigned long	allocs;
+	long		rendered;
+};
+
+static double now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+static void fill_string(char *str, unsigned seed, bool escape)
+{
+	static const char plain[] = "abcdefghijklmnopqrstuvwxyz0123456789";
+	static const char heavy[] = "a\"b\\c<d>e&f\tg,h\"";
+	int len = 4 + seed % (STR_SIZE - 5);
+	int i;
+
+	for (i = 0; i < len; i++)
+		str[i] = escape ? heavy[(seed + i) % (sizeof(heavy) - 1)] :
+				  plain[(seed + i) % (sizeof(plain) - 1)];
+	str[len] = '\0';
+}
+
+/* column i is FIELD_STR, FIELD_NUM or FIELD_LLU in turn */
+static int table_create(struct bench_table *t, int ncols, long nrows,
+			bool color, bool escape)
+{
+	static const enum field_type types[] = { FIELD_STR, FIELD_NUM, FIELD_LLU };
+	static const size_t sizes[] = { STR_SIZE, sizeof(int), sizeof(uint64_t) };
+	static char names[MAX_COLUMN_COUNT][8];
+	struct table_column *c;
+	size_t off = 0;
+	unsigned seed;
+	char *row;
+	long i;
+	int k;
+
+	memset(t, 0, sizeof(*t));
+	t->ncols = ncols;
+	t->nrows = nrows;
+	t->clm = calloc(ncols, sizeof(*t->clm));
+	t->cs = calloc(ncols + 1, sizeof(*t->cs));
+	if (!t->clm || !t->cs)
+		return -ENOMEM;
+
+	for (k = 0; k < ncols; k++) {
+		c = &t->clm[k];
+		snprintf(names[k], sizeof(names[k]), "c%d", k);
+		off = (off + 7) & ~7UL;
+		c->m_name = names[k];
+		snprintf(c->m_header, sizeof(c->m_header), "Col%d", k);
+		c->hdr_width = strlen(c->m_header);
+		c->m_type = types[k % 3];
+		c->m_offset = off;
+		c->column_align = c->m_type == FIELD_STR ? 'l' : 'r';
+		c->hdr_color = CBLD;
+		c->clm_color = color ? CRED + k % 4 : CNRM;
+		t->cs[k] = c;
+		off += sizes[k % 3];
+	}
+	t->row_size = (off + 7) & ~7UL;
+
+	t->pool = calloc(POOL_ROWS, t->row_size);
+	t->rows = calloc(nrows + 1, sizeof(*t->rows));
+	if (!t->pool || !t->rows)
+		return -ENOMEM;
+
+	for (i = 0; i < POOL_ROWS; i++) {
+		row = t->pool + i * t->row_size;
+		for (k = 0; k < ncols; k++) {
+			c = &t->clm[k];
+			seed = i * 7919 + k * 104729;
+			if (c->m_type == FIELD_STR)
+				fill_string(row + c->m_offset, seed, escape);
+			else if (c->m_type == FIELD_NUM)
+				*(int *)(row + c->m_offset) = (int)(seed * 2654435761u) >> (seed % 31);
+			else
+				*(uint64_t *)(row + c->m_offset) = ((uint64_t)seed << 32 | seed) >> (seed % 64);
+		}
+	}
+
+	for (i = 0; i < nrows; i++)
+		t->rows[i] = t->pool + (i % POOL_ROWS) * t->row_size;
+
+	return 0;
+}
+
+static void table_destroy(struct bench_table *t)
+{
+	free(t->clm);
+	free(t->cs);
+	free(t->pool);
+	free(t->rows);
+}
+
+static void *drain(void *arg)
+{
+	char buf[64 * 1024];
+	int fd = *(int *)arg;
+
+	while (read(fd, buf, sizeof(buf)) > 0)
+		;
+
+	return NULL;
+}
+
+static int render(struct bench_table *t, enum format_type format, enum target target,
+		  bool color, struct bench_result *res)
+{
+	struct tbl_sink sink;
+	pthread_t reader;
+	int fds[2] = { -1, -1 };
+	unsigned long allocs;
+	long rounds, r, n;
+	double start;
+	int k, ret = 0;
+
+	rounds = (MIN_RENDERED + t->nrows - 1) / t->nrows;
+
+	if (target == TARGET_NULL) {
+		fds[1] = open("/dev/null", O_WRONLY);
+		if (fds[1] < 0)
+			return -errno;
+	} else if (target == TARGET_PIPE) {
+		if (pipe(fds))
+			return -errno;
+		if (pthread_create(&reader, NULL, drain, &fds[0])) {
+			close(fds[0]);
+			close(fds[1]);
+			return -EAGAIN;
+		}
+	}
+
+	memset(res, 0, sizeof(*res));
+	for (r = 0; r < rounds && !ret; r++) {
+		for (k = 0; k < t->ncols; k++)
+			t->clm[k].m_width = t->clm[k].hdr_width;
+
+		/* the sink setup is part of what a caller pays per table */
+		allocs = nallocs;
+		start = now_ns();
+		if (target == TARGET_MEM)
+			ret = tbl_sink_init_heap(&sink, 0);
+		else
+			ret = tbl_sink_init_fd(&sink, fds[1], NULL, 0);
+		if (ret)
+			break;
+
+		if (single_rows) {
+			for (n = 0; n < t->nrows && !ret; n++)
+				ret = print_table_single_row_sink(&sink, t->rows[n],
+								  format, "", t->cs,
+								  color, 0, 0);
+		} else {
+			ret = print_table_all_rows_sink(&sink, t->rows, format, "",
+							t->cs, color, 0, 0);
+		}
+		ret = tbl_sink_close(&sink) ?: ret;
+		res->ns += now_ns() - start;
+		res->allocs += nallocs - allocs;
+		res->bytes += tbl_sink_bytes(&sink);
+		res->writes += sink.nwrites;
+		res->rendered += t->nrows;
+		tbl_sink_release(&sink);
+	}
+
+	if (fds[1] >= 0)
+		close(fds[1]);
+	if (target == TARGET_PIPE) {
+		pthread_join(reader, NULL);
+		close(fds[0]);
+	}
+
+	return ret;
+}
+
+/* Parse a comma separated list of numbers, returns the count or -1 */
+static int parse_list(const char *arg, long *list, int max)
+{
+	char *end;
+	int n = 0;
+
+	while (*arg && n < max) {
+		list[n++] = strtol(arg, &end, 10);
+		if (end == arg || list[n - 1] <= 0)
+			return -1;
+		arg = *end == ',' ? end + 1 : end;
+	}
+
+	return *arg ? -1 : n;
+}
+
+static bool selected(const char *list, const char *name)
+{
+	size_t len = strlen(name);
+	const char *p = list;
+
+	while ((p = strstr(p, name))) {
+		if ((p == list || p[-1] == ',') && (p[len] == ',' || !p[len]))
+			return true;
+		p += len;
+	}
+
+	return false;
+}
+
+static void usage(const char *prog)
+{
+	fprintf(stderr, "usage: %s [-r rows,...] [-c columns,...] [-f formats] [-t targets] [-s]\n"
+		"  formats: term,csv,json,xml,arrow,jsonl  targets: null,pipe,mem\n"
+		"  -s: print the rows one at a time (no arrow)\n"
+		"  e.g. -r 1000,10000,100000,1000000,10000000 -c 4,12,50\n", prog);
+}
+
+int main(int argc, char **argv)
+{
+	long rows[8] = { 1000, 100000 }, cols[8] = { 4, 50 };
+	int nrows = 2, ncols = 2;
+	const char *formats = "term,csv,json,xml,arrow,jsonl";
+	const char *targets = "null,pipe,mem";
+	struct bench_result res;
+	struct bench_table t;
+	unsigned f, tg;
+	int opt, i, j, color, escape, ret;
+
+	while ((opt = getopt(argc, argv, "r:c:f:t:sh")) != -1) {
+		switch (opt) {
+		case 'r':
+			nrows = parse_list(optarg, rows, 8);
+			break;
+		case 'c':
+			ncols = parse_list(optarg, cols, 8);
+			break;
+		case 'f':
+			formats = optarg;
+			break;
+		case 't':
+			targets = optarg;
+			break;
+		case 's':
+			single_rows = true;
+			break;
+		default:
+			usage(argv[0]);
+			return opt == 'h' ? 0 : 1;
+		}
+		if (nrows < 0 || ncols < 0) {
+			usage(argv[0]);
+			return 1;
+		}
+	}
+
+	for (i = 0; i < ncols; i++)
+		if (cols[i] > MAX_COLUMN_COUNT) {
+			fprintf(stderr, "at most %d columns\n", MAX_COLUMN_COUNT);
+			return 1;
+		}
+
+	printf("format\ttarget\trows\tcols\tcolor\tescape\tns_per_row\tmb_per_s\t"
+	       "bytes_per_row\twrites_per_krow\tallocs_per_row\n");
+
+	for (i = 0; i < nrows; i++)
+	for (j = 0; j < ncols; j++)
+	for (color = 0; color < 2; color++)
+	for (escape = 0; escape < 2; escape++) {
+		ret = table_create(&t, cols[j], rows[i], color, escape);
+		if (ret) {
+			fprintf(stderr, "%s\n", strerror(-ret));
+			return 1;
+		}
+
+		for (f = 0; f < NUMBER_OF_FORMATS; f++) {
+			if (!selected(formats, format_names[f]) ||
+			    (single_rows && f == FORMAT_ARROW))
+				continue;
+			for (tg = 0; tg < sizeof(target_names) / sizeof(target_names[0]); tg++) {
+				if (!selected(targets, target_names[tg]))
+					continue;
+
+				ret = render(&t, f, tg, color, &res);
+				if (ret) {
+					fprintf(stderr, "%s/%s: %s\n", format_names[f],
+						target_names[tg], strerror(-ret));
+					return 1;
+				}
+
+				printf("%s\t%s\t%ld\t%ld\t%d\t%d\t%.1f\t%.1f\t%.1f\t%.3f\t%.4f\n",
+				       format_names[f], target_names[tg], rows[i], cols[j],
+				       color, escape, res.ns / res.rendered,
+				       res.bytes / (res.ns / 1e9) / 1e6,
+				       (double)res.bytes / res.rendered,
+				       res.writes * 1000.0 / res.rendered,
+				       (double)res.allocs / res.rendered);
+				fflush(stdout);
+			}
+		}
+		table_destroy(&t);
+	}
+
+	return 0;
+}
@@ -2,21 +2,44 @@
 #ifndef __H_TABLE
 #define __H_TABLE
 
+#include <stdarg.h>
 #include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
 
 enum field_type {
 	FIELD_STR,
 	FIELD_VAL,
 	FIELD_NUM,
-	FIELD_LLU
+	FIELD_LLU,
+	FIELD_I8,
+	FIELD_U8,
+	FIELD_I16,
+	FIELD_U16,
+	FIELD_I32,
+	FIELD_U32,
+	FIELD_I64,
+	FIELD_U64,
+	/* uint64_t values with a unit, humanized without a m_tostr() callback */
+	FIELD_BYTES,		/* 1.5 KiB */
+	FIELD_BYTES_RATE,	/* bytes per second, 1.5 MiB/s */
+	FIELD_NSEC,		/* nanoseconds, 1.5 ms */
+	FIELD_SI		/* counts, 1.5M */
 };
 
 enum format_type {
 	FORMAT_TERM,
 	FORMAT_CSV,
 	FORMAT_JSON,
-	FORMAT_XML
+	FORMAT_XML,
+	FORMAT_ARROW,
+	FORMAT_JSONL	/* one compact JSON object per line */
 };
 
 enum color {
@@ -51,6 +74,14 @@ static const char * const colors[] = {
 	[CSTRIKETHROUGH] = "\x1B[9m",
 };
 
+/* strlen() of the escape sequences in colors[] */
+static const unsigned char color_lens[] = {
+	[CNRM] = 4, [CBLD] = 4, [CUND] = 4,
+	[CRED] = 5, [CGRN] = 5, [CYEL] = 5, [CBLU] = 5,
+	[CMAG] = 5, [CCYN] = 5, [CWHT] = 5,
+	[CDIM] = 4, [CDGR] = 5, [CSTRIKETHROUGH] = 4,
+};
+
 struct table_column {
 	const char	*m_name;
 	char		m_header[16];
@@ -80,8 +111,8 @@ struct table_column {
 		.m_name		= s_name, \
 		.m_header	= header, \
 		.hdr_width	= sizeof(header) - 1, \
-		.m_type		= type, \
 		.m_descr	= descr, \
+		.m_type		= type, \
 		.m_width	= width, \
 		.m_offset	= offsetof(struct str, name), \
 		.m_tostr	= tostr, \
@@ -96,6 +127,10 @@ struct table_column clm_ ## str ## _ ## name = \
 	_CLM(str, #name, name, header, type, tostr, align, h_color, c_color, descr, width, off)
 
 #define MAX_COLUMN_WIDTH 128
+/*
+ * Columns of the struct table_field arrays of the legacy functions, the
+ * other renderers and tbl_stats take any number of columns.
+ */
 #define MAX_COLUMN_COUNT 50
 #define COLUMN_DELIMITER "  "
 
@@ -104,16 +139,249 @@ struct table_field {
 	enum color mColor;
 };
 
+/*
+ * Variable length cell: @len bytes at @off in the text of a struct tbl_arena.
+ * Unlike struct table_field a cell is neither padded nor truncated to
+ * MAX_COLUMN_WIDTH.
+ */
+struct tbl_cell {
+	uint32_t	off;
+	uint32_t	len;
+	enum color	mColor;
+};
+
+/*
+ * Bump allocator for cell text. All cells of a render share one contiguous
+ * buffer which is reused after tbl_arena_reset(). A zeroed arena is valid.
+ */
+struct tbl_arena {
+	char	*base;
+	size_t	used;
+	size_t	size;
+	bool	borrowed;	/* @base is a caller buffer, not freed */
+};
+
 /*
 * Print @str in @pColor color.
 */
 #define COLOR_STR(use_color, pColor, str) \
 	trm ? colors[pColor] : "", str, use_color ? colors[CNRM] : ""
 
+/*
+ * Output sink. Every print_table_*_sink() function appends to the buffer
+ * of a sink instead of calling printf() per field. FILE and fd sinks hand
+ * the buffer over with one fwrite()/writev() once a batch of rows has been
+ * collected, MEM sinks fill a caller supplied buffer and HEAP sinks grow a
+ * malloc()ed one. ASYNC sinks hand full buffers to a writer thread.
+ *
+ * Setting color_runs after initializing a sink makes the row renderers
+ * track the terminal color across a row: escape sequences are only written
+ * where the color changes and a single reset ends the row.
+ */
+enum tbl_sink_type {
+	TBL_SINK_FILE,
+	TBL_SINK_FD,
+	TBL_SINK_MEM,
+	TBL_SINK_HEAP,
+	TBL_SINK_ASYNC
+};
+
+#define TBL_SINK_BUF_SIZE (64 * 1024)
+
+struct tbl_sink_async;
+
+struct tbl_sink {
+	enum tbl_sink_type	type;
+	FILE		*file;
+	int		fd;
+	char		*buf;
+	size_t		len;		/* bytes pending in @buf */
+	size_t		size;		/* capacity of @buf */
+	size_t		batch;		/* flush threshold checked at row ends */
+	size_t		flushed;	/* bytes handed over (or dropped) */
+	unsigned long	nwrites;	/* fwrite()/writev() calls issued */
+	int		error;		/* first error, sticky */
+	bool		own_buf;
+	bool		color_runs;	/* merge the colors of adjacent cells */
+	size_t		color_saved;	/* escape bytes saved by @color_runs */
+	struct tbl_sink_async *async;
+	uint64_t	wait_ns;	/* ASYNC: waited for a free buffer */
+};
+
+/*
+ * Initialize a sink writing to @file or @fd. If @buf is NULL a buffer of
+ * @size (or TBL_SINK_BUF_SIZE if 0) bytes is allocated.
+ */
+int tbl_sink_init_file(struct tbl_sink *sink, FILE *file, char *buf, size_t size);
+int tbl_sink_init_fd(struct tbl_sink *sink, int fd, char *buf, size_t size);
+
+/*
+ * Render into @nbufs buffers of @size bytes (TBL_SINK_BUF_SIZE if 0) which
+ * a writer thread drains to @file or @fd (@file NULL): once a buffer is
+ * full it is queued and rendering continues in the next one, waiting only
+ * while all @nbufs (at least 2) buffers are queued. Write errors show up
+ * in the next flush or tbl_sink_close(), which waits for the queued
+ * buffers and stops the thread. Writes after the close fail with -EPIPE.
+ */
+int tbl_sink_init_async(struct tbl_sink *sink, FILE *file, int fd, size_t size,
+			unsigned nbufs);
+
+/* Render into @buf of @size bytes, -ENOSPC once it is full */
+int tbl_sink_init_mem(struct tbl_sink *sink, char *buf, size_t size);
+
+/* Render into a growing heap buffer, available in sink->buf after close */
+int tbl_sink_init_heap(struct tbl_sink *sink, size_t size_hint);
+
+int tbl_sink_write_slow(struct tbl_sink *sink, const void *data, size_t len);
+
+static inline int tbl_sink_write(struct tbl_sink *sink, const void *data,
+				 size_t len)
+{
+	if (sink->size - sink->len < len)
+		return tbl_sink_write_slow(sink, data, len);
+
+	memcpy(sink->buf + sink->len, data, len);
+	sink->len += len;
+
+	return 0;
+}
+
+static inline int tbl_sink_puts(struct tbl_sink *sink, const char *str)
+{
+	return tbl_sink_write(sink, str, strlen(str));
+}
+
+static inline int tbl_sink_putc(struct tbl_sink *sink, char c)
+{
+	if (sink->len == sink->size)
+		return tbl_sink_write_slow(sink, &c, 1);
+
+	sink->buf[sink->len++] = c;
+
+	return 0;
+}
+
+/*
+ * Return a pointer to at least @len contiguous free bytes, or NULL.
+ * Account the bytes actually used with sink->len += n.
+ */
+char *tbl_sink_reserve(struct tbl_sink *sink, size_t len);
+
+/* Append @count copies of @c */
+int tbl_sink_fill(struct tbl_sink *sink, char c, size_t count);
+
+int tbl_sink_vprintf(struct tbl_sink *sink, const char *format, va_list args);
+
+int tbl_sink_printf(struct tbl_sink *sink, const char *format, ...)
+	__attribute__((format(printf, 2, 3)));
+
+/* Called after each row, flushes once a batch of rows has been collected */
+int tbl_sink_row_end(struct tbl_sink *sink);
+
+int tbl_sink_flush(struct tbl_sink *sink);
+
+/*
+ * Flush a FILE/fd sink or '\0' terminate a MEM/HEAP sink. Returns the first
+ * error seen by the sink.
+ */
+int tbl_sink_close(struct tbl_sink *sink);
+
+/* Free the buffer if it was allocated by the sink */
+void tbl_sink_release(struct tbl_sink *sink);
+
+/* Number of bytes produced so far */
+size_t tbl_sink_bytes(const struct tbl_sink *sink);
+
+/*
+ * Append @str to @sink escaped for CSV ("" for "), JSON (\", \\, \n, \u00XX
+ * ...) or XML (&lt; &gt; &amp;). Returns the number of escaped bytes.
+ */
+size_t tbl_escape_sink(struct tbl_sink *sink, enum format_type format,
+		       const char *str, size_t len);
+
+/*
+ * Can @str stand unquoted as a JSON number:
+ * -?(0|[1-9][0-9]*)(.[0-9]+)?([eE][+-]?[0-9]+)?
+ */
+bool tbl_json_number(const char *str, size_t len);
+
+/*
+ * Switch the terminal of @sink from the color *@cur to @want. A foreground
+ * color replaces another one, attributes like bold need a reset first.
+ * Returns the number of bytes written.
+ */
+size_t tbl_sink_color_switch(struct tbl_sink *sink, enum color *cur,
+			     enum color want);
+
+/*
+ * Locale independent integer formatting. The digits of @v are written to
+ * @buf without a terminating '\0', the number of bytes written is returned.
+ * @buf must hold TBL_INT_BUF_SIZE - 1 bytes.
+ */
+#define TBL_INT_BUF_SIZE 24
+
+int tbl_u64toa(char *buf, uint64_t v);
+
+int tbl_i64toa(char *buf, int64_t v);
+
+/*
+ * Humanize @v of the unit type @type (FIELD_BYTES ... FIELD_SI) with one
+ * decimal and the largest unit it reaches, e.g. "1.5 KiB" or "999 ns",
+ * using integer arithmetic only. Returns the length written to @buf as by
+ * tbl_u64toa() or -1 if @type has no unit.
+ */
+int tbl_humanize(char *buf, enum field_type type, uint64_t v);
+
+/*
+ * Terminal columns taken by the UTF-8 text @str of @len bytes: East Asian
+ * wide characters count two, combining marks and joiners none. Bytes of
+ * invalid sequences count one each. Runs of ASCII are skipped in bulk.
+ */
+size_t tbl_str_width(const char *str, size_t len);
+
+/*
+ * Bytes of the longest prefix of @str which fits into @width columns
+ * without splitting a character, its width is stored in @cols if not NULL.
+ */
+size_t tbl_str_truncate(const char *str, size_t len, size_t width, size_t *cols);
+
 int table_row_stringify(void *s, struct table_field *pfields,
 			struct table_column **pColumns, int humanize,
 			int pre_len);
 
+/* Preallocate @size_hint bytes of text, 64 KiB if 0 */
+int tbl_arena_init(struct tbl_arena *arena, size_t size_hint);
+
+/*
+ * Start with the caller buffer @buf of @size bytes, e.g. on the stack; the
+ * text moves to the heap only if it outgrows @buf.
+ */
+void tbl_arena_init_buf(struct tbl_arena *arena, char *buf, size_t size);
+
+/* Forget all cells but keep the memory for the next render */
+void tbl_arena_reset(struct tbl_arena *arena);
+
+void tbl_arena_release(struct tbl_arena *arena);
+
+/* Return a pointer to @len free bytes at the end of the arena text */
+char *tbl_arena_reserve(struct tbl_arena *arena, size_t len);
+
+static inline const char *tbl_cell_str(const struct tbl_arena *arena,
+				       const struct tbl_cell *cell)
+{
+	return arena->base + cell->off;
+}
+
+/*
+ * Like table_row_stringify() but store the text of the row @s in @arena
+ * and describe it by one entry of @pCells per column. The text is '\0'
+ * terminated and never truncated.
+ */
+int table_row_stringify_arena(void *s, struct tbl_arena *arena,
+			      struct tbl_cell *pCells,
+			      struct table_column **pColumns, int humanize,
+			      int pre_len);
+
 int table_get_max_h_width(struct table_column **pColumns);
 
 bool table_contains_number(struct table_column **pColumns);
@@ -128,6 +396,53 @@ int table_extend_columns(const char *names, const char *delim,
 
 int table_column_count(struct table_column **pColumns);
 
+/*
+ * Column catalog compiled once from the NULL terminated array @all, with a
+ * hashed name index. Selections are bitsets plus the selection order and
+ * are updated by tbl_schema_select() without allocating memory:
+ * "a,b" selects a and b, "+c" appends c and "-a" removes a (see
+ * table_extend_columns()). A column is selected at most once.
+ */
+struct tbl_schema {
+	struct table_column	**all;
+	int			count;
+	int			words;	/* uint64_t words of a selection */
+	uint32_t		*index;	/* column index + 1, 0 if free */
+	uint32_t		mask;
+};
+
+struct tbl_selection {
+	uint64_t	*bits;
+	int		*order;
+	int		count;
+};
+
+struct tbl_schema *tbl_schema_create(struct table_column **all);
+
+void tbl_schema_destroy(struct tbl_schema *schema);
+
+/* Index of the column named by @len bytes of @name in schema->all or -ENOENT */
+int tbl_schema_find(const struct tbl_schema *schema, const char *name, size_t len);
+
+int tbl_selection_init(struct tbl_selection *sel, const struct tbl_schema *schema);
+
+void tbl_selection_release(struct tbl_selection *sel);
+
+/*
+ * Apply the @delim separated list @arg to @sel. Returns -EINVAL, leaving
+ * @sel unchanged, if @arg is empty or names an unknown column.
+ */
+int tbl_schema_select(const struct tbl_schema *schema, struct tbl_selection *sel,
+		      const char *arg, const char *delim);
+
+/*
+ * Store the selected columns in @cs, an array of @cs_len entries, followed
+ * by NULL. Returns the number of columns or -ENOSPC.
+ */
+int tbl_selection_columns(const struct tbl_schema *schema,
+			  const struct tbl_selection *sel,
+			  struct table_column **cs, int cs_len);
+
 /*	@
 * brief Print table for @format
 * @param format JSON/XML/TERM/CSV 
@@ -142,36 +457,589 @@ int print_table_fields(enum format_type format, const char *prefix,
 		     struct table_field *pFields, struct table_column **pColumns,
 		     bool use_color, int pwidth);
 
+int print_table_fields_sink(struct tbl_sink *sink, enum format_type format,
+			    const char *prefix, struct table_field *pFields,
+			    struct table_column **pColumns, bool use_color,
+			    int pwidth);
+
+/* print_table_fields() for cells stringified into @arena */
+int print_table_cells(enum format_type format, const char *prefix,
+		      const struct tbl_arena *arena, const struct tbl_cell *pCells,
+		      struct table_column **pColumns, bool use_color, int pwidth);
+
+int print_table_cells_sink(struct tbl_sink *sink, enum format_type format,
+			   const char *prefix, const struct tbl_arena *arena,
+			   const struct tbl_cell *pCells,
+			   struct table_column **pColumns, bool use_color,
+			   int pwidth);
+
+/*
+ * Render plan of the rows of one (format, columns, prefix, color) set: the
+ * literal text (prefix, keys, tags, quotes and delimiters) is compiled once
+ * into one buffer, so that printing a row only copies literals and cells.
+ * TERM cells are padded to the m_width of the columns at the time of
+ * printing.
+ */
+struct tbl_plan_slot;
+
+struct tbl_plan {
+	enum format_type	format;
+	struct table_column	**columns;
+	int			count;
+	bool			use_color;
+	int			pwidth;
+	struct tbl_sink		lit;	/* literals of all slots */
+	struct tbl_plan_slot	*slots;	/* count + 1, the last is the row end */
+};
+
+int tbl_plan_compile(struct tbl_plan *plan, enum format_type format,
+		     const char *prefix, struct table_column **pColumns,
+		     bool use_color, int pwidth);
+
+void tbl_plan_release(struct tbl_plan *plan);
+
+/* print_table_cells_sink() with a plan compiled by tbl_plan_compile() */
+int tbl_plan_print_cells(struct tbl_sink *sink, const struct tbl_plan *plan,
+			 const struct tbl_arena *arena,
+			 const struct tbl_cell *pCells);
+
+/*
+ * Mutable state of one render of a column set. The legacy functions grow
+ * the m_width of the columns while rows are stringified, so columns which
+ * are shared (e.g. static CLM() definitions) can't be rendered by several
+ * threads at once. The tbl_layout_*() functions only read the columns and
+ * keep the widths here instead; a layout is owned by one thread.
+ */
+struct tbl_filter;
+struct tbl_totals;
+
+/*
+ * The fields of the columns read for every cell, compiled into arrays
+ * indexed by column so that the row loops of wide tables walk a few
+ * contiguous arrays instead of one struct table_column per cell.
+ */
+struct tbl_hot {
+	int		count;
+	unsigned long	*offs;		/* s_off + m_offset */
+	int		(**tostr)(char *str, size_t len, enum color *pColor,
+				  void *v, int humanize);
+	uint8_t		*types;		/* enum field_type */
+	uint8_t		*colors;	/* clm_color */
+};
+
+int tbl_hot_compile(struct tbl_hot *hot, struct table_column **pColumns);
+
+void tbl_hot_release(struct tbl_hot *hot);
+
+struct tbl_layout {
+	struct table_column	**columns;
+	int			count;
+	int			*widths;
+	struct tbl_hot		hot;
+	const struct tbl_filter	*filter;	/* rows printed, all if NULL */
+	struct tbl_totals	*totals;	/* aggregates of the rows printed */
+	unsigned long		scanned;	/* rows passed to the filter */
+	unsigned long		emitted;	/* rows printed */
+};
+
+/*
+ * Start from the m_width of @pColumns, any number of them. Free the
+ * layout with tbl_layout_release().
+ */
+int tbl_layout_init(struct tbl_layout *layout, struct table_column **pColumns);
+
+void tbl_layout_release(struct tbl_layout *layout);
+
+/* Store the widths in the columns like the legacy functions do */
+void tbl_layout_store(const struct tbl_layout *layout);
+
+/* table_row_stringify_arena() growing the widths of @layout */
+int tbl_layout_row_stringify(struct tbl_layout *layout, void *s,
+			     struct tbl_arena *arena, struct tbl_cell *pCells,
+			     int humanize, int pre_len);
+
+int tbl_layout_print_header_sink(const struct tbl_layout *layout,
+				 struct tbl_sink *sink, const char *prefix,
+				 bool use_color, char align);
+
+/* tbl_plan_print_cells() padding TERM cells to the widths of @layout */
+int tbl_layout_print_cells_sink(const struct tbl_layout *layout,
+				struct tbl_sink *sink, const struct tbl_plan *plan,
+				const struct tbl_arena *arena,
+				const struct tbl_cell *pCells);
+
+/*
+ * print_table_all_rows_sink() of the columns of @layout, printing only the
+ * rows matching layout->filter if set.
+ */
+int tbl_layout_print_rows_sink(struct tbl_layout *layout, struct tbl_sink *sink,
+			       void **v, enum format_type format, const char *pre,
+			       bool use_color, int humanize, size_t pre_len);
+
+/*
+ * Rows produced on demand instead of a NULL terminated array: @next is
+ * called with @state for every row until it returns NULL or @limit rows
+ * have been printed, so that producers walking a list, a hash table or a
+ * file need no array of all rows and can stop early. @size_hint is the
+ * number of rows expected, 0 if unknown, and caps the worker threads of
+ * the parallel renderers.
+ */
+struct tbl_row_source {
+	void		*(*next)(void *state);
+	void		*state;
+	unsigned long	size_hint;
+	unsigned long	limit;		/* rows printed at most, 0 for all */
+};
+
+/* Source of the NULL terminated array *@pos, advancing *@pos */
+void tbl_row_source_array(struct tbl_row_source *src, void ***pos);
+
+/* State of a source walking @count structs of @stride bytes at @base */
+struct tbl_strided {
+	const char	*pos;
+	const char	*end;
+	size_t		stride;
+};
+
+/*
+ * Source of the rows of an array of structs by address arithmetic instead
+ * of a pointer array. The row a few strides ahead is prefetched while the
+ * current one is printed.
+ */
+void tbl_row_source_strided(struct tbl_row_source *src, struct tbl_strided *st,
+			    const void *base, size_t stride, size_t count);
+
+int tbl_layout_print_source_sink(struct tbl_layout *layout, struct tbl_sink *sink,
+				 const struct tbl_row_source *src,
+				 enum format_type format, const char *pre,
+				 bool use_color, int humanize, size_t pre_len);
+
+/*
+ * Rows are pulled from @src by the calling thread. With a filter and a
+ * limit the rows are printed by the calling thread only.
+ */
+int tbl_layout_print_source_parallel_sink(struct tbl_layout *layout,
+					  struct tbl_sink *sink,
+					  const struct tbl_row_source *src,
+					  enum format_type format, const char *pre,
+					  bool use_color, int humanize,
+					  size_t pre_len, int nthreads);
+
+/* print_table_all_rows_sink() of the rows of @src */
+int print_table_source_sink(struct tbl_sink *sink, const struct tbl_row_source *src,
+			    enum format_type format, const char *pre,
+			    struct table_column **pColumns, bool use_color,
+			    int humanize, size_t pre_len);
+
+int tbl_layout_print_rows_parallel_sink(struct tbl_layout *layout,
+					struct tbl_sink *sink, void **v,
+					enum format_type format, const char *pre,
+					bool use_color, int humanize,
+					size_t pre_len, int nthreads);
+
 /* Print table header for format TERM */
 int print_table_header_term(const char *prefix, struct table_column **pColumns,
 			    bool use_color, char align);
 
+int print_table_header_term_sink(struct tbl_sink *sink, const char *prefix,
+				 struct table_column **pColumns, bool use_color,
+				 char align);
+
 /*
 * Print table header and table for format TERM 
 */
 int print_table_term(const char *prefix, struct table_column **pColumn,
 			 bool use_color);
 
+int print_table_term_sink(struct tbl_sink *sink, const char *prefix,
+			  struct table_column **pColumn, bool use_color);
+
 void print_table_entry_term(const char *prefix, struct table_field *pFields,
 			    struct table_column **pColumns, int hdr_width, bool use_color);
 
+void print_table_entry_term_sink(struct tbl_sink *sink, const char *prefix,
+				 struct table_field *pFields,
+				 struct table_column **pColumns, int hdr_width,
+				 bool use_color);
+
 /* CSV Print functions*/
 void print_table_header_csv(struct table_column **pColumns);
 
+void print_table_header_csv_sink(struct tbl_sink *sink,
+				 struct table_column **pColumns);
 
 /* Print @format in @pColor */
 int print_color(bool use_color, enum color pColor, const char *format, ...);
 
+int print_color_sink(struct tbl_sink *sink, bool use_color, enum color pColor,
+		     const char *format, ...) __attribute__((format(printf, 4, 5)));
+
 int print_table_single_row(void *v, enum format_type format, const char *pre,
 		    struct table_column **pColumns, bool use_color, int humanize,
 		    size_t pre_len);
 
+int print_table_single_row_sink(struct tbl_sink *sink, void *v,
+				enum format_type format, const char *pre,
+				struct table_column **pColumns, bool use_color,
+				int humanize, size_t pre_len);
+
 int print_table_all_rows(void **v, enum format_type format, const char *pre,
 		    struct table_column **pColumns, bool use_color, int humanize,
 		    size_t pre_len);
 
+/*
+ * Render the NULL terminated array of rows @v into @sink, the sink is
+ * flushed in batches of rows but not closed.
+ */
+int print_table_all_rows_sink(struct tbl_sink *sink, void **v,
+			      enum format_type format, const char *pre,
+			      struct table_column **pColumns, bool use_color,
+			      int humanize, size_t pre_len);
+
+/*
+ * print_table_all_rows() and print_table_all_rows_sink() of the @count
+ * structs of @stride bytes at @base, without an array of row pointers.
+ */
+int print_table_strided(const void *base, size_t stride, size_t count,
+			enum format_type format, const char *pre,
+			struct table_column **pColumns, bool use_color,
+			int humanize, size_t pre_len);
+
+int print_table_strided_sink(struct tbl_sink *sink, const void *base,
+			     size_t stride, size_t count, enum format_type format,
+			     const char *pre, struct table_column **pColumns,
+			     bool use_color, int humanize, size_t pre_len);
+
+/*
+ * print_table_all_rows() stringifying chunks of rows on @nthreads threads
+ * (one per CPU if 0), no more than there are chunks of rows. Tables of one
+ * chunk or less are printed serially. Chunks are emitted in order and the
+ * output is byte identical to print_table_all_rows(), including the widths
+ * left in the columns. The m_tostr() callbacks must be thread safe.
+ */
+int print_table_all_rows_parallel(void **v, enum format_type format,
+				  const char *pre, struct table_column **pColumns,
+				  bool use_color, int humanize, size_t pre_len,
+				  int nthreads);
+
+int print_table_all_rows_parallel_sink(struct tbl_sink *sink, void **v,
+				       enum format_type format, const char *pre,
+				       struct table_column **pColumns,
+				       bool use_color, int humanize,
+				       size_t pre_len, int nthreads);
+
 int print_table_row_line(const char *pre, struct table_column **pColumns,
 			 bool use_color, size_t pre_len);
 
+int print_table_row_line_sink(struct tbl_sink *sink, const char *pre,
+			      struct table_column **pColumns, bool use_color,
+			      size_t pre_len);
+
 			 
+/*
+ * Streaming TERM renderer. Column widths are taken from the declared widths
+ * and measured on the first @lookahead rows, then the header is printed and
+ * every further row is emitted as soon as it is pushed. Cells wider than
+ * their column are handled according to @overflow.
+ */
+enum tbl_overflow {
+	TBL_OVERFLOW_WIDEN,	/* widen the column and continue */
+	TBL_OVERFLOW_TRUNCATE,	/* cut the cell, ending it with @marker */
+	TBL_OVERFLOW_REFLOW	/* widen and reprint the header every @block rows */
+};
+
+#define TBL_STREAM_LOOKAHEAD 64
+#define TBL_STREAM_BLOCK 50
+
+struct tbl_stream_opts {
+	int		lookahead;	/* rows measured before the header */
+	enum tbl_overflow overflow;
+	int		block;		/* rows between header reprints */
+	const char	*marker;	/* truncation marker, "~" if NULL */
+	bool		type_widths;	/* reserve the widest value of numbers */
+	char		align;		/* header alignment, see print_table_header_term() */
+};
+
+struct tbl_stream {
+	struct tbl_sink		*sink;
+	struct table_column	**columns;
+	int			count;
+	int			*widths;
+	struct tbl_hot		hot;
+	const char		*prefix;
+	size_t			pre_len;
+	bool			use_color;
+	int			humanize;
+	struct tbl_stream_opts	opts;
+	struct tbl_plan		plan;
+	struct tbl_arena	arena;
+	struct tbl_cell		*cells;		/* the look-ahead rows */
+	int			pending;	/* rows waiting in @cells */
+	bool			started;	/* header printed */
+	bool			dirty;		/* widths grew since the header */
+	unsigned long		since_header;
+	unsigned long		rows;		/* rows emitted */
+	unsigned long		truncated;	/* cells cut by TBL_OVERFLOW_TRUNCATE */
+};
+
+/* @opts may be NULL for a look-ahead of TBL_STREAM_LOOKAHEAD rows */
+int tbl_stream_init(struct tbl_stream *st, struct tbl_sink *sink,
+		    const char *prefix, struct table_column **pColumns,
+		    bool use_color, int humanize, size_t pre_len,
+		    const struct tbl_stream_opts *opts);
+
+int tbl_stream_push(struct tbl_stream *st, void *row);
+
+/* Emit the rows still held back, release the stream and return its error */
+int tbl_stream_finish(struct tbl_stream *st);
+
+void tbl_stream_release(struct tbl_stream *st);
+
+/*
+ * Aggregates of the integer columns (table_type_is_number()) over the rows
+ * printed by the tbl_layout_print_rows*() functions while layout->totals
+ * is set, read from the rows in the same pass. Sums of signed columns are
+ * kept in two's complement and wrap at 64 bits. Those functions and the
+ * footer return -EINVAL if layout->totals has fewer columns than @layout.
+ */
+#define TBL_AGG_COUNT	0x01
+#define TBL_AGG_SUM	0x02
+#define TBL_AGG_MIN	0x04
+#define TBL_AGG_MAX	0x08
+#define TBL_AGG_AVG	0x10
+#define TBL_AGG_ALL	0x1f
+
+struct tbl_total {
+	uint64_t	sum;
+	uint64_t	min;
+	uint64_t	max;
+};
+
+struct tbl_totals {
+	unsigned long		rows;
+	int			count;
+	struct tbl_total	*columns;
+};
+
+/* Aggregates of @count columns, free them with tbl_totals_release() */
+int tbl_totals_init(struct tbl_totals *totals, int count);
+
+void tbl_totals_reset(struct tbl_totals *totals);
+
+void tbl_totals_release(struct tbl_totals *totals);
+
+/*
+ * Add the row @row, for callers printing their own row loops. Columns of
+ * @pColumns past totals->count are not aggregated.
+ */
+void tbl_totals_add(struct tbl_totals *totals, struct table_column **pColumns,
+		    const void *row);
+
+/*
+ * Grow the widths of @layout to the TERM footer cells of @aggs. Call it
+ * before printing the header when the totals are known up front (e.g.
+ * summed with tbl_totals_add()), so that the rows line up with the footer.
+ */
+int tbl_layout_fit_totals(struct tbl_layout *layout, size_t pre_len, unsigned aggs);
+
+/*
+ * Print the @aggs (TBL_AGG_*) of layout->totals: a row per aggregate for
+ * TERM (after a separator line) and CSV, labelled in the first non numeric
+ * column, a <summary> element for XML and a {"summary": ...} object for
+ * JSON and JSONL. The JSON object is printed like a row: without a newline
+ * after it and without the ",\n" which separates it from the rows before.
+ * TERM widens the columns of @layout which are too narrow for the footer
+ * first (see tbl_layout_fit_totals()). Returns -EINVAL for FORMAT_ARROW.
+ */
+int tbl_layout_print_totals_sink(struct tbl_layout *layout,
+				 struct tbl_sink *sink, enum format_type format,
+				 const char *prefix, bool use_color,
+				 size_t pre_len, unsigned aggs);
+
+/*
+ * Row filter compiled from an expression over the columns @all, e.g.
+ *   errors > 0 && (name ^= "sd" || name *= nvme) && !(state == 3)
+ * Integer columns are compared with == != < <= > >= to decimal, octal or
+ * hex numbers, FIELD_STR columns without a m_tostr() callback with
+ * == and != or ^= (prefix) and *= (substring) to a quoted or bare word.
+ * The expression is evaluated on the raw values of a row, so rows which
+ * are filtered out by the tbl_layout_print_rows*() functions are never
+ * stringified. A compiled filter is only read and can be shared by threads.
+ */
+struct tbl_filter_node;
+
+struct tbl_filter {
+	struct tbl_filter_node	*nodes;		/* postfix program */
+	int			count;
+	struct tbl_sink		strings;	/* string operands */
+};
+
+/* Returns -EINVAL for syntax errors, unknown columns or mismatching types */
+int tbl_filter_compile(struct tbl_filter *filter, const char *expr,
+		       struct table_column **all);
+
+bool tbl_filter_match(const struct tbl_filter *filter, const void *row);
+
+void tbl_filter_release(struct tbl_filter *filter);
+
+/*
+ * Sorting of rows by the raw values of their columns, without stringifying
+ * them: integer columns (also those with a m_tostr() callback, e.g. for
+ * humanized sizes) are compared as numbers, FIELD_STR columns without a
+ * callback as the '\0' terminated string at their offset. Other string
+ * columns can't be keys (-EINVAL). Later keys order rows equal in the
+ * earlier ones; the sort is not stable.
+ */
+#define TBL_SORT_MAX_KEYS 8
+
+struct tbl_sort_key {
+	struct table_column	*column;
+	bool			desc;
+};
+
+/*
+ * Parse the @delim separated list of column names @spec of @all into @keys
+ * of @max entries. A name prefixed by '-' sorts descending, by '+' (or
+ * none) ascending. Returns the number of keys or -EINVAL.
+ */
+int tbl_sort_parse(const char *spec, const char *delim, struct table_column **all,
+		   struct tbl_sort_key *keys, int max);
+
+/* Sort the NULL terminated array of rows @v in place */
+int tbl_sort_rows(void **v, const struct tbl_sort_key *keys, int nkeys);
+
+/*
+ * Store the first @k rows of @v by @keys in order in @top, an array of
+ * @k + 1 entries, followed by NULL. @v is not modified. A heap of @k rows is
+ * kept while scanning @v, so only the selected rows need to be printed.
+ * Returns the number of rows stored.
+ */
+long tbl_top_rows(void **v, const struct tbl_sort_key *keys, int nkeys,
+		  void **top, long k);
+
+/*
+ * Live TERM table redrawn in place at the top of the screen, e.g. once a
+ * second by a monitoring tool. The cells of the previous frame are kept and
+ * only the cells which changed are rewritten at their cursor position; rows
+ * are appended or cleared as the table grows or shrinks. The whole table is
+ * redrawn on the first frame, when a column got wider and after
+ * tbl_live_invalidate() (e.g. on SIGWINCH). A frame is wrapped in the
+ * synchronized update sequences and handed to the sink with one flush.
+ */
+struct tbl_live {
+	struct tbl_sink		*sink;
+	struct tbl_layout	layout;
+	const char		*prefix;
+	size_t			pre_len;
+	bool			use_color;
+	int			humanize;
+	char			align;		/* see print_table_header_term() */
+	struct tbl_plan		plan;
+	struct tbl_arena	arena[2];	/* text of the last and the next frame */
+	struct tbl_cell		*cells[2];
+	int			*cols;		/* old widths and screen columns */
+	int			cap;		/* rows each @cells holds */
+	int			last;		/* index of the last frame */
+	int			rows;		/* rows of the last frame */
+	bool			redraw;		/* draw the next frame in full */
+	unsigned long		frames;
+	unsigned long		redraws;	/* frames drawn in full */
+	unsigned long		updates;	/* cells rewritten in place */
+};
+
+int tbl_live_init(struct tbl_live *live, struct tbl_sink *sink,
+		  const char *prefix, struct table_column **pColumns,
+		  bool use_color, int humanize, size_t pre_len, char align);
+
+/* Draw the NULL terminated array of rows @v as the next frame */
+int tbl_live_frame(struct tbl_live *live, void **v);
+
+/* Draw the next frame in full, the screen content is unknown */
+void tbl_live_invalidate(struct tbl_live *live);
+
+void tbl_live_release(struct tbl_live *live);
+
+/*
+ * Render cost instrumentation. While a struct tbl_stats is attached to a
+ * thread with tbl_stats_attach(), the renders of that thread (and the
+ * workers of print_table_all_rows_parallel()) add to it. Columns are
+ * counted by their position in the rendered column set, the first
+ * stats->count of them; cycles are TSC ticks where available, nanoseconds
+ * otherwise. Rows rendered while no stats are attached skip the hooks, at
+ * the cost of a thread local load and a branch per row and cell. Only the
+ * build can remove them: with -DTBL_NO_STATS (make STATS=0) the
+ * instrumentation is compiled out and attaching fails with -EOPNOTSUPP.
+ */
+struct tbl_column_stats {
+	uint64_t	calls;		/* cells stringified */
+	uint64_t	cycles;		/* in m_tostr() or built-in formatting */
+	uint64_t	bytes;		/* text produced */
+	uint64_t	escapes;	/* characters escaped on output */
+	uint64_t	truncated;	/* cells cut at MAX_COLUMN_WIDTH */
+};
+
+struct tbl_stats {
+	uint64_t		rows;		/* rows stringified */
+	uint64_t		emitted;	/* rows printed */
+	uint64_t		stringify_cycles;
+	uint64_t		emit_cycles;
+	int			count;
+	struct tbl_column_stats	*columns;
+};
+
+/* Counters of @count columns, free them with tbl_stats_release() */
+int tbl_stats_init(struct tbl_stats *stats, int count);
+
+/* Attach @stats to the calling thread, NULL detaches */
+int tbl_stats_attach(struct tbl_stats *stats);
+
+void tbl_stats_reset(struct tbl_stats *stats);
+
+void tbl_stats_release(struct tbl_stats *stats);
+
+/* Print @stats of a render of @pColumns as a table in @format */
+int tbl_stats_print_sink(struct tbl_sink *sink, enum format_type format,
+			 const struct tbl_stats *stats,
+			 struct table_column **pColumns);
+
+/*
+ * Apache Arrow IPC stream (FORMAT_ARROW): a schema message followed by
+ * record batches of @batch rows (TBL_ARROW_BATCH if 0) and an end of
+ * stream marker. Integer columns are copied from the rows without text
+ * conversion into Int columns of the same width and signedness, in host
+ * byte order which the schema declares. All other columns are stringified
+ * into Utf8 columns. No value is null.
+ */
+#define TBL_ARROW_BATCH 4096
+
+struct tbl_arrow_column;
+
+struct tbl_arrow {
+	struct tbl_sink		*sink;
+	struct table_column	**columns;
+	int			count;
+	int			humanize;
+	int			batch;		/* rows per record batch */
+	int			rows;		/* rows in the open batch */
+	unsigned long		batches;	/* record batches written */
+	struct tbl_arrow_column	*data;
+	struct tbl_sink		meta;		/* flatbuffer of a message */
+	struct tbl_arena	arena;
+};
+
+/* Writes the schema message, @ar is released if that fails */
+int tbl_arrow_init(struct tbl_arrow *ar, struct tbl_sink *sink,
+		   struct table_column **pColumns, int humanize, int batch);
+
+int tbl_arrow_push(struct tbl_arrow *ar, void *row);
+
+/* Writes the open batch and the end of stream marker, then releases @ar */
+int tbl_arrow_finish(struct tbl_arrow *ar);
+
+void tbl_arrow_release(struct tbl_arrow *ar);
+
+#ifdef __cplusplus
+}
+#endif
+
 #endif /* __H_TABLE */
@@ -0,0 +1,720 @@
+/* SPDX-License-Identifier: GPL-2.0-or-later */
+#ifndef __HPP_TABLE
+#define __HPP_TABLE
+
+/*
+ * Header only C++17 layer over libtbl. A table is a constexpr list of
+ * member pointers with their names, headers and formatters:
+ *
+ *	static int fmt_state(char *str, size_t len, enum color *pColor,
+ *			     const int &v, int humanize);
+ *
+ *	static constexpr auto proc_table = tbl::make_table(
+ *		tbl::col<&proc::pid>("pid", "PID"),
+ *		tbl::col<&proc::name>("name", "Name").align('l'),
+ *		tbl::col<&proc::rss>("rss", "RSS").type(FIELD_BYTES),
+ *		tbl::col<&proc::state>("state", "State", fmt_state));
+ *
+ *	tbl::layout<proc_table> layout;
+ *	layout.print_rows(&sink, procs, FORMAT_JSON, NULL, false, 0, 0);
+ *
+ * The field types of the columns are deduced from the members (char
+ * arrays are FIELD_STR), the header widths are computed at compile time
+ * and the row loop of every format is instantiated for the table, so
+ * that cells are formatted without indirect calls. The output is byte
+ * identical to the tbl_layout_print_rows_sink() of layout.columns().
+ */
+
+#include "libtbl.h"
+#include <errno.h>
+#include <array>
+#include <cstddef>
+#include <iterator>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+
+namespace tbl {
+
+namespace detail {
+
+template <typename T>
+struct member;
+
+template <typename S, typename M>
+struct member<M S::*> {
+	using row_type = S;
+	using type = M;
+};
+
+template <auto Member>
+using row_t = typename member<decltype(Member)>::row_type;
+
+template <auto Member>
+using member_t = typename member<decltype(Member)>::type;
+
+template <typename M>
+constexpr bool is_str = std::is_array_v<M> &&
+			std::is_same_v<std::remove_extent_t<M>, char>;
+
+template <typename M>
+constexpr bool is_int = std::is_integral_v<M> && !std::is_same_v<M, bool> &&
+			!std::is_same_v<M, char>;
+
+/* The field type of a member formatted without a callback */
+template <typename M>
+constexpr enum field_type builtin_type()
+{
+	if constexpr (is_int<M>) {
+		if constexpr (sizeof(M) == 1)
+			return std::is_signed_v<M> ? FIELD_I8 : FIELD_U8;
+		else if constexpr (sizeof(M) == 2)
+			return std::is_signed_v<M> ? FIELD_I16 : FIELD_U16;
+		else if constexpr (sizeof(M) == 4)
+			return std::is_signed_v<M> ? FIELD_I32 : FIELD_U32;
+		else
+			return std::is_signed_v<M> ? FIELD_I64 : FIELD_U64;
+	}
+
+	return FIELD_STR;
+}
+
+/* Whether the C functions read a member of @M as @type */
+template <typename M>
+constexpr bool type_fits(enum field_type type)
+{
+	if constexpr (is_str<M>) {
+		return type == FIELD_STR;
+	} else if constexpr (is_int<M>) {
+		switch (type) {
+		case FIELD_NUM:
+		case FIELD_VAL:
+		case FIELD_I32:
+			return sizeof(M) == 4 && std::is_signed_v<M>;
+		case FIELD_U32:
+			return sizeof(M) == 4 && !std::is_signed_v<M>;
+		case FIELD_I8:
+		case FIELD_U8:
+		case FIELD_I16:
+		case FIELD_U16:
+		case FIELD_I64:
+			return type == builtin_type<M>();
+		case FIELD_STR:
+			return false;
+		default:	/* FIELD_LLU, FIELD_U64 and the unit types */
+			return sizeof(M) == 8 && !std::is_signed_v<M>;
+		}
+	}
+
+	return false;
+}
+
+constexpr bool type_is_number(enum field_type type)
+{
+	return type == FIELD_NUM || type == FIELD_LLU ||
+	       (type >= FIELD_I8 && type <= FIELD_SI);
+}
+
+constexpr bool type_is_int(enum field_type type)
+{
+	return type == FIELD_VAL || type_is_number(type);
+}
+
+constexpr bool type_is_unit(enum field_type type)
+{
+	return type >= FIELD_BYTES && type <= FIELD_SI;
+}
+
+constexpr size_t cstrlen(const char *str)
+{
+	size_t len = 0;
+
+	while (str[len])
+		len++;
+
+	return len;
+}
+
+/* Column names are literals of the JSON keys unless they need escaping */
+constexpr bool json_plain(const char *str)
+{
+	for (; *str; str++)
+		if ((unsigned char)*str < 0x20 || *str == '"' || *str == '\\')
+			return false;
+
+	return true;
+}
+
+/* sink_pad() of a cell whose display width @cols is already known */
+inline void pad(struct tbl_sink *sink, const char *str, size_t len, size_t cols,
+		int width, bool left)
+{
+	size_t w;
+
+	if (width < 0) {
+		left = true;
+		width = -width;
+	}
+	w = width;
+
+	if (!left && w > cols)
+		tbl_sink_fill(sink, ' ', w - cols);
+	tbl_sink_write(sink, str, len);
+	if (left && w > cols)
+		tbl_sink_fill(sink, ' ', w - cols);
+}
+
+struct no_format {};
+
+/* A row of @R, or the row a pointer @R points to */
+template <typename R>
+inline const auto &row_ref(const R &row)
+{
+	if constexpr (std::is_pointer_v<R>)
+		return *row;
+	else
+		return row;
+}
+
+} /* namespace detail */
+
+/*
+ * One column of @Member, formatted by @Format if given: a function or
+ * function object called as
+ *
+ *	int format(char *str, size_t len, enum color *pColor, const M &v,
+ *		   int humanize);
+ *
+ * with the contract of m_tostr(). The attributes are those of CLM(), the
+ * width defaults to the width of the header.
+ */
+template <auto Member, typename Format = detail::no_format>
+struct column {
+	using row_type = detail::row_t<Member>;
+	using member_type = detail::member_t<Member>;
+
+	static constexpr auto member = Member;
+	static constexpr bool has_format = !std::is_same_v<Format, detail::no_format>;
+
+	const char	*m_name;
+	const char	*m_header;
+	int		hdr_width;
+	const char	*m_descr;
+	enum field_type	m_type;
+	int		m_width;
+	char		column_align;
+	enum color	hdr_color;
+	enum color	clm_color;
+	Format		m_format;
+
+	constexpr column(const char *name, const char *header, Format format)
+		: m_name(name), m_header(header),
+		  hdr_width(detail::cstrlen(header)), m_descr(""),
+		  m_type(detail::builtin_type<member_type>()),
+		  m_width(detail::cstrlen(header)), column_align('r'),
+		  hdr_color(CNRM), clm_color(CNRM), m_format(format)
+	{
+	}
+
+	constexpr column width(int width) const
+	{
+		column c = *this;
+
+		c.m_width = width;
+		return c;
+	}
+
+	constexpr column align(char align) const
+	{
+		column c = *this;
+
+		c.column_align = align;
+		return c;
+	}
+
+	constexpr column colors(enum color hdr, enum color clm) const
+	{
+		column c = *this;
+
+		c.hdr_color = hdr;
+		c.clm_color = clm;
+		return c;
+	}
+
+	constexpr column descr(const char *descr) const
+	{
+		column c = *this;
+
+		c.m_descr = descr;
+		return c;
+	}
+
+	/* e.g. FIELD_BYTES for a uint64_t, FIELD_NUM for an int */
+	constexpr column type(enum field_type type) const
+	{
+		column c = *this;
+
+		c.m_type = type;
+		return c;
+	}
+};
+
+template <auto Member>
+constexpr column<Member> col(const char *name, const char *header)
+{
+	return column<Member>(name, header, detail::no_format());
+}
+
+/* @format is a function (stored as a pointer) or a function object */
+template <auto Member, typename Format>
+constexpr column<Member, Format> col(const char *name, const char *header,
+				     Format format)
+{
+	return column<Member, Format>(name, header, format);
+}
+
+template <typename... Columns>
+struct table {
+	static_assert(sizeof...(Columns) > 0, "a table needs a column");
+
+	using row_type = typename std::tuple_element_t<0, std::tuple<Columns...>>::row_type;
+
+	static_assert((std::is_same_v<typename Columns::row_type, row_type> && ...),
+		      "the columns of a table are members of one struct");
+
+	static constexpr size_t count = sizeof...(Columns);
+
+	std::tuple<Columns...>	columns;
+};
+
+template <typename... Columns>
+constexpr table<Columns...> make_table(Columns... columns)
+{
+	return table<Columns...>{ std::tuple<Columns...>(columns...) };
+}
+
+/*
+ * Render state of the constexpr table @Table, the C++ counterpart of
+ * struct tbl_layout: the widths start from the column widths and grow
+ * with the rows printed. The struct table_column array for the C
+ * functions (headers, totals, filters, Arrow) is built by the constructor.
+ */
+template <const auto &Table>
+class layout {
+public:
+	using table_type = std::remove_cv_t<std::remove_reference_t<decltype(Table)>>;
+	using row_type = typename table_type::row_type;
+
+	static constexpr size_t count = table_type::count;
+
+	layout()
+	{
+		init(std::make_index_sequence<count>());
+	}
+
+	~layout()
+	{
+		tbl_arena_release(&m_arena);
+	}
+
+	layout(const layout &) = delete;
+	layout &operator=(const layout &) = delete;
+
+	/* NULL terminated, the m_width of the columns set by store() */
+	struct table_column **columns()
+	{
+		return m_ptrs.data();
+	}
+
+	const std::array<int, count> &widths() const
+	{
+		return m_widths;
+	}
+
+	/* Store the widths in columns() like tbl_layout_store() */
+	void store()
+	{
+		for (size_t i = 0; i < count; i++)
+			m_columns[i].m_width = m_widths[i];
+	}
+
+	int print_header(struct tbl_sink *sink, const char *prefix, bool use_color,
+			 char align)
+	{
+		store();
+
+		return print_table_header_term_sink(sink, prefix, columns(), use_color,
+						    align);
+	}
+
+	/*
+	 * tbl_layout_print_rows_sink() of the rows [@first, @last), iterators
+	 * of row_type or of pointers to it.
+	 */
+	template <typename It>
+	int print_rows(struct tbl_sink *sink, It first, It last,
+		       enum format_type format, const char *pre, bool use_color,
+		       int humanize, size_t pre_len)
+	{
+		switch (format) {
+		case FORMAT_TERM:
+			return rows<FORMAT_TERM>(sink, first, last, pre, use_color,
+						 humanize, pre_len);
+		case FORMAT_CSV:
+			return rows<FORMAT_CSV>(sink, first, last, pre, use_color,
+						humanize, pre_len);
+		case FORMAT_JSON:
+			return rows<FORMAT_JSON>(sink, first, last, pre, use_color,
+						 humanize, pre_len);
+		case FORMAT_XML:
+			return rows<FORMAT_XML>(sink, first, last, pre, use_color,
+						humanize, pre_len);
+		case FORMAT_JSONL:
+			return rows<FORMAT_JSONL>(sink, first, last, NULL, false,
+						  humanize, pre_len);
+		case FORMAT_ARROW:
+			return arrow(sink, first, last, humanize);
+		}
+
+		return -EINVAL;
+	}
+
+	template <typename Rows>
+	int print_rows(struct tbl_sink *sink, const Rows &rows, enum format_type format,
+		       const char *pre, bool use_color, int humanize, size_t pre_len)
+	{
+		return print_rows(sink, std::begin(rows), std::end(rows), format, pre,
+				  use_color, humanize, pre_len);
+	}
+
+private:
+	/* Text of one cell, at @off in the arena until the row is complete */
+	struct cell {
+		const char	*str;
+		size_t		off;
+		size_t		len;
+		size_t		cols;	/* display width */
+		enum color	color;
+	};
+
+	template <size_t I>
+	static constexpr const auto &col()
+	{
+		return std::get<I>(Table.columns);
+	}
+
+	template <size_t I>
+	using col_t = std::remove_cv_t<std::remove_reference_t<decltype(col<I>())>>;
+
+	template <size_t I>
+	using member_t = typename col_t<I>::member_type;
+
+	template <size_t I>
+	static constexpr bool quoted(enum format_type format)
+	{
+		if (format == FORMAT_JSONL)
+			return !detail::type_is_int(col<I>().m_type);
+
+		return format != FORMAT_TERM && col<I>().m_type == FIELD_STR;
+	}
+
+	/* m_tostr() of the columns with a formatter, colored clm_color by default */
+	template <size_t I>
+	static int tostr(char *str, size_t len, enum color *pColor, void *v,
+			 int humanize)
+	{
+		*pColor = col<I>().clm_color;
+		return col<I>().m_format(str, len, pColor,
+					 *static_cast<const member_t<I> *>(v),
+					 humanize);
+	}
+
+	template <size_t I>
+	void init_column()
+	{
+		constexpr const auto &c = col<I>();
+		struct table_column *column = &m_columns[I];
+		alignas(row_type) static const char row[sizeof(row_type)] = {};
+		const row_type *s = reinterpret_cast<const row_type *>(row);
+
+		static_assert(detail::cstrlen(c.m_header) < sizeof(column->m_header),
+			      "column header too long");
+		static_assert(col_t<I>::has_format || detail::is_str<member_t<I>> ||
+			      detail::is_int<member_t<I>>,
+			      "members other than integers and char arrays need a formatter");
+		static_assert(col_t<I>::has_format || detail::type_fits<member_t<I>>(c.m_type),
+			      "field type doesn't match the member");
+
+		memset(column, 0, sizeof(*column));
+		column->m_name = c.m_name;
+		memcpy(column->m_header, c.m_header, detail::cstrlen(c.m_header));
+		column->hdr_width = c.hdr_width;
+		column->m_descr = c.m_descr;
+		column->m_type = c.m_type;
+		column->m_width = c.m_width;
+		column->m_offset = reinterpret_cast<const char *>(&(s->*col_t<I>::member)) - row;
+		if constexpr (col_t<I>::has_format)
+			column->m_tostr = tostr<I>;
+		column->column_align = c.column_align;
+		column->hdr_color = c.hdr_color;
+		column->clm_color = c.clm_color;
+
+		m_widths[I] = c.m_width;
+		m_ptrs[I] = column;
+	}
+
+	template <size_t... I>
+	void init(std::index_sequence<I...>)
+	{
+		(init_column<I>(), ...);
+		m_ptrs[count] = NULL;
+	}
+
+	/* arena_row_stringify() of column @I, returns 0 or -ENOMEM */
+	template <size_t I>
+	int stringify(const row_type &s, int humanize, size_t pre_len)
+	{
+		constexpr const auto &c = col<I>();
+		const member_t<I> &v = s.*col_t<I>::member;
+		struct cell *cell = &m_cells[I];
+		size_t avail = MAX_COLUMN_WIDTH;
+		char *str;
+		int len;
+
+		cell->color = c.clm_color;
+		if constexpr (col_t<I>::has_format) {
+			for (;;) {
+				str = tbl_arena_reserve(&m_arena, avail);
+				if (!str)
+					return -ENOMEM;
+				len = c.m_format(str, avail, &cell->color, v, humanize);
+				if (len < 0)
+					len = 0;
+				if ((size_t)len < avail)
+					break;
+				avail = len + 1;
+			}
+			str[len] = '\0';
+			cell->str = NULL;
+			cell->off = m_arena.used;
+			cell->len = len;
+			cell->cols = tbl_str_width(str, len);
+			m_arena.used += len + 1;
+		} else if constexpr (detail::is_str<member_t<I>>) {
+			cell->str = v;
+			cell->len = strnlen(v, sizeof(v));
+			cell->cols = tbl_str_width(v, cell->len);
+		} else {
+			str = m_nums[I];
+			if constexpr (detail::type_is_unit(c.m_type)) {
+				if (humanize)
+					len = tbl_humanize(str, c.m_type, v);
+				else
+					len = tbl_u64toa(str, v);
+			} else if constexpr (std::is_signed_v<member_t<I>>) {
+				len = tbl_i64toa(str, v);
+			} else {
+				len = tbl_u64toa(str, v);
+			}
+			cell->str = str;
+			cell->len = len;
+			cell->cols = len;
+		}
+
+		if (m_widths[I] < (int)(cell->cols + (I ? 0 : pre_len)))
+			m_widths[I] = cell->cols + (I ? 0 : pre_len);
+
+		return 0;
+	}
+
+	/* tbl_plan_emit() of column @I */
+	template <enum format_type F, size_t I>
+	void emit(struct tbl_sink *sink, const char *prefix, bool use_color,
+		  size_t pwidth, enum color *cur, size_t *plain, size_t *used)
+	{
+		constexpr const auto &c = col<I>();
+		constexpr bool q = quoted<I>(F);
+		constexpr bool null = !q && (F == FORMAT_JSON || F == FORMAT_JSONL);
+		const struct cell *cell = &m_cells[I];
+		const char *str = cell->str ?: m_arena.base + cell->off;
+		bool on = use_color && cell->color != CNRM;
+
+		if (on)
+			*plain += color_lens[cell->color] + color_lens[CNRM];
+
+		/* head */
+		if constexpr (F == FORMAT_CSV && I) {
+			*used += tbl_sink_color_switch(sink, cur, CNRM);
+			tbl_sink_putc(sink, ',');
+		} else if constexpr (F == FORMAT_JSON) {
+			*used += tbl_sink_color_switch(sink, cur, CNRM);
+			if (!I) {
+				tbl_sink_puts(sink, prefix);
+				tbl_sink_putc(sink, '{');
+			}
+			tbl_sink_puts(sink, I ? ",\n" : "\n");
+			tbl_sink_puts(sink, prefix);
+			tbl_sink_write(sink, "\t\"", 2);
+			tbl_sink_write(sink, c.m_name, detail::cstrlen(c.m_name));
+			tbl_sink_write(sink, "\": ", 3);
+		} else if constexpr (F == FORMAT_JSONL) {
+			*used += tbl_sink_color_switch(sink, cur, CNRM);
+			tbl_sink_write(sink, I ? ",\"" : "{\"", 2);
+			if constexpr (detail::json_plain(c.m_name))
+				tbl_sink_write(sink, c.m_name, detail::cstrlen(c.m_name));
+			else
+				tbl_escape_sink(sink, FORMAT_JSON, c.m_name,
+						detail::cstrlen(c.m_name));
+			tbl_sink_write(sink, "\":", 2);
+		} else if constexpr (F == FORMAT_XML) {
+			*used += tbl_sink_color_switch(sink, cur, CNRM);
+			if constexpr (I > 0) {
+				constexpr const char *prev = col<I - 1>().m_name;
+
+				tbl_sink_write(sink, "</", 2);
+				tbl_sink_write(sink, prev, detail::cstrlen(prev));
+				tbl_sink_write(sink, ">\n", 2);
+			}
+			tbl_sink_puts(sink, prefix);
+			tbl_sink_putc(sink, '<');
+			tbl_sink_write(sink, c.m_name, detail::cstrlen(c.m_name));
+			tbl_sink_putc(sink, '>');
+		}
+
+		if (null && !cell->len && !on) {
+			*used += tbl_sink_color_switch(sink, cur, CNRM);
+			tbl_sink_write(sink, "null", 4);
+			return;
+		}
+
+		*used += tbl_sink_color_switch(sink, cur, on ? cell->color : CNRM);
+		if constexpr (F == FORMAT_TERM) {
+			if (!I)
+				tbl_sink_puts(sink, prefix);
+			detail::pad(sink, str, cell->len, cell->cols,
+				    m_widths[I] - (I ? 0 : pwidth),
+				    c.column_align == 'l');
+			tbl_sink_write(sink, COLUMN_DELIMITER,
+				       sizeof(COLUMN_DELIMITER) - 1);
+		} else if constexpr (F == FORMAT_XML || q) {
+			if (q)
+				tbl_sink_putc(sink, '"');
+			tbl_escape_sink(sink, F == FORMAT_JSONL ? FORMAT_JSON : F,
+					str, cell->len);
+			if (q)
+				tbl_sink_putc(sink, '"');
+		} else if constexpr (F == FORMAT_JSONL ||
+				     (F == FORMAT_JSON && detail::type_is_unit(c.m_type))) {
+			if (tbl_json_number(str, cell->len)) {
+				tbl_sink_write(sink, str, cell->len);
+			} else {
+				/* e.g. humanized "1.5K" */
+				tbl_sink_putc(sink, '"');
+				tbl_escape_sink(sink, FORMAT_JSON, str, cell->len);
+				tbl_sink_putc(sink, '"');
+			}
+		} else {
+			tbl_sink_write(sink, str, cell->len);
+		}
+
+		if (!sink->color_runs)
+			*used += tbl_sink_color_switch(sink, cur, CNRM);
+	}
+
+	/* The end of a row, the head of the slot after the last column */
+	template <enum format_type F>
+	static void emit_tail(struct tbl_sink *sink, const char *prefix)
+	{
+		constexpr const char *last = col<count - 1>().m_name;
+
+		if constexpr (F == FORMAT_TERM || F == FORMAT_CSV) {
+			tbl_sink_putc(sink, '\n');
+		} else if constexpr (F == FORMAT_JSON) {
+			tbl_sink_putc(sink, '\n');
+			tbl_sink_puts(sink, prefix);
+			tbl_sink_putc(sink, '}');
+		} else if constexpr (F == FORMAT_JSONL) {
+			tbl_sink_write(sink, "}\n", 2);
+		} else {
+			tbl_sink_write(sink, "</", 2);
+			tbl_sink_write(sink, last, detail::cstrlen(last));
+			tbl_sink_write(sink, ">\n", 2);
+		}
+	}
+
+	template <enum format_type F, size_t... I>
+	int row(struct tbl_sink *sink, const row_type &s, const char *prefix,
+		bool use_color, int humanize, size_t pre_len,
+		std::index_sequence<I...>)
+	{
+		size_t plain = 0, used = 0;
+		enum color cur = CNRM;
+		int ret = 0;
+
+		tbl_arena_reset(&m_arena);
+		((ret = ret ?: stringify<I>(s, humanize, pre_len)), ...);
+		if (ret)
+			return ret;
+
+		(emit<F, I>(sink, prefix, use_color, pre_len, &cur, &plain, &used), ...);
+		used += tbl_sink_color_switch(sink, &cur, CNRM);
+		emit_tail<F>(sink, prefix);
+		sink->color_saved += plain - used;
+
+		return sink->error;
+	}
+
+	template <enum format_type F, typename It>
+	int rows(struct tbl_sink *sink, It first, It last, const char *pre,
+		 bool use_color, int humanize, size_t pre_len)
+	{
+		const char *prefix = pre ?: "";
+		int ret = 0;
+
+		for (It it = first; it != last; ++it) {
+			if (F == FORMAT_JSON && it != first)
+				tbl_sink_write(sink, ",\n", 2);
+
+			ret = row<F>(sink, detail::row_ref(*it), prefix, use_color,
+				     humanize, pre_len, std::make_index_sequence<count>());
+			if (ret)
+				break;
+			tbl_sink_row_end(sink);
+		}
+
+		return ret;
+	}
+
+	/* Arrow batches are built by the C encoder from columns() */
+	template <typename It>
+	int arrow(struct tbl_sink *sink, It first, It last, int humanize)
+	{
+		struct tbl_arrow ar;
+		int ret;
+
+		ret = tbl_arrow_init(&ar, sink, columns(), humanize, 0);
+		if (ret)
+			return ret;
+
+		for (It it = first; !ret && it != last; ++it)
+			ret = tbl_arrow_push(&ar, (void *)&detail::row_ref(*it));
+
+		if (ret) {
+			tbl_arrow_release(&ar);
+			return ret;
+		}
+
+		return tbl_arrow_finish(&ar);
+	}
+
+	std::array<struct table_column, count>		m_columns;
+	std::array<struct table_column *, count + 1>	m_ptrs;
+	std::array<int, count>				m_widths;
+	std::array<struct cell, count>			m_cells;
+	char						m_nums[count][TBL_INT_BUF_SIZE];
+	struct tbl_arena				m_arena = {};
+};
+
+} /* namespace tbl */
+
+#endif /* __HPP_TABLE */
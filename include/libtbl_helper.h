@@ -1,4 +1,7 @@
 /* SPDX-License-Identifier: GPL-2.0-or-later */
+#ifndef __H_TABLE_HELPER
+#define __H_TABLE_HELPER
+
 #include "libtbl.h"
 #include <ctype.h>	/* for isspace(); */
 #include <inttypes.h>
@@ -29,4 +32,261 @@ size_t get_dashed_line(char *buf, size_t buf_size, size_t len);
 int print_table_field_as_string_escaped(struct table_field *pFields,
 				   struct table_column *pColumns,
 				   bool use_color,
-				   enum format_type pFormat);
\ No newline at end of file
+				   enum format_type pFormat);
+
+static inline bool color_used(bool use_color, enum color pColor)
+{
+	return use_color && pColor != CNRM;
+}
+
+static inline void sink_color(struct tbl_sink *sink, enum color pColor)
+{
+	tbl_sink_write(sink, colors[pColor], color_lens[pColor]);
+}
+
+static inline void sink_color_on(struct tbl_sink *sink, bool use_color,
+				 enum color pColor)
+{
+	if (color_used(use_color, pColor))
+		sink_color(sink, pColor);
+}
+
+static inline void sink_color_off(struct tbl_sink *sink, bool use_color,
+				  enum color pColor)
+{
+	if (color_used(use_color, pColor))
+		sink_color(sink, CNRM);
+}
+
+/*
+ * Append @str of @len bytes padded to @width columns like printf("%*s")
+ * does for ASCII: right aligned unless @left is set or @width is negative.
+ */
+static inline void sink_pad(struct tbl_sink *sink, const char *str, size_t len,
+		     int width, bool left)
+{
+	size_t w, cols;
+
+	if (width < 0) {
+		left = true;
+		width = -width;
+	}
+	w = width;
+	cols = w ? tbl_str_width(str, len) : 0;
+
+	if (!left && w > cols)
+		tbl_sink_fill(sink, ' ', w - cols);
+	tbl_sink_write(sink, str, len);
+	if (left && w > cols)
+		tbl_sink_fill(sink, ' ', w - cols);
+}
+
+/*
+ * The stringified cells of one row, either @fields or @cells in @arena.
+ */
+struct tbl_row_cells {
+	struct table_field	*fields;
+	const struct tbl_arena	*arena;
+	const struct tbl_cell	*cells;
+};
+
+static inline const char *tbl_row_cell(const struct tbl_row_cells *row, int i,
+				       size_t *len, enum color *pColor)
+{
+	if (row->fields) {
+		*pColor = row->fields[i].mColor;
+		*len = strlen(row->fields[i].mName);
+		return row->fields[i].mName;
+	}
+
+	*pColor = row->cells[i].mColor;
+	*len = row->cells[i].len;
+	return row->arena->base + row->cells[i].off;
+}
+
+int print_row_cells_sink(struct tbl_sink *sink, enum format_type pFormat,
+			 const char *prefix, const struct tbl_row_cells *row,
+			 struct table_column **pColumns, bool use_color, int pwidth);
+
+/*
+ * Emit @row following @plan. TERM cells are padded to @widths instead of
+ * the m_width of the columns, unless @widths is NULL.
+ */
+int tbl_plan_emit(struct tbl_sink *sink, const struct tbl_plan *plan,
+		  const struct tbl_row_cells *row, const int *widths);
+
+/*
+ * TERM header taking the column widths from @widths instead of the
+ * m_width of the columns, unless @widths is NULL.
+ */
+int print_header_term_widths(struct tbl_sink *sink, const char *prefix,
+			     struct table_column **pColumns, const int *widths,
+			     bool use_color, char align);
+
+/* Add the aggregates of @from to @totals, over the columns both of them hold */
+void tbl_totals_merge(struct tbl_totals *totals, const struct tbl_totals *from,
+		      struct table_column **pColumns);
+
+/*
+ * Stringify one cell of @column at arena->base + arena->used, without
+ * advancing arena->used. Returns the length of the text or -ENOMEM.
+ */
+long arena_cell_stringify(struct tbl_arena *arena, struct table_column *column,
+			  enum color *pColor, void *v, int humanize);
+
+/*
+ * Stringify the row @s into @arena without touching the widths of the
+ * columns.
+ */
+int arena_row_stringify(void *s, struct tbl_arena *arena, struct tbl_cell *pCells,
+			const struct tbl_hot *hot, int humanize);
+
+/*
+ * Return the offset of the first byte of @str which has to be escaped in
+ * @format, @len if there is none. Scans 16 or 32 bytes at a time where the
+ * CPU supports it.
+ */
+size_t tbl_escape_scan(enum format_type format, const char *str, size_t len);
+
+/*
+ * Reentrant tokenizer of column name lists: return the next token of *@s
+ * delimited by any of @delim and store its length in @len, or NULL at the
+ * end. Tokens consisting of white space only are skipped.
+ */
+const char *tbl_next_name(const char **s, const char *delim, size_t *len);
+
+/* Compare @name to the @len bytes of @tok ignoring white space in @tok */
+bool tbl_name_eq(const char *name, const char *tok, size_t len);
+
+/* FIELD_NUM and the integer types, which get totals lines */
+static inline bool table_type_is_number(enum field_type type)
+{
+	return type == FIELD_NUM || type == FIELD_LLU ||
+	       (type >= FIELD_I8 && type <= FIELD_SI);
+}
+
+/* The uint64_t types humanized by tbl_humanize() */
+static inline bool table_type_is_unit(enum field_type type)
+{
+	return type >= FIELD_BYTES && type <= FIELD_SI;
+}
+
+/* The types formatted as integers, FIELD_VAL is an int as well */
+static inline bool table_type_is_int(enum field_type type)
+{
+	return type == FIELD_VAL || table_type_is_number(type);
+}
+
+static inline bool table_type_is_signed(enum field_type type)
+{
+	return type == FIELD_NUM || type == FIELD_VAL || type == FIELD_I8 ||
+	       type == FIELD_I16 || type == FIELD_I32 || type == FIELD_I64;
+}
+
+/*
+ * The integer at @v of the integer @type widened to 64 bits: sign extended
+ * for signed types, so compare as int64_t if table_type_is_signed().
+ */
+static inline uint64_t table_int_raw(enum field_type type, const void *v)
+{
+	switch (type) {
+	case FIELD_NUM:
+	case FIELD_VAL:
+	case FIELD_I32:
+		return *(const int32_t *)v;
+	case FIELD_I8:
+		return *(const int8_t *)v;
+	case FIELD_U8:
+		return *(const uint8_t *)v;
+	case FIELD_I16:
+		return *(const int16_t *)v;
+	case FIELD_U16:
+		return *(const uint16_t *)v;
+	case FIELD_U32:
+		return *(const uint32_t *)v;
+	case FIELD_I64:
+		return *(const int64_t *)v;
+	default:
+		return *(const uint64_t *)v;
+	}
+}
+
+/* layout->totals has fewer columns than @layout, its rows can't be added */
+static inline bool tbl_totals_short(const struct tbl_layout *layout)
+{
+	return layout->totals && layout->totals->count < layout->count;
+}
+
+/*
+ * Write the integer at @v of @type to @buf (TBL_INT_BUF_SIZE bytes), not
+ * '\0' terminated. Returns the length or -1 if @type is no integer type.
+ */
+int table_format_int(char *buf, enum field_type type, const void *v);
+
+/*
+ * Format the value @v of @column which has no m_tostr() callback into @str
+ * of @len bytes, unit types humanized if @humanize is set. Returns what
+ * snprintf() would.
+ */
+int table_format_builtin(char *str, size_t len, struct table_column *column,
+			 void *v, int humanize);
+
+/* table_format_builtin() of a value of @type */
+int table_format_type(char *str, size_t len, enum field_type type, void *v,
+		      int humanize);
+
+/*
+ * Instrumentation hooks: tbl_stats_get() is the stats attached to the
+ * thread, constant NULL with TBL_NO_STATS so that the hooks compile away.
+ * It is read once per row, so without attached stats a cell only pays a
+ * well predicted branch.
+ */
+extern __thread struct tbl_stats *tbl_stats_cur;
+
+#ifdef TBL_NO_STATS
+#define tbl_stats_get() ((struct tbl_stats *)NULL)
+#else
+#define tbl_stats_get() tbl_stats_cur
+#endif
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+
+static inline uint64_t tbl_stats_clock(void)
+{
+	return __rdtsc();
+}
+#else
+#include <time.h>
+
+static inline uint64_t tbl_stats_clock(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+#endif
+
+/* Worker threads of one render share the stats */
+static inline void tbl_stats_add(uint64_t *counter, uint64_t v)
+{
+	__atomic_fetch_add(counter, v, __ATOMIC_RELAXED);
+}
+
+static inline void tbl_stats_cell(struct tbl_stats *stats, int i, uint64_t cycles,
+				  size_t bytes, bool truncated)
+{
+	struct tbl_column_stats *cs;
+
+	if (i >= stats->count)
+		return;
+	cs = &stats->columns[i];
+	tbl_stats_add(&cs->calls, 1);
+	tbl_stats_add(&cs->cycles, cycles);
+	tbl_stats_add(&cs->bytes, bytes);
+	if (truncated)
+		tbl_stats_add(&cs->truncated, 1);
+}
+
+#endif /* __H_TABLE_HELPER */
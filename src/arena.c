@@ -0,0 +1,210 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+#include "libtbl.h"
+#include "libtbl_helper.h"
+#include <errno.h>
+#include <stdint.h>
+#include <string.h>
+
+#define ARENA_DEFAULT_SIZE (64 * 1024)
+
+/* room reserved for a cell before its length is known */
+#define ARENA_NUM_WIDTH 32
+
+int tbl_arena_init(struct tbl_arena *arena, size_t size_hint)
+{
+	memset(arena, 0, sizeof(*arena));
+
+	return tbl_arena_reserve(arena, size_hint ?: ARENA_DEFAULT_SIZE) ? 0 : -ENOMEM;
+}
+
+void tbl_arena_init_buf(struct tbl_arena *arena, char *buf, size_t size)
+{
+	arena->base = buf;
+	arena->used = 0;
+	arena->size = size;
+	arena->borrowed = true;
+}
+
+void tbl_arena_reset(struct tbl_arena *arena)
+{
+	arena->used = 0;
+}
+
+void tbl_arena_release(struct tbl_arena *arena)
+{
+	if (!arena->borrowed)
+		free(arena->base);
+	memset(arena, 0, sizeof(*arena));
+}
+
+char *tbl_arena_reserve(struct tbl_arena *arena, size_t len)
+{
+	size_t size = arena->size ?: ARENA_DEFAULT_SIZE;
+	char *base;
+
+	if (arena->size - arena->used >= len)
+		return arena->base + arena->used;
+
+	while (size - arena->used < len) {
+		if (size > SIZE_MAX / 2)
+			return NULL;
+		size *= 2;
+	}
+
+	if (arena->borrowed) {
+		base = malloc(size);
+		if (!base)
+			return NULL;
+		memcpy(base, arena->base, arena->used);
+		arena->borrowed = false;
+	} else {
+		base = realloc(arena->base, size);
+		if (!base)
+			return NULL;
+	}
+
+	arena->base = base;
+	arena->size = size;
+
+	return arena->base + arena->used;
+}
+
+/*
+ * Stringify one cell of @type at the end of @arena, growing the reserved
+ * room until the @tostr callback output fits. Returns the length of the
+ * text or a negative error.
+ */
+static long cell_stringify(struct tbl_arena *arena, enum field_type type,
+			   int (*tostr)(char *str, size_t len, enum color *pColor,
+					void *v, int humanize),
+			   enum color color, enum color *pColor, void *v,
+			   int humanize)
+{
+	size_t avail = MAX_COLUMN_WIDTH;
+	char *str;
+	int len;
+
+	if (!tostr) {
+		*pColor = color;
+		if (type == FIELD_STR) {
+			len = strlen(v);
+			str = tbl_arena_reserve(arena, len + 1);
+			if (!str)
+				return -ENOMEM;
+			memcpy(str, v, len);
+			str[len] = '\0';
+			return len;
+		}
+
+		str = tbl_arena_reserve(arena, ARENA_NUM_WIDTH);
+		if (!str)
+			return -ENOMEM;
+		len = table_format_type(str, ARENA_NUM_WIDTH, type, v, humanize);
+		return len < ARENA_NUM_WIDTH ? len : ARENA_NUM_WIDTH - 1;
+	}
+
+	for (;;) {
+		str = tbl_arena_reserve(arena, avail);
+		if (!str)
+			return -ENOMEM;
+		len = tostr(str, avail, pColor, v, humanize);
+		if (len < 0)
+			len = 0;
+		if ((size_t)len < avail)
+			break;
+		avail = len + 1;
+	}
+	str[len] = '\0';
+
+	return len;
+}
+
+long arena_cell_stringify(struct tbl_arena *arena, struct table_column *column,
+			  enum color *pColor, void *v, int humanize)
+{
+	return cell_stringify(arena, column->m_type, column->m_tostr,
+			      column->clm_color, pColor, v, humanize);
+}
+
+/*
+ * Stringify the row @s by the compiled @hot or, if it is NULL, by the NULL
+ * terminated @pColumns, so that single rows need no tbl_hot.
+ */
+static int row_stringify(void *s, struct tbl_arena *arena, struct tbl_cell *pCells,
+			 const struct tbl_hot *hot, struct table_column **pColumns,
+			 int humanize)
+{
+	struct tbl_stats *stats = tbl_stats_get();
+	struct table_column *column;
+	uint64_t start = 0, t = 0;
+	int columnCount;
+	long len;
+	void *v;
+
+	if (stats)
+		start = tbl_stats_clock();
+
+	for (columnCount = 0; hot ? columnCount < hot->count : !!pColumns[columnCount];
+	     columnCount++) {
+		if (arena->used + MAX_COLUMN_WIDTH > UINT32_MAX)
+			return -E2BIG;
+
+		if (stats)
+			t = tbl_stats_clock();
+		if (hot) {
+			v = (char *)s + hot->offs[columnCount];
+			len = cell_stringify(arena, hot->types[columnCount],
+					     hot->tostr[columnCount],
+					     hot->colors[columnCount],
+					     &pCells[columnCount].mColor, v, humanize);
+		} else {
+			column = pColumns[columnCount];
+			v = (char *)s + column->s_off + column->m_offset;
+			len = arena_cell_stringify(arena, column,
+						   &pCells[columnCount].mColor, v,
+						   humanize);
+		}
+		if (len < 0)
+			return len;
+		if (stats)
+			tbl_stats_cell(stats, columnCount, tbl_stats_clock() - t, len, false);
+
+		pCells[columnCount].off = arena->used;
+		pCells[columnCount].len = len;
+		arena->used += len + 1;
+	}
+
+	if (stats) {
+		tbl_stats_add(&stats->rows, 1);
+		tbl_stats_add(&stats->stringify_cycles, tbl_stats_clock() - start);
+	}
+
+	return 0;
+}
+
+int arena_row_stringify(void *s, struct tbl_arena *arena, struct tbl_cell *pCells,
+			const struct tbl_hot *hot, int humanize)
+{
+	return row_stringify(s, arena, pCells, hot, NULL, humanize);
+}
+
+int table_row_stringify_arena(void *s, struct tbl_arena *arena,
+			      struct tbl_cell *pCells,
+			      struct table_column **pColumns, int humanize,
+			      int prefix_len)
+{
+	int i, len, ret;
+
+	ret = row_stringify(s, arena, pCells, NULL, pColumns, humanize);
+	if (ret)
+		return ret;
+
+	for (i = 0; pColumns[i]; i++) {
+		len = tbl_str_width(arena->base + pCells[i].off, pCells[i].len) +
+		      (i ? 0 : prefix_len);
+		if (pColumns[i]->m_width < len)
+			pColumns[i]->m_width = len;
+	}
+
+	return 0;
+}
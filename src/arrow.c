@@ -0,0 +1,459 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+#include "libtbl.h"
+#include "libtbl_helper.h"
+#include <errno.h>
+#include <limits.h>
+#include <string.h>
+
+/*
+ * Apache Arrow IPC stream writer. Every message is a continuation marker,
+ * the length of the flatbuffer metadata, the metadata padded to 8 bytes
+ * and the message body. The flatbuffers are laid out front to back:
+ * children always follow their parent, so every offset points forward
+ * and is patched once the child has been placed.
+ */
+
+#define ARROW_CONTINUATION	0xffffffffu
+#define ARROW_METADATA_V5	4
+#define ARROW_HEADER_SCHEMA	1
+#define ARROW_HEADER_BATCH	3
+#define ARROW_TYPE_INT		2
+#define ARROW_TYPE_UTF8		5
+
+#define ARROW_MAX_FIELDS	6
+
+struct tbl_arrow_column {
+	struct tbl_sink	values;		/* fixed width values or UTF-8 bytes */
+	struct tbl_sink	offsets;	/* int32_t offsets of UTF-8 columns */
+	int		width;		/* bytes per integer, 0 for UTF-8 */
+	bool		is_signed;
+};
+
+static inline size_t fb_align(size_t pos, size_t align)
+{
+	return (pos + align - 1) / align * align;
+}
+
+static void fb_pad(struct tbl_sink *b, size_t align)
+{
+	tbl_sink_fill(b, 0, fb_align(b->len, align) - b->len);
+}
+
+/* Flatbuffers are little endian whatever the host is */
+static void fb_le(struct tbl_sink *b, size_t at, uint64_t v, int size)
+{
+	int i;
+
+	if (b->error)
+		return;
+	for (i = 0; i < size; i++)
+		b->buf[at + i] = v >> (8 * i);
+}
+
+static size_t fb_uint(struct tbl_sink *b, uint64_t v, int size)
+{
+	size_t at = b->len;
+
+	tbl_sink_fill(b, 0, size);
+	fb_le(b, at, v, size);
+
+	return at;
+}
+
+/* Point the offset at @at to the object at @target */
+static void fb_link(struct tbl_sink *b, size_t at, size_t target)
+{
+	fb_le(b, at, target - at, 4);
+}
+
+/*
+ * Lay out a table of @n fields of @sizes bytes (0 if absent) after its
+ * vtable, store the position of each field in @pos and return the position
+ * of the table.
+ */
+static size_t fb_table(struct tbl_sink *b, int n, const uint8_t *sizes, size_t *pos)
+{
+	uint16_t off[ARROW_MAX_FIELDS];
+	size_t vt, tbl, size = 4;
+	int i;
+
+	for (i = 0; i < n; i++) {
+		off[i] = 0;
+		if (!sizes[i])
+			continue;
+		size = fb_align(size, sizes[i]);
+		off[i] = size;
+		size += sizes[i];
+	}
+
+	fb_pad(b, 2);
+	vt = fb_uint(b, 4 + 2 * n, 2);
+	fb_uint(b, size, 2);
+	for (i = 0; i < n; i++)
+		fb_uint(b, off[i], 2);
+
+	fb_pad(b, 8);
+	tbl = fb_uint(b, 0, 4);
+	fb_le(b, tbl, tbl - vt, 4);
+	tbl_sink_fill(b, 0, size - 4);
+
+	for (i = 0; i < n; i++)
+		pos[i] = tbl + off[i];
+
+	return tbl;
+}
+
+/* Start a vector of @n elements of @size bytes, returns its position */
+static size_t fb_vector(struct tbl_sink *b, uint32_t n, size_t size, size_t align)
+{
+	size_t at;
+
+	tbl_sink_fill(b, 0, fb_align(b->len + 4, align) - b->len - 4);
+	at = fb_uint(b, n, 4);
+	tbl_sink_fill(b, 0, n * size);
+
+	return at;
+}
+
+static size_t fb_string(struct tbl_sink *b, const char *s)
+{
+	size_t len = strlen(s);
+	size_t at;
+
+	fb_pad(b, 4);
+	at = fb_uint(b, len, 4);
+	tbl_sink_write(b, s, len);
+	tbl_sink_putc(b, '\0');
+
+	return at;
+}
+
+/* Start a Message with @header_type, returns the position of its header offset */
+static size_t arrow_message(struct tbl_sink *b, int header_type, size_t body_len)
+{
+	static const uint8_t sizes[] = { 2, 1, 4, 8 };
+	size_t pos[4], root;
+
+	b->len = 0;
+	root = fb_uint(b, 0, 4);
+	fb_link(b, root, fb_table(b, 4, sizes, pos));
+	fb_le(b, pos[0], ARROW_METADATA_V5, 2);
+	fb_le(b, pos[1], header_type, 1);
+	fb_le(b, pos[3], body_len, 8);
+
+	return pos[2];
+}
+
+/* Hand the metadata in ar->meta over to the sink */
+static int arrow_flush_meta(struct tbl_arrow *ar)
+{
+	struct tbl_sink *b = &ar->meta;
+	size_t at;
+
+	fb_pad(b, 8);
+	if (b->error)
+		return b->error;
+
+	at = b->len;
+	fb_uint(b, ARROW_CONTINUATION, 4);
+	fb_uint(b, at, 4);
+	tbl_sink_write(ar->sink, b->buf + at, 8);
+	tbl_sink_write(ar->sink, b->buf, at);
+
+	return ar->sink->error;
+}
+
+static int arrow_schema(struct tbl_arrow *ar)
+{
+	static const uint8_t schema_sizes[] = { 2, 4 };
+	static const uint8_t field_sizes[] = { 4, 1, 1, 4, 0, 4 };
+	static const uint8_t int_sizes[] = { 4, 1 };
+	struct tbl_sink *b = &ar->meta;
+	struct tbl_arrow_column *col;
+	size_t header, vec, tbl, pos[ARROW_MAX_FIELDS], fpos[ARROW_MAX_FIELDS];
+	int i;
+
+	header = arrow_message(b, ARROW_HEADER_SCHEMA, 0);
+	fb_link(b, header, fb_table(b, 2, schema_sizes, pos));
+	fb_le(b, pos[0], __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__, 2);
+
+	vec = fb_vector(b, ar->count, 4, 4);
+	fb_link(b, pos[1], vec);
+
+	for (i = 0; i < ar->count; i++) {
+		col = &ar->data[i];
+		fb_link(b, vec + 4 + 4 * i, fb_table(b, 6, field_sizes, fpos));
+		fb_link(b, fpos[0], fb_string(b, ar->columns[i]->m_name));
+		fb_le(b, fpos[2], col->width ? ARROW_TYPE_INT : ARROW_TYPE_UTF8, 1);
+		if (col->width) {
+			tbl = fb_table(b, 2, int_sizes, pos);
+			fb_le(b, pos[0], col->width * 8, 4);
+			fb_le(b, pos[1], col->is_signed, 1);
+		} else {
+			tbl = fb_table(b, 0, NULL, pos);
+		}
+		fb_link(b, fpos[3], tbl);
+		fb_link(b, fpos[5], fb_vector(b, 0, 4, 4));
+	}
+
+	return arrow_flush_meta(ar);
+}
+
+static size_t arrow_body_len(const struct tbl_arrow *ar)
+{
+	const struct tbl_arrow_column *col;
+	size_t len = 0;
+	int i;
+
+	for (i = 0; i < ar->count; i++) {
+		col = &ar->data[i];
+		len += fb_align(col->values.len, 8);
+		if (!col->width)
+			len += fb_align(col->offsets.len, 8);
+	}
+
+	return len;
+}
+
+static void arrow_buffer(struct tbl_sink *b, size_t at, size_t *off, size_t len)
+{
+	fb_le(b, at, *off, 8);
+	fb_le(b, at + 8, len, 8);
+	*off += fb_align(len, 8);
+}
+
+static void arrow_body(struct tbl_sink *sink, const struct tbl_sink *buf)
+{
+	tbl_sink_write(sink, buf->buf, buf->len);
+	tbl_sink_fill(sink, 0, fb_align(buf->len, 8) - buf->len);
+}
+
+static int arrow_batch(struct tbl_arrow *ar)
+{
+	static const uint8_t batch_sizes[] = { 8, 4, 4 };
+	struct tbl_sink *b = &ar->meta;
+	struct tbl_arrow_column *col;
+	size_t header, nodes, bufs, pos[3], off = 0;
+	int i, nbufs = 0;
+	int32_t zero = 0;
+
+	for (i = 0; i < ar->count; i++)
+		nbufs += ar->data[i].width ? 2 : 3;
+
+	header = arrow_message(b, ARROW_HEADER_BATCH, arrow_body_len(ar));
+	fb_link(b, header, fb_table(b, 3, batch_sizes, pos));
+	fb_le(b, pos[0], ar->rows, 8);
+
+	nodes = fb_vector(b, ar->count, 16, 8);
+	fb_link(b, pos[1], nodes);
+	for (i = 0; i < ar->count; i++)
+		fb_le(b, nodes + 4 + 16 * i, ar->rows, 8);
+
+	/* no nulls: every validity bitmap is empty */
+	bufs = fb_vector(b, nbufs, 16, 8) + 4;
+	fb_link(b, pos[2], bufs - 4);
+	for (i = 0; i < ar->count; i++) {
+		col = &ar->data[i];
+		arrow_buffer(b, bufs, &off, 0);
+		bufs += 16;
+		if (!col->width) {
+			arrow_buffer(b, bufs, &off, col->offsets.len);
+			bufs += 16;
+		}
+		arrow_buffer(b, bufs, &off, col->values.len);
+		bufs += 16;
+	}
+
+	if (arrow_flush_meta(ar))
+		return ar->sink->error ?: b->error;
+
+	for (i = 0; i < ar->count; i++) {
+		col = &ar->data[i];
+		if (!col->width)
+			arrow_body(ar->sink, &col->offsets);
+		arrow_body(ar->sink, &col->values);
+
+		col->values.len = 0;
+		col->offsets.len = 0;
+		if (!col->width)
+			tbl_sink_write(&col->offsets, &zero, sizeof(zero));
+	}
+	ar->rows = 0;
+	ar->batches++;
+
+	return tbl_sink_row_end(ar->sink);
+}
+
+/* Arrow integer type of a libtbl integer type, false for the others */
+static bool arrow_int_type(enum field_type type, int *width, bool *is_signed)
+{
+	switch (type) {
+	case FIELD_NUM:
+	case FIELD_VAL:
+	case FIELD_I32:
+		*width = 4;
+		*is_signed = true;
+		return true;
+	case FIELD_LLU:
+	case FIELD_U64:
+	case FIELD_BYTES:
+	case FIELD_BYTES_RATE:
+	case FIELD_NSEC:
+	case FIELD_SI:
+		*width = 8;
+		*is_signed = false;
+		return true;
+	case FIELD_I8:
+	case FIELD_U8:
+		*width = 1;
+		break;
+	case FIELD_I16:
+	case FIELD_U16:
+		*width = 2;
+		break;
+	case FIELD_U32:
+		*width = 4;
+		break;
+	case FIELD_I64:
+		*width = 8;
+		break;
+	default:
+		return false;
+	}
+	*is_signed = type == FIELD_I8 || type == FIELD_I16 || type == FIELD_I64;
+
+	return true;
+}
+
+int tbl_arrow_init(struct tbl_arrow *ar, struct tbl_sink *sink,
+		   struct table_column **pColumns, int humanize, int batch)
+{
+	struct tbl_arrow_column *col;
+	int32_t zero = 0;
+	int i, ret;
+
+	memset(ar, 0, sizeof(*ar));
+	ar->sink = sink;
+	ar->columns = pColumns;
+	ar->count = table_column_count(pColumns);
+	ar->humanize = humanize;
+	ar->batch = batch > 0 ? batch : TBL_ARROW_BATCH;
+
+	ar->data = calloc(ar->count ?: 1, sizeof(*ar->data));
+	if (!ar->data || tbl_sink_init_heap(&ar->meta, 1024))
+		goto nomem;
+
+	for (i = 0; i < ar->count; i++) {
+		col = &ar->data[i];
+		if (tbl_sink_init_heap(&col->values, 1024))
+			goto nomem;
+		if (arrow_int_type(pColumns[i]->m_type, &col->width, &col->is_signed))
+			continue;
+		if (tbl_sink_init_heap(&col->offsets, 1024))
+			goto nomem;
+		tbl_sink_write(&col->offsets, &zero, sizeof(zero));
+	}
+
+	ret = arrow_schema(ar);
+	if (ret)
+		tbl_arrow_release(ar);
+
+	return ret;
+nomem:
+	tbl_arrow_release(ar);
+	return -ENOMEM;
+}
+
+int tbl_arrow_push(struct tbl_arrow *ar, void *s)
+{
+	struct tbl_stats *stats = tbl_stats_get();
+	struct table_column *column;
+	struct tbl_arrow_column *col;
+	uint64_t t = 0;
+	enum color pColor;
+	const char *str;
+	int32_t end;
+	long len;
+	void *v;
+	int i;
+
+	for (i = 0; i < ar->count; i++) {
+		column = ar->columns[i];
+		col = &ar->data[i];
+		v = (char *)s + column->s_off + column->m_offset;
+
+		if (col->width) {
+			tbl_sink_write(&col->values, v, col->width);
+			continue;
+		}
+
+		if (column->m_type == FIELD_STR && !column->m_tostr) {
+			str = v;
+			len = strlen(str);
+		} else {
+			tbl_arena_reset(&ar->arena);
+			if (stats)
+				t = tbl_stats_clock();
+			len = arena_cell_stringify(&ar->arena, column, &pColor, v,
+						   ar->humanize);
+			if (len < 0)
+				return len;
+			if (stats)
+				tbl_stats_cell(stats, i, tbl_stats_clock() - t, len, false);
+			str = ar->arena.base;
+		}
+
+		/* the offsets are int32_t, use smaller batches for more text */
+		if (col->values.len + len > INT32_MAX)
+			return -E2BIG;
+
+		tbl_sink_write(&col->values, str, len);
+		end = col->values.len;
+		tbl_sink_write(&col->offsets, &end, sizeof(end));
+	}
+
+	for (i = 0; i < ar->count; i++)
+		if (ar->data[i].values.error || ar->data[i].offsets.error)
+			return -ENOMEM;
+
+	if (++ar->rows >= ar->batch)
+		return arrow_batch(ar);
+
+	return ar->sink->error;
+}
+
+int tbl_arrow_finish(struct tbl_arrow *ar)
+{
+	int ret = 0;
+
+	if (ar->rows)
+		ret = arrow_batch(ar);
+
+	if (!ret) {
+		/* end of stream */
+		ar->meta.len = 0;
+		fb_uint(&ar->meta, ARROW_CONTINUATION, 4);
+		fb_uint(&ar->meta, 0, 4);
+		tbl_sink_write(ar->sink, ar->meta.buf, ar->meta.len);
+		ret = ar->sink->error;
+	}
+	tbl_arrow_release(ar);
+
+	return ret;
+}
+
+void tbl_arrow_release(struct tbl_arrow *ar)
+{
+	int i;
+
+	if (ar->data) {
+		for (i = 0; i < ar->count; i++) {
+			tbl_sink_release(&ar->data[i].values);
+			tbl_sink_release(&ar->data[i].offsets);
+		}
+		free(ar->data);
+		ar->data = NULL;
+	}
+	tbl_sink_release(&ar->meta);
+	tbl_arena_release(&ar->arena);
+}
@@ -0,0 +1,234 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+#include "libtbl.h"
+#include "libtbl_helper.h"
+#include <stdint.h>
+#include <string.h>
+
+/* AVX2 is picked at run time, SSE2 only where the target guarantees it */
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define ESCAPE_X86
+#if defined(__SSE2__)
+#define ESCAPE_SSE2
+#endif
+#endif
+
+/*
+ * Bytes which need escaping: up to three literal characters plus, for
+ * JSON, every control character. @need is the same as a lookup table for
+ * the scalar scan.
+ */
+struct escape_set {
+	char		c[3];
+	bool		ctrl;
+	unsigned char	need[256];
+};
+
+static const struct escape_set escape_sets[] = {
+	[FORMAT_CSV]	= { { '"', '"', '"' }, false, { ['"'] = 1 } },
+	[FORMAT_JSON]	= { { '"', '\\', '\\' }, true,
+			    { [0 ... 0x1f] = 1, ['"'] = 1, ['\\'] = 1 } },
+	[FORMAT_XML]	= { { '<', '>', '&' }, false,
+			    { ['<'] = 1, ['>'] = 1, ['&'] = 1 } },
+};
+
+static size_t scan_scalar(const struct escape_set *set, const char *str,
+			  size_t i, size_t len)
+{
+	for (; i < len; i++)
+		if (set->need[(unsigned char)str[i]])
+			break;
+
+	return i;
+}
+
+#ifdef ESCAPE_SSE2
+static size_t scan_sse2(const struct escape_set *set, const char *str, size_t len)
+{
+	const __m128i c0 = _mm_set1_epi8(set->c[0]);
+	const __m128i c1 = _mm_set1_epi8(set->c[1]);
+	const __m128i c2 = _mm_set1_epi8(set->c[2]);
+	const __m128i ctrl = _mm_set1_epi8(set->ctrl ? 0x1f : 0);
+	const __m128i on = _mm_set1_epi8(set->ctrl ? 0xff : 0);
+	__m128i x, m;
+	unsigned mask;
+	size_t i;
+
+	for (i = 0; i + 16 <= len; i += 16) {
+		x = _mm_loadu_si128((const __m128i *)(str + i));
+		m = _mm_or_si128(_mm_cmpeq_epi8(x, c0), _mm_cmpeq_epi8(x, c1));
+		m = _mm_or_si128(m, _mm_cmpeq_epi8(x, c2));
+		/* x <= 0x1f unsigned */
+		m = _mm_or_si128(m, _mm_and_si128(on,
+				 _mm_cmpeq_epi8(_mm_max_epu8(x, ctrl), ctrl)));
+		mask = _mm_movemask_epi8(m);
+		if (mask)
+			return i + __builtin_ctz(mask);
+	}
+
+	return scan_scalar(set, str, i, len);
+}
+#endif
+
+#ifdef ESCAPE_X86
+__attribute__((target("avx2")))
+static size_t scan_avx2(const struct escape_set *set, const char *str, size_t len)
+{
+	const __m256i c0 = _mm256_set1_epi8(set->c[0]);
+	const __m256i c1 = _mm256_set1_epi8(set->c[1]);
+	const __m256i c2 = _mm256_set1_epi8(set->c[2]);
+	const __m256i ctrl = _mm256_set1_epi8(set->ctrl ? 0x1f : 0);
+	const __m256i on = _mm256_set1_epi8(set->ctrl ? 0xff : 0);
+	__m256i x, m;
+	unsigned mask;
+	size_t i;
+
+	for (i = 0; i + 32 <= len; i += 32) {
+		x = _mm256_loadu_si256((const __m256i *)(str + i));
+		m = _mm256_or_si256(_mm256_cmpeq_epi8(x, c0), _mm256_cmpeq_epi8(x, c1));
+		m = _mm256_or_si256(m, _mm256_cmpeq_epi8(x, c2));
+		m = _mm256_or_si256(m, _mm256_and_si256(on,
+				    _mm256_cmpeq_epi8(_mm256_max_epu8(x, ctrl), ctrl)));
+		mask = _mm256_movemask_epi8(m);
+		if (mask)
+			break;
+	}
+
+	/*
+	 * Leave the upper halves of the ymm registers clean, SSE code running
+	 * afterwards (also memcpy() and the tail scan) is slowed down a lot
+	 * otherwise.
+	 */
+	_mm256_zeroupper();
+	if (i + 32 <= len)
+		return i + __builtin_ctz(mask);
+
+#ifdef ESCAPE_SSE2
+	return i + scan_sse2(set, str + i, len - i);
+#else
+	return scan_scalar(set, str, i, len);
+#endif
+}
+#endif
+
+static size_t scan_generic(const struct escape_set *set, const char *str, size_t len)
+{
+	return scan_scalar(set, str, 0, len);
+}
+
+static size_t scan_dispatch(const struct escape_set *set, const char *str, size_t len);
+
+static size_t (*escape_scan_fn)(const struct escape_set *set, const char *str,
+				size_t len) = scan_dispatch;
+
+/* Pick the widest kernel the CPU supports on the first call */
+static size_t scan_dispatch(const struct escape_set *set, const char *str, size_t len)
+{
+	size_t (*fn)(const struct escape_set *, const char *, size_t) = scan_generic;
+
+#ifdef ESCAPE_SSE2
+	fn = scan_sse2;
+#endif
+#ifdef ESCAPE_X86
+	__builtin_cpu_init();
+	if (__builtin_cpu_supports("avx2"))
+		fn = scan_avx2;
+#endif
+	__atomic_store_n(&escape_scan_fn, fn, __ATOMIC_RELAXED);
+
+	return fn(set, str, len);
+}
+
+size_t tbl_escape_scan(enum format_type format, const char *str, size_t len)
+{
+	if (format != FORMAT_CSV && format != FORMAT_JSON && format != FORMAT_XML)
+		return len;
+
+	/* most cells are shorter than a vector */
+	if (len < 16)
+		return scan_scalar(&escape_sets[format], str, 0, len);
+
+	return __atomic_load_n(&escape_scan_fn, __ATOMIC_RELAXED)(&escape_sets[format],
+								   str, len);
+}
+
+static void escape_json(struct tbl_sink *sink, unsigned char c)
+{
+	static const char hex[] = "0123456789abcdef";
+	char u[6] = { '\\', 'u', '0', '0' };
+
+	switch (c) {
+	case '"':
+		tbl_sink_write(sink, "\\\"", 2);
+		break;
+	case '\\':
+		tbl_sink_write(sink, "\\\\", 2);
+		break;
+	case '\b':
+		tbl_sink_write(sink, "\\b", 2);
+		break;
+	case '\f':
+		tbl_sink_write(sink, "\\f", 2);
+		break;
+	case '\n':
+		tbl_sink_write(sink, "\\n", 2);
+		break;
+	case '\r':
+		tbl_sink_write(sink, "\\r", 2);
+		break;
+	case '\t':
+		tbl_sink_write(sink, "\\t", 2);
+		break;
+	default:
+		u[4] = hex[c >> 4];
+		u[5] = hex[c & 0xf];
+		tbl_sink_write(sink, u, sizeof(u));
+		break;
+	}
+}
+
+static void escape_xml(struct tbl_sink *sink, char c)
+{
+	switch (c) {
+	case '<':
+		tbl_sink_write(sink, "&lt;", 4);
+		break;
+	case '>':
+		tbl_sink_write(sink, "&gt;", 4);
+		break;
+	default:
+		tbl_sink_write(sink, "&amp;", 5);
+		break;
+	}
+}
+
+size_t tbl_escape_sink(struct tbl_sink *sink, enum format_type format,
+		       const char *str, size_t len)
+{
+	size_t hits = 0;
+	size_t n;
+
+	for (;;) {
+		n = tbl_escape_scan(format, str, len);
+		tbl_sink_write(sink, str, n);
+		if (n == len)
+			break;
+
+		hits++;
+		switch (format) {
+		case FORMAT_CSV:
+			tbl_sink_write(sink, "\"\"", 2);
+			break;
+		case FORMAT_JSON:
+			escape_json(sink, str[n]);
+			break;
+		default:
+			escape_xml(sink, str[n]);
+			break;
+		}
+		str += n + 1;
+		len -= n + 1;
+	}
+
+	return hits;
+}
@@ -0,0 +1,362 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+#include "libtbl.h"
+#include "libtbl_helper.h"
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* bool stack of the evaluation, one bit per level */
+#define FILTER_MAX_DEPTH 64
+
+enum filter_op {
+	FILTER_EQ,
+	FILTER_NE,
+	FILTER_LT,
+	FILTER_LE,
+	FILTER_GT,
+	FILTER_GE,
+	FILTER_PREFIX,
+	FILTER_SUBSTR,
+	FILTER_AND,
+	FILTER_OR,
+	FILTER_NOT,
+};
+
+enum filter_kind {
+	FILTER_SIGNED,
+	FILTER_UNSIGNED,
+	FILTER_STRING,
+};
+
+/*
+ * One step of the postfix program: a comparison pushes its result, the
+ * logical operators replace the top one or two results.
+ */
+struct tbl_filter_node {
+	uint8_t			op;
+	uint8_t			kind;
+	bool			neg;	/* @val is a negative number */
+	enum field_type		type;
+	unsigned long		off;	/* of the value in the row */
+	uint64_t		val;
+	uint32_t		str;	/* string operand at @str in filter->strings */
+	uint32_t		len;
+};
+
+struct filter_parser {
+	struct tbl_filter	*filter;
+	struct table_column	**all;
+	const char		*p;
+	int			depth;	/* results on the stack */
+	int			error;
+};
+
+static const struct {
+	const char	*str;
+	enum filter_op	op;
+} filter_ops[] = {
+	/* two character operators first */
+	{ "==", FILTER_EQ }, { "!=", FILTER_NE }, { "<=", FILTER_LE },
+	{ ">=", FILTER_GE }, { "^=", FILTER_PREFIX }, { "*=", FILTER_SUBSTR },
+	{ "=", FILTER_EQ }, { "<", FILTER_LT }, { ">", FILTER_GT },
+};
+
+static void skip_space(struct filter_parser *fp)
+{
+	while (isspace((unsigned char)*fp->p))
+		fp->p++;
+}
+
+static bool accept(struct filter_parser *fp, const char *tok)
+{
+	size_t len = strlen(tok);
+
+	skip_space(fp);
+	if (strncmp(fp->p, tok, len))
+		return false;
+	fp->p += len;
+
+	return true;
+}
+
+static bool is_word(char c)
+{
+	return isalnum((unsigned char)c) || c == '_' || c == '.' || c == '-' ||
+	       c == '+';
+}
+
+static void emit(struct filter_parser *fp, struct tbl_filter_node *node, int push)
+{
+	struct tbl_filter *filter = fp->filter;
+	struct tbl_filter_node *nodes;
+
+	if (fp->error)
+		return;
+
+	fp->depth += push;
+	if (fp->depth > FILTER_MAX_DEPTH) {
+		fp->error = -E2BIG;
+		return;
+	}
+
+	if (!(filter->count & (filter->count - 1))) {
+		nodes = realloc(filter->nodes, (filter->count ? 2 * filter->count : 8) *
+				sizeof(*nodes));
+		if (!nodes) {
+			fp->error = -ENOMEM;
+			return;
+		}
+		filter->nodes = nodes;
+	}
+	filter->nodes[filter->count++] = *node;
+}
+
+/* An integer or a string, quoted with " or a bare word */
+static int parse_value(struct filter_parser *fp, struct tbl_filter_node *node)
+{
+	const char *start, *end;
+	char *num_end;
+
+	skip_space(fp);
+	if (*fp->p == '"') {
+		start = ++fp->p;
+		end = strchr(start, '"');
+		if (!end)
+			return -EINVAL;
+		fp->p = end + 1;
+	} else {
+		start = fp->p;
+		while (is_word(*fp->p))
+			fp->p++;
+		end = fp->p;
+		if (start == end)
+			return -EINVAL;
+	}
+
+	if (node->kind == FILTER_STRING) {
+		node->str = tbl_sink_bytes(&fp->filter->strings);
+		node->len = end - start;
+		tbl_sink_write(&fp->filter->strings, start, end - start);
+		tbl_sink_putc(&fp->filter->strings, '\0');
+		return fp->filter->strings.error;
+	}
+
+	errno = 0;
+	node->neg = *start == '-';
+	if (node->neg)
+		node->val = strtoll(start, &num_end, 0);
+	else
+		node->val = strtoull(start, &num_end, 0);
+	if (errno || num_end != end)
+		return -EINVAL;
+
+	return 0;
+}
+
+static void parse_compare(struct filter_parser *fp)
+{
+	struct tbl_filter_node node = {};
+	struct table_column *column;
+	const char *name;
+	size_t len, i;
+
+	skip_space(fp);
+	name = fp->p;
+	while (isalnum((unsigned char)*fp->p) || *fp->p == '_')
+		fp->p++;
+	len = fp->p - name;
+
+	for (i = 0; (column = fp->all[i]); i++)
+		if (len && tbl_name_eq(column->m_name, name, len))
+			break;
+	if (!column) {
+		fp->error = -EINVAL;
+		return;
+	}
+
+	if (table_type_is_int(column->m_type))
+		node.kind = table_type_is_signed(column->m_type) ?
+			    FILTER_SIGNED : FILTER_UNSIGNED;
+	else if (column->m_type == FIELD_STR && !column->m_tostr)
+		node.kind = FILTER_STRING;
+	else
+		fp->error = -EINVAL;
+	node.type = column->m_type;
+	node.off = column->s_off + column->m_offset;
+
+	skip_space(fp);
+	for (i = 0; i < sizeof(filter_ops) / sizeof(filter_ops[0]); i++)
+		if (accept(fp, filter_ops[i].str))
+			break;
+	if (i == sizeof(filter_ops) / sizeof(filter_ops[0])) {
+		fp->error = -EINVAL;
+		return;
+	}
+	node.op = filter_ops[i].op;
+
+	/* strings are matched, numbers ordered */
+	if (node.kind == FILTER_STRING ?
+	    node.op != FILTER_EQ && node.op != FILTER_NE &&
+	    node.op != FILTER_PREFIX && node.op != FILTER_SUBSTR :
+	    node.op == FILTER_PREFIX || node.op == FILTER_SUBSTR)
+		fp->error = -EINVAL;
+
+	if (!fp->error)
+		fp->error = parse_value(fp, &node);
+	emit(fp, &node, 1);
+}
+
+static void parse_or(struct filter_parser *fp);
+
+static void parse_unary(struct filter_parser *fp)
+{
+	struct tbl_filter_node node = {};
+
+	if (fp->error)
+		return;
+
+	if (accept(fp, "!")) {
+		parse_unary(fp);
+		node.op = FILTER_NOT;
+		emit(fp, &node, 0);
+	} else if (accept(fp, "(")) {
+		parse_or(fp);
+		if (!accept(fp, ")") && !fp->error)
+			fp->error = -EINVAL;
+	} else {
+		parse_compare(fp);
+	}
+}
+
+static void parse_and(struct filter_parser *fp)
+{
+	struct tbl_filter_node node = { .op = FILTER_AND };
+
+	parse_unary(fp);
+	while (!fp->error && accept(fp, "&&")) {
+		parse_unary(fp);
+		emit(fp, &node, -1);
+	}
+}
+
+static void parse_or(struct filter_parser *fp)
+{
+	struct tbl_filter_node node = { .op = FILTER_OR };
+
+	parse_and(fp);
+	while (!fp->error && accept(fp, "||")) {
+		parse_and(fp);
+		emit(fp, &node, -1);
+	}
+}
+
+int tbl_filter_compile(struct tbl_filter *filter, const char *expr,
+		       struct table_column **all)
+{
+	struct filter_parser fp = { .filter = filter, .all = all, .p = expr };
+
+	memset(filter, 0, sizeof(*filter));
+	if (tbl_sink_init_heap(&filter->strings, 64))
+		return -ENOMEM;
+
+	parse_or(&fp);
+	skip_space(&fp);
+	if (!fp.error && *fp.p)
+		fp.error = -EINVAL;
+	if (fp.error) {
+		tbl_filter_release(filter);
+		return fp.error;
+	}
+
+	return 0;
+}
+
+void tbl_filter_release(struct tbl_filter *filter)
+{
+	free(filter->nodes);
+	filter->nodes = NULL;
+	filter->count = 0;
+	tbl_sink_release(&filter->strings);
+}
+
+static bool filter_compare(const struct tbl_filter *filter,
+			   const struct tbl_filter_node *node, const char *v)
+{
+	const char *str;
+	uint64_t raw;
+	int64_t s;
+	int d;
+
+	if (node->kind == FILTER_STRING) {
+		str = filter->strings.buf + node->str;
+		switch (node->op) {
+		case FILTER_PREFIX:
+			return !strncmp(v, str, node->len);
+		case FILTER_SUBSTR:
+			return strstr(v, str);
+		case FILTER_NE:
+			return strcmp(v, str);
+		default:
+			return !strcmp(v, str);
+		}
+	}
+
+	raw = table_int_raw(node->type, v);
+	if (node->kind == FILTER_SIGNED) {
+		s = raw;
+		if (!node->neg && node->val > INT64_MAX)
+			d = -1;
+		else
+			d = (s > (int64_t)node->val) - (s < (int64_t)node->val);
+	} else {
+		d = node->neg ? 1 : (raw > node->val) - (raw < node->val);
+	}
+
+	switch (node->op) {
+	case FILTER_EQ:
+		return !d;
+	case FILTER_NE:
+		return d;
+	case FILTER_LT:
+		return d < 0;
+	case FILTER_LE:
+		return d <= 0;
+	case FILTER_GT:
+		return d > 0;
+	default:
+		return d >= 0;
+	}
+}
+
+bool tbl_filter_match(const struct tbl_filter *filter, const void *row)
+{
+	const struct tbl_filter_node *node = filter->nodes;
+	const struct tbl_filter_node *end = node + filter->count;
+	uint64_t stack = 0;
+	bool top;
+
+	for (; node < end; node++) {
+		switch (node->op) {
+		case FILTER_AND:
+			top = stack & 1;
+			stack >>= 1;
+			stack = (stack & ~1ULL) | (stack & top);
+			break;
+		case FILTER_OR:
+			top = stack & 1;
+			stack >>= 1;
+			stack |= top;
+			break;
+		case FILTER_NOT:
+			stack ^= 1;
+			break;
+		default:
+			stack = stack << 1 |
+				filter_compare(filter, node, (const char *)row + node->off);
+			break;
+		}
+	}
+
+	/* a zeroed filter matches every row */
+	return !filter->count || (stack & 1);
+}
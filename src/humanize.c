@@ -0,0 +1,77 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+#include "libtbl.h"
+#include "libtbl_helper.h"
+#include <string.h>
+
+struct human_unit {
+	uint64_t	scale;
+	const char	*suffix;
+};
+
+#define UNIT_COUNT 7
+
+static const struct {
+	struct human_unit	units[UNIT_COUNT];
+	bool			space;	/* between the number and the suffix */
+} human_types[] = {
+	[FIELD_BYTES - FIELD_BYTES] = {{
+		{ 1, "B" }, { 1ULL << 10, "KiB" }, { 1ULL << 20, "MiB" },
+		{ 1ULL << 30, "GiB" }, { 1ULL << 40, "TiB" }, { 1ULL << 50, "PiB" },
+		{ 1ULL << 60, "EiB" },
+	}, true },
+	[FIELD_BYTES_RATE - FIELD_BYTES] = {{
+		{ 1, "B/s" }, { 1ULL << 10, "KiB/s" }, { 1ULL << 20, "MiB/s" },
+		{ 1ULL << 30, "GiB/s" }, { 1ULL << 40, "TiB/s" },
+		{ 1ULL << 50, "PiB/s" }, { 1ULL << 60, "EiB/s" },
+	}, true },
+	[FIELD_NSEC - FIELD_BYTES] = {{
+		{ 1, "ns" }, { 1000ULL, "us" }, { 1000000ULL, "ms" },
+		{ 1000000000ULL, "s" }, { 60 * 1000000000ULL, "min" },
+		{ 3600 * 1000000000ULL, "h" }, { 86400 * 1000000000ULL, "d" },
+	}, true },
+	[FIELD_SI - FIELD_BYTES] = {{
+		{ 1, "" }, { 1000ULL, "k" }, { 1000000ULL, "M" },
+		{ 1000000000ULL, "G" }, { 1000000000000ULL, "T" },
+		{ 1000000000000000ULL, "P" }, { 1000000000000000000ULL, "E" },
+	}, false },
+};
+
+int tbl_humanize(char *buf, enum field_type type, uint64_t v)
+{
+	const struct human_unit *units;
+	uint64_t whole, tenths, scale;
+	size_t slen;
+	int i, len;
+
+	if (!table_type_is_unit(type))
+		return -1;
+	units = human_types[type - FIELD_BYTES].units;
+
+	for (i = UNIT_COUNT - 1; i && v < units[i].scale; i--)
+		;
+	scale = units[i].scale;
+	whole = v / scale;
+
+	/* rounded half up, 1023.96 KiB carries over to 1.0 MiB */
+	tenths = ((v % scale) * 10 + scale / 2) / scale;
+	if (tenths == 10) {
+		whole++;
+		tenths = 0;
+		if (i + 1 < UNIT_COUNT && whole * scale == units[i + 1].scale) {
+			i++;
+			whole = 1;
+		}
+	}
+
+	len = tbl_u64toa(buf, whole);
+	if (i) {
+		buf[len++] = '.';
+		buf[len++] = '0' + tenths;
+	}
+	if (human_types[type - FIELD_BYTES].space)
+		buf[len++] = ' ';
+	slen = strlen(units[i].suffix);
+	memcpy(buf + len, units[i].suffix, slen);
+
+	return len + slen;
+}
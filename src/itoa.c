@@ -0,0 +1,119 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+#include "libtbl.h"
+#include "libtbl_helper.h"
+#include <stdint.h>
+#include <string.h>
+
+static const char digit_pairs[200] =
+	"00010203040506070809"
+	"10111213141516171819"
+	"20212223242526272829"
+	"30313233343536373839"
+	"40414243444546474849"
+	"50515253545556575859"
+	"60616263646566676869"
+	"70717273747576777879"
+	"80818283848586878889"
+	"90919293949596979899";
+
+static const uint64_t pow10_tbl[20] = {
+	1ULL,
+	10ULL,
+	100ULL,
+	1000ULL,
+	10000ULL,
+	100000ULL,
+	1000000ULL,
+	10000000ULL,
+	100000000ULL,
+	1000000000ULL,
+	10000000000ULL,
+	100000000000ULL,
+	1000000000000ULL,
+	10000000000000ULL,
+	100000000000000ULL,
+	1000000000000000ULL,
+	10000000000000000ULL,
+	100000000000000000ULL,
+	1000000000000000000ULL,
+	10000000000000000000ULL,
+};
+
+/*
+ * Number of decimal digits of @v: log10 estimated from the bit length
+ * (1233 / 4096 ~ log10(2)) and corrected by one table lookup. Setting the
+ * lowest bit never changes the digit count but makes 0 count as 1 digit.
+ */
+static inline int u64_digits(uint64_t v)
+{
+	int t;
+
+	v |= 1;
+	t = ((64 - __builtin_clzll(v)) * 1233) >> 12;
+
+	return t + (v >= pow10_tbl[t]);
+}
+
+int tbl_u64toa(char *buf, uint64_t v)
+{
+	int len = u64_digits(v);
+	char *p = buf + len;
+	unsigned i;
+
+	while (v >= 100) {
+		i = (v % 100) * 2;
+		v /= 100;
+		p -= 2;
+		memcpy(p, digit_pairs + i, 2);
+	}
+
+	if (v >= 10) {
+		p -= 2;
+		memcpy(p, digit_pairs + v * 2, 2);
+	} else {
+		*--p = '0' + v;
+	}
+
+	return len;
+}
+
+int tbl_i64toa(char *buf, int64_t v)
+{
+	if (v >= 0)
+		return tbl_u64toa(buf, v);
+
+	*buf = '-';
+	/* negate in unsigned arithmetic, INT64_MIN has no positive twin */
+	return tbl_u64toa(buf + 1, -(uint64_t)v) + 1;
+}
+
+int table_format_int(char *buf, enum field_type type, const void *v)
+{
+	switch (type) {
+	case FIELD_NUM:
+	case FIELD_VAL:
+	case FIELD_I32:
+		return tbl_i64toa(buf, *(const int32_t *)v);
+	case FIELD_LLU:
+	case FIELD_U64:
+	case FIELD_BYTES:
+	case FIELD_BYTES_RATE:
+	case FIELD_NSEC:
+	case FIELD_SI:
+		return tbl_u64toa(buf, *(const uint64_t *)v);
+	case FIELD_I8:
+		return tbl_i64toa(buf, *(const int8_t *)v);
+	case FIELD_U8:
+		return tbl_u64toa(buf, *(const uint8_t *)v);
+	case FIELD_I16:
+		return tbl_i64toa(buf, *(const int16_t *)v);
+	case FIELD_U16:
+		return tbl_u64toa(buf, *(const uint16_t *)v);
+	case FIELD_U32:
+		return tbl_u64toa(buf, *(const uint32_t *)v);
+	case FIELD_I64:
+		return tbl_i64toa(buf, *(const int64_t *)v);
+	default:
+		return -1;
+	}
+}
@@ -0,0 +1,310 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+#include "libtbl.h"
+#include "libtbl_helper.h"
+#include <errno.h>
+#include <string.h>
+
+int tbl_hot_compile(struct tbl_hot *hot, struct table_column **pColumns)
+{
+	struct table_column *column;
+	int i, count;
+	char *mem;
+
+	count = table_column_count(pColumns);
+
+	/* one block, the arrays ordered by alignment */
+	mem = malloc((count ?: 1) * (sizeof(*hot->offs) + sizeof(*hot->tostr) +
+				     sizeof(*hot->types) + sizeof(*hot->colors)));
+	if (!mem)
+		return -ENOMEM;
+
+	hot->count = count;
+	hot->offs = (void *)mem;
+	hot->tostr = (void *)(hot->offs + count);
+	hot->types = (void *)(hot->tostr + count);
+	hot->colors = hot->types + count;
+
+	for (i = 0; i < count; i++) {
+		column = pColumns[i];
+		hot->offs[i] = column->s_off + column->m_offset;
+		hot->tostr[i] = column->m_tostr;
+		hot->types[i] = column->m_type;
+		hot->colors[i] = column->clm_color;
+	}
+
+	return 0;
+}
+
+void tbl_hot_release(struct tbl_hot *hot)
+{
+	free(hot->offs);
+	memset(hot, 0, sizeof(*hot));
+}
+
+int tbl_layout_init(struct tbl_layout *layout, struct table_column **pColumns)
+{
+	int i, ret;
+
+	memset(layout, 0, sizeof(*layout));
+	ret = tbl_hot_compile(&layout->hot, pColumns);
+	if (ret)
+		return ret;
+
+	layout->columns = pColumns;
+	layout->count = layout->hot.count;
+	layout->widths = malloc((layout->count ?: 1) * sizeof(*layout->widths));
+	if (!layout->widths) {
+		tbl_hot_release(&layout->hot);
+		return -ENOMEM;
+	}
+
+	for (i = 0; i < layout->count; i++)
+		layout->widths[i] = pColumns[i]->m_width;
+
+	return 0;
+}
+
+void tbl_layout_release(struct tbl_layout *layout)
+{
+	tbl_hot_release(&layout->hot);
+	free(layout->widths);
+	layout->widths = NULL;
+}
+
+void tbl_layout_store(const struct tbl_layout *layout)
+{
+	int i;
+
+	for (i = 0; i < layout->count; i++)
+		layout->columns[i]->m_width = layout->widths[i];
+}
+
+int tbl_layout_row_stringify(struct tbl_layout *layout, void *s,
+			     struct tbl_arena *arena, struct tbl_cell *pCells,
+			     int humanize, int prefix_len)
+{
+	int i, len, ret;
+
+	ret = arena_row_stringify(s, arena, pCells, &layout->hot, humanize);
+	if (ret)
+		return ret;
+
+	for (i = 0; i < layout->count; i++) {
+		len = tbl_str_width(arena->base + pCells[i].off, pCells[i].len) +
+		      (i ? 0 : prefix_len);
+		if (layout->widths[i] < len)
+			layout->widths[i] = len;
+	}
+
+	return 0;
+}
+
+int tbl_layout_print_header_sink(const struct tbl_layout *layout,
+				 struct tbl_sink *sink, const char *prefix,
+				 bool use_color, char align)
+{
+	return print_header_term_widths(sink, prefix, layout->columns,
+					layout->widths, use_color, align);
+}
+
+int tbl_layout_print_cells_sink(const struct tbl_layout *layout,
+				struct tbl_sink *sink, const struct tbl_plan *plan,
+				const struct tbl_arena *arena,
+				const struct tbl_cell *pCells)
+{
+	struct tbl_row_cells row = { .arena = arena, .cells = pCells };
+
+	return tbl_plan_emit(sink, plan, &row, layout->widths);
+}
+
+static void *array_next(void *state)
+{
+	void ***pos = state;
+
+	return **pos ? *(*pos)++ : NULL;
+}
+
+/*
+ * The next row of @src to print, skipping the rows which don't match the
+ * filter of @layout. The row is counted in @count and added to the totals.
+ * NULL at the end of @src or once @count reached its limit.
+ */
+static void *layout_next(struct tbl_layout *layout, const struct tbl_row_source *src,
+			 unsigned long *count)
+{
+	void *row;
+
+	if (src->limit && *count >= src->limit)
+		return NULL;
+
+	while ((row = src->next(src->state))) {
+		layout->scanned++;
+		if (layout->filter && !tbl_filter_match(layout->filter, row))
+			continue;
+
+		layout->emitted++;
+		(*count)++;
+		if (layout->totals)
+			tbl_totals_add(layout->totals, layout->columns, row);
+		break;
+	}
+
+	return row;
+}
+
+static int print_table_arrow_sink(struct tbl_layout *layout, struct tbl_sink *sink,
+				  const struct tbl_row_source *src, int humanize)
+{
+	unsigned long count = 0;
+	struct tbl_arrow ar;
+	void *row;
+	int ret;
+
+	ret = tbl_arrow_init(&ar, sink, layout->columns, humanize, 0);
+	if (ret)
+		return ret;
+
+	while (!ret && (row = layout_next(layout, src, &count)))
+		ret = tbl_arrow_push(&ar, row);
+
+	if (ret) {
+		tbl_arrow_release(&ar);
+		return ret;
+	}
+
+	return tbl_arrow_finish(&ar);
+}
+
+int tbl_layout_print_source_sink(struct tbl_layout *layout, struct tbl_sink *sink,
+				 const struct tbl_row_source *src,
+				 enum format_type pFormat, const char *pre,
+				 bool use_color, int humanize, size_t pre_len)
+{
+	struct tbl_arena arena = {};
+	unsigned long count = 0;
+	struct tbl_cell *cells;
+	struct tbl_plan plan;
+	void *row;
+	int ret;
+
+	if (tbl_totals_short(layout))
+		return -EINVAL;
+	if (pFormat == FORMAT_ARROW)
+		return print_table_arrow_sink(layout, sink, src, humanize);
+
+	cells = malloc((layout->count ?: 1) * sizeof(*cells));
+	if (!cells)
+		return -ENOMEM;
+
+	ret = tbl_plan_compile(&plan, pFormat, pre, layout->columns, use_color,
+			       pre_len);
+	if (ret) {
+		free(cells);
+		return ret;
+	}
+
+	while ((row = layout_next(layout, src, &count))) {
+		if (count > 1 && pFormat == FORMAT_JSON)
+			tbl_sink_write(sink, ",\n", 2);
+
+		tbl_arena_reset(&arena);
+		ret = tbl_layout_row_stringify(layout, row, &arena, cells, humanize,
+					       pre_len);
+		if (ret)
+			break;
+
+		ret = tbl_layout_print_cells_sink(layout, sink, &plan, &arena, cells);
+		if (ret)
+			break;
+		tbl_sink_row_end(sink);
+	}
+	tbl_arena_release(&arena);
+	tbl_plan_release(&plan);
+	free(cells);
+
+	return ret;
+}
+
+void tbl_row_source_array(struct tbl_row_source *src, void ***pos)
+{
+	memset(src, 0, sizeof(*src));
+	src->next = array_next;
+	src->state = pos;
+}
+
+/* rows prefetched ahead of the one returned */
+#define STRIDED_PREFETCH_ROWS 4
+
+static void *strided_next(void *state)
+{
+	struct tbl_strided *st = state;
+	const char *row = st->pos;
+
+	if (row == st->end)
+		return NULL;
+
+	st->pos += st->stride;
+	if ((size_t)(st->end - row) > STRIDED_PREFETCH_ROWS * st->stride)
+		__builtin_prefetch(row + STRIDED_PREFETCH_ROWS * st->stride);
+
+	return (void *)row;
+}
+
+void tbl_row_source_strided(struct tbl_row_source *src, struct tbl_strided *st,
+			    const void *base, size_t stride, size_t count)
+{
+	st->pos = base;
+	st->end = st->pos + stride * count;
+	st->stride = stride;
+
+	memset(src, 0, sizeof(*src));
+	src->next = strided_next;
+	src->state = st;
+	src->size_hint = count;
+}
+
+int tbl_layout_print_rows_sink(struct tbl_layout *layout, struct tbl_sink *sink,
+			       void **v, enum format_type pFormat, const char *pre,
+			       bool use_color, int humanize, size_t pre_len)
+{
+	struct tbl_row_source src;
+
+	tbl_row_source_array(&src, &v);
+
+	return tbl_layout_print_source_sink(layout, sink, &src, pFormat, pre,
+					    use_color, humanize, pre_len);
+}
+
+int print_table_source_sink(struct tbl_sink *sink, const struct tbl_row_source *src,
+			    enum format_type pFormat, const char *pre,
+			    struct table_column **cs, bool use_color, int humanize,
+			    size_t pre_len)
+{
+	struct tbl_layout layout;
+	int ret;
+
+	ret = tbl_layout_init(&layout, cs);
+	if (ret)
+		return ret;
+
+	ret = tbl_layout_print_source_sink(&layout, sink, src, pFormat, pre,
+					   use_color, humanize, pre_len);
+	tbl_layout_store(&layout);
+	tbl_layout_release(&layout);
+
+	return ret;
+}
+
+int print_table_strided_sink(struct tbl_sink *sink, const void *base,
+			     size_t stride, size_t count, enum format_type pFormat,
+			     const char *pre, struct table_column **cs,
+			     bool use_color, int humanize, size_t pre_len)
+{
+	struct tbl_row_source src;
+	struct tbl_strided st;
+
+	tbl_row_source_strided(&src, &st, base, stride, count);
+
+	return print_table_source_sink(sink, &src, pFormat, pre, cs, use_color,
+				       humanize, pre_len);
+}
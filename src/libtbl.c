@@ -37,49 +37,104 @@ void escape_char(char *buf, char *str, const char escape, const char character)
 	buf[j] = '\0';
 }
 
+/* Size of the on-stack sink buffer used by the stdout API */
+#define STDOUT_SINK_SIZE 4096
+
+static void stdout_sink_init(struct tbl_sink *sink, char *buf, size_t size)
+{
+	tbl_sink_init_file(sink, stdout, buf, size);
+}
+
+static void sink_escaped(struct tbl_sink *sink, enum format_type pFormat,
+			 const char *str, size_t len)
+{
+	tbl_sink_putc(sink, '"');
+	if (pFormat == FORMAT_CSV || pFormat == FORMAT_JSON)
+		tbl_escape_sink(sink, pFormat, str, len);
+	else
+		tbl_sink_write(sink, str, len);
+	tbl_sink_putc(sink, '"');
+}
+
+static void print_escaped_field_sink(struct tbl_sink *sink, enum format_type pFormat,
+				     bool use_color, enum color pColor, const char *str,
+				     size_t len)
+{
+	sink_color_on(sink, use_color, pColor);
+	sink_escaped(sink, pFormat, str, len);
+	sink_color_off(sink, use_color, pColor);
+}
+
 int print_escaped_field(enum format_type pFormat, bool use_color, enum color pColor, char *str)
 {
-	int ret;
-	char *buf;
-
-	switch(pFormat) {
-	case FORMAT_CSV:
-		buf = malloc((2 * strlen(str)) + 1);
-		escape_char(buf, str, '"', '"');
-		break;
-	case FORMAT_JSON:
-		buf = malloc((2 * strlen(str)) + 1);
-		escape_char(buf, str, '\\', '"');
-		break;
-	default:
-		return print_color(use_color, pColor, "\"%s\"", str);
-	}
+	char buf[STDOUT_SINK_SIZE];
+	struct tbl_sink sink;
 
-	ret = print_color(use_color, pColor, "\"%s\"", buf);
-	free(buf);
+	stdout_sink_init(&sink, buf, sizeof(buf));
+	print_escaped_field_sink(&sink, pFormat, use_color, pColor, str, strlen(str));
+	tbl_sink_close(&sink);
 
-	return ret;
+	return tbl_sink_bytes(&sink);
+}
+
+/* XML element content, '<', '>' and '&' are escaped */
+static void cell_as_string(struct tbl_sink *sink, const char *str, size_t len,
+			   enum color pColor, struct table_column *column,
+			   bool use_color)
+{
+	sink_color_on(sink, use_color, pColor);
+	if (column->m_type == FIELD_STR)
+		tbl_sink_putc(sink, '"');
+	tbl_escape_sink(sink, FORMAT_XML, str, len);
+	if (column->m_type == FIELD_STR)
+		tbl_sink_putc(sink, '"');
+	sink_color_off(sink, use_color, pColor);
 }
 
 int print_table_fields_as_string(struct table_field *pFields,
 				   struct table_column *pColumns,
 				   bool use_color)
 {
-	if (pColumns->m_type == FIELD_STR)
-		return print_color(use_color, pFields->mColor, "\"%s\"", pFields->mName);
-	else
-		return print_color(use_color, pFields->mColor, "%s", pFields->mName);
+	char buf[STDOUT_SINK_SIZE];
+	struct tbl_sink sink;
+
+	stdout_sink_init(&sink, buf, sizeof(buf));
+	cell_as_string(&sink, pFields->mName, strlen(pFields->mName), pFields->mColor,
+		       pColumns, use_color);
+	tbl_sink_close(&sink);
+
+	return tbl_sink_bytes(&sink);
 }
 
 size_t get_dashed_line(char *buf, size_t buf_size, size_t len)
 {
-	size_t count = 0;
 	len = (len >= buf_size) ? buf_size - 1 : len;
+	memset(buf, '-', len);
+	buf[len] = '\0';
 
-	while (count < len)
-		count += snprintf(buf + count, len - count + 1, "%s", "-");
+	return len;
+}
 
-	return count;
+/*
+ * Returns the number of bytes appended to @sink, 0 meaning that the
+ * field was empty.
+ */
+static size_t cell_as_string_escaped(struct tbl_sink *sink, const char *str,
+				     size_t len, enum color pColor,
+				     struct table_column *column, bool use_color,
+				     enum format_type pFormat)
+{
+	size_t before = tbl_sink_bytes(sink);
+
+	if (column->m_type == FIELD_STR) {
+		print_escaped_field_sink(sink, pFormat, use_color, pColor, str, len);
+	} else {
+		sink_color_on(sink, use_color, pColor);
+		tbl_sink_write(sink, str, len);
+		sink_color_off(sink, use_color, pColor);
+	}
+
+	return tbl_sink_bytes(sink) - before;
 }
 
 int print_table_field_as_string_escaped(struct table_field *pFields,
@@ -87,162 +142,178 @@ int print_table_field_as_string_escaped(struct table_field *pFields,
 				   bool use_color,
 				   enum format_type pFormat)
 {
-	if (pColumns->m_type == FIELD_STR)
-		return print_escaped_field(pFormat, use_color, pFields->mColor, pFields->mName);
-	else
-		return print_color(use_color, pFields->mColor, "%s", pFields->mName);
-}
-
-static int print_table_fields_term(const char *prefix, struct table_field *pFields,
-				 struct table_column **pColumns, bool use_color, int pWidth)
-{
-	int columnCount = 0;
-	struct table_column *column = *pColumns;
+	char buf[STDOUT_SINK_SIZE];
+	struct tbl_sink sink;
+	int ret;
 
-	if (!column)
-		return 0;
+	stdout_sink_init(&sink, buf, sizeof(buf));
+	ret = cell_as_string_escaped(&sink, pFields->mName, strlen(pFields->mName),
+				     pFields->mColor, pColumns, use_color, pFormat);
+	tbl_sink_close(&sink);
 
-	print_color(use_color, pFields[columnCount].mColor,
-		  (column->column_align == 'l') ? "%s%-*s" COLUMN_DELIMITER : "%s%*s" COLUMN_DELIMITER,
-		  prefix ?: "", column->m_width - pWidth, pFields[columnCount].mName);
+	return ret;
+}
 
-	for (column = *++pColumns, columnCount = 1; column; column = *++pColumns, columnCount++)
-		print_color(use_color, pFields[columnCount].mColor, (column->column_align == 'l') ?
-			  "%-*s" COLUMN_DELIMITER : "%*s" COLUMN_DELIMITER,
-			  column->m_width, pFields[columnCount].mName);
-	printf("\n");
+int print_table_fields_sink(struct tbl_sink *sink, enum format_type pFormat,
+			    const char *prefix, struct table_field *pFields,
+			    struct table_column **pColumns, bool use_color, int pwidth)
+{
+	struct tbl_row_cells row = { .fields = pFields };
 
-	return 0;
+	return print_row_cells_sink(sink, pFormat, prefix, &row, pColumns, use_color,
+				    pwidth);
 }
 
-static int print_table_fields_csv(struct table_field *pFields,
-				struct table_column **pColumns, bool use_color)
+int print_table_cells_sink(struct tbl_sink *sink, enum format_type pFormat,
+			   const char *prefix, const struct tbl_arena *arena,
+			   const struct tbl_cell *pCells,
+			   struct table_column **pColumns, bool use_color, int pwidth)
 {
-	int columnCount;
-	struct table_column *c = *pColumns;
+	struct tbl_row_cells row = { .arena = arena, .cells = pCells };
 
-	if (c)
-		print_table_field_as_string_escaped(&pFields[0], c, use_color, FORMAT_CSV);
+	return print_row_cells_sink(sink, pFormat, prefix, &row, pColumns, use_color,
+				    pwidth);
+}
 
-	for (c = *++pColumns, columnCount = 1; c; c = *++pColumns, columnCount++) {
-		printf(",");
-		print_table_field_as_string_escaped(&pFields[columnCount], c, use_color, FORMAT_CSV);
-	}
+int print_table_cells(enum format_type pFormat, const char *prefix,
+		      const struct tbl_arena *arena, const struct tbl_cell *pCells,
+		      struct table_column **pColumns, bool use_color, int pwidth)
+{
+	char buf[STDOUT_SINK_SIZE];
+	struct tbl_sink sink;
+	int ret;
 
-	printf("\n");
+	stdout_sink_init(&sink, buf, sizeof(buf));
+	ret = print_table_cells_sink(&sink, pFormat, prefix, arena, pCells, pColumns,
+				     use_color, pwidth);
+	tbl_sink_close(&sink);
 
-	return 0;
+	return ret;
 }
 
-/*FIXME: escape '"' in strings */
-static int print_table_fields_json(const char *prefix, struct table_field *pFields,
-				 struct table_column **pColumns, bool use_color)
+int print_table_fields(enum format_type pFormat, const char *prefix,
+			    struct table_field *pFields, struct table_column **pColumns,
+			    bool use_color, int pwidth)
 {
-	int columnCount;
-	struct table_column *column = *pColumns;
+	char buf[STDOUT_SINK_SIZE];
+	struct tbl_sink sink;
+	int ret;
 
-	printf("%s{", prefix);
+	stdout_sink_init(&sink, buf, sizeof(buf));
+	ret = print_table_fields_sink(&sink, pFormat, prefix, pFields, pColumns,
+				      use_color, pwidth);
+	tbl_sink_close(&sink);
 
-	if (column) {
-		printf("\n%s\t\"%s\": ", prefix, column->m_name);
-		if (!print_table_field_as_string_escaped(&pFields[0], column, use_color, FORMAT_JSON))
-			print_color(use_color, pFields[0].mColor, "null");
-	}
+	return ret;
+}
 
-	for (column = *++pColumns, columnCount = 1; column; column = *++pColumns, columnCount++) {
-		printf(",\n%s\t\"%s\": ", prefix, column->m_name);
-		if (!print_table_field_as_string_escaped(&pFields[columnCount], column, use_color, FORMAT_JSON))
-			print_color(use_color, pFields[columnCount].mColor, "null");
-	}
+int print_color_sink(struct tbl_sink *sink, bool use_color, enum color pColor,
+		     const char *format, ...)
+{
+	size_t before = tbl_sink_bytes(sink);
+	va_list args;
 
-	printf("\n%s}", prefix);
+	va_start(args, format);
+	sink_color_on(sink, use_color, pColor);
+	tbl_sink_vprintf(sink, format, args);
+	sink_color_off(sink, use_color, pColor);
+	va_end(args);
 
-	return 0;
+	return tbl_sink_bytes(sink) - before;
 }
 
-int print_table_fields_xml(const char *prefix, struct table_field *pFields,
-				struct table_column **pColumns, bool use_color)
+/* Print @format in @pColor color*/
+int print_color(bool use_color, enum color pColor, const char *format, ...)
 {
-	int columnCount;
-	struct table_column *column = *pColumns;
+	char buf[STDOUT_SINK_SIZE];
+	struct tbl_sink sink;
+	va_list args;
 
-	for (column = *pColumns, columnCount = 0; column; column = *++pColumns, columnCount++) {
-		printf("%s<%s>", prefix, column->m_name);
-		print_table_fields_as_string(&pFields[columnCount], column, use_color);
-		printf("</%s>\n", column->m_name);
-	}
+	stdout_sink_init(&sink, buf, sizeof(buf));
+	va_start(args, format);
+	sink_color_on(&sink, use_color, pColor);
+	tbl_sink_vprintf(&sink, format, args);
+	sink_color_off(&sink, use_color, pColor);
+	va_end(args);
+	tbl_sink_close(&sink);
 
-	return 0;
+	return tbl_sink_bytes(&sink);
 }
 
-int print_table_fields(enum format_type pFormat, const char *prefix,
-			    struct table_field *pFields, struct table_column **pColumns,
-			    bool use_color, int pwidth)
+static int format_int(char *buf, enum field_type type, void *v, int humanize)
 {
-	switch (pFormat) {
-	case FORMAT_TERM:
-		return print_table_fields_term(prefix, pFields, pColumns, use_color, pwidth);
-	case FORMAT_XML:
-		return print_table_fields_xml(prefix, pFields, pColumns, use_color);
-	case FORMAT_CSV:
-		return print_table_fields_csv(pFields, pColumns, use_color);
-	case FORMAT_JSON:
-		return print_table_fields_json(prefix, pFields, pColumns, use_color);
-	default:
-		return -EINVAL;
-	}
+	if (humanize && table_type_is_unit(type))
+		return tbl_humanize(buf, type, *(uint64_t *)v);
+
+	return table_format_int(buf, type, v);
 }
 
-/* Print @format in @pColor color*/
-int print_color(bool use_color, enum color pColor, const char *format, ...)
+int table_format_type(char *str, size_t len, enum field_type type, void *v,
+		      int humanize)
 {
-	va_list args;
+	char tmp[TBL_INT_BUF_SIZE];
 	int ret;
 
-	va_start(args, format);
-	if (use_color && (pColor != CNRM)) {
-		ret = printf("%s", colors[pColor]);
-		ret += vprintf(format, args);
-		ret += printf("%s", colors[CNRM]);
-	} else {
-		ret = vprintf(format, args);
+	if (!table_type_is_number(type) && type != FIELD_VAL)
+		return snprintf(str, len, "%s", (char *)v);
+
+	if (len >= TBL_INT_BUF_SIZE) {
+		ret = format_int(str, type, v, humanize);
+		str[ret] = '\0';
+		return ret;
 	}
-	va_end(args);
+
+	ret = format_int(tmp, type, v, humanize);
+	if (len) {
+		len = (size_t)ret < len ? (size_t)ret : len - 1;
+		memcpy(str, tmp, len);
+		str[len] = '\0';
+	}
+
 	return ret;
 }
 
+int table_format_builtin(char *str, size_t len, struct table_column *column,
+			 void *v, int humanize)
+{
+	return table_format_type(str, len, column->m_type, v, humanize);
+}
+
 int table_row_stringify(void *s, struct table_field *pFields,
 			       struct table_column **pColumns, int humanize,
 			       int prefix_len)
 {
+	struct tbl_stats *stats = tbl_stats_get();
+	uint64_t start = 0, t = 0;
 	int columnCount;
 	size_t len;
 	void *v;
 	struct table_column *column;
 
+	if (stats)
+		start = tbl_stats_clock();
+
 	for (column = *pColumns, columnCount = 0; column; column = *++pColumns, columnCount++) {
 		v = (void *)s + column->s_off + column->m_offset;
 
+		if (stats)
+			t = tbl_stats_clock();
 		if (column->m_tostr) {
 			len = column->m_tostr(pFields[columnCount].mName, MAX_COLUMN_WIDTH,
 					 &pFields[columnCount].mColor, v, humanize);
 		} else {
-			if (column->m_type == FIELD_NUM || column->m_type == FIELD_VAL)
-				len = snprintf(pFields[columnCount].mName, MAX_COLUMN_WIDTH,
-					       "%d",
-					       *(int *)v);
-			else if (column->m_type == FIELD_LLU)
-				len = snprintf(pFields[columnCount].mName, MAX_COLUMN_WIDTH,
-					       PRIu64,
-					       *(uint64_t *)v);
-			else
-				len = snprintf(pFields[columnCount].mName, MAX_COLUMN_WIDTH,
-					       "%s",
-					       (char *)v);
-
+			len = table_format_builtin(pFields[columnCount].mName,
+						   MAX_COLUMN_WIDTH, column, v,
+						   humanize);
 			pFields[columnCount].mColor = column->clm_color;
 		}
+		if (stats)
+			tbl_stats_cell(stats, columnCount, tbl_stats_clock() - t,
+				       strlen(pFields[columnCount].mName),
+				       len >= MAX_COLUMN_WIDTH);
 
+		if (len < MAX_COLUMN_WIDTH)
+			len = tbl_str_width(pFields[columnCount].mName, len);
 		if (!columnCount)
 			len += prefix_len;
 
@@ -250,6 +321,11 @@ int table_row_stringify(void *s, struct table_field *pFields,
 			column->m_width = len;
 	}
 
+	if (stats) {
+		tbl_stats_add(&stats->rows, 1);
+		tbl_stats_add(&stats->stringify_cycles, tbl_stats_clock() - start);
+	}
+
 	return 0;
 }
 
@@ -268,67 +344,208 @@ int table_get_max_h_width(struct table_column **pColumns)
 	return max_hdr_len;
 }
 
-void print_table_entry_term(const char *prefix, struct table_field *pFields,
-				   struct table_column **pColumns, int hdr_width,
-				   bool use_color)
+void print_table_entry_term_sink(struct tbl_sink *sink, const char *prefix,
+				 struct table_field *pFields,
+				 struct table_column **pColumns, int hdr_width,
+				 bool use_color)
 {
 	int columnCount;
 	struct table_column *column;
 
+	prefix = prefix ?: "";
 	for (column = *pColumns, columnCount = 0; column; column = *++pColumns, columnCount++) {
-		printf("%s%-*s" COLUMN_DELIMITER, prefix, hdr_width, column->m_header);
-		print_color(use_color, pFields[columnCount].mColor, "%s\n", pFields[columnCount].mName);
+		tbl_sink_puts(sink, prefix);
+		sink_pad(sink, column->m_header, strlen(column->m_header), hdr_width, true);
+		tbl_sink_write(sink, COLUMN_DELIMITER, sizeof(COLUMN_DELIMITER) - 1);
+		sink_color_on(sink, use_color, pFields[columnCount].mColor);
+		tbl_sink_puts(sink, pFields[columnCount].mName);
+		tbl_sink_putc(sink, '\n');
+		sink_color_off(sink, use_color, pFields[columnCount].mColor);
 	}
 }
 
+void print_table_entry_term(const char *prefix, struct table_field *pFields,
+				   struct table_column **pColumns, int hdr_width,
+				   bool use_color)
+{
+	char buf[STDOUT_SINK_SIZE];
+	struct tbl_sink sink;
+
+	stdout_sink_init(&sink, buf, sizeof(buf));
+	print_table_entry_term_sink(&sink, prefix, pFields, pColumns, hdr_width, use_color);
+	tbl_sink_close(&sink);
+}
+
+/*
+ * The single row functions keep as many cells and as much text on the
+ * stack as the table_field arrays did, the heap is used only beyond.
+ */
+#define ROW_STACK_CELLS	MAX_COLUMN_COUNT
+#define ROW_STACK_TEXT	(MAX_COLUMN_COUNT * MAX_COLUMN_WIDTH)
+
+int print_table_single_row_sink(struct tbl_sink *sink, void *v,
+				enum format_type pFormat, const char *prefix,
+				struct table_column **pColumns, bool use_color,
+				int humanize, size_t prefix_len)
+{
+	struct tbl_cell stack_cells[ROW_STACK_CELLS], *cells = stack_cells;
+	int count = table_column_count(pColumns), ret;
+	char text[ROW_STACK_TEXT];
+	struct tbl_arena arena;
+
+	if (count > ROW_STACK_CELLS) {
+		cells = malloc(count * sizeof(*cells));
+		if (!cells)
+			return -ENOMEM;
+	}
+	tbl_arena_init_buf(&arena, text, sizeof(text));
+
+	ret = table_row_stringify_arena(v, &arena, cells, pColumns, humanize,
+					prefix_len);
+	if (!ret)
+		ret = print_table_cells_sink(sink, pFormat, prefix, &arena, cells,
+					     pColumns, use_color, prefix_len);
+	tbl_arena_release(&arena);
+	if (cells != stack_cells)
+		free(cells);
+
+	return ret;
+}
+
 int print_table_single_row(void *v, enum format_type pFormat, const char *prefix,
 			   struct table_column **pColumns, bool use_color, int humanize,
 			   size_t prefix_len)
 {
-	struct table_field fields[MAX_COLUMN_COUNT];
+	char buf[STDOUT_SINK_SIZE];
+	struct tbl_sink sink;
+	int ret;
 
-	table_row_stringify(v, fields, pColumns, humanize, prefix_len);
-	print_table_fields(pFormat, prefix, fields, pColumns, use_color, prefix_len);
+	stdout_sink_init(&sink, buf, sizeof(buf));
+	ret = print_table_single_row_sink(&sink, v, pFormat, prefix, pColumns,
+					  use_color, humanize, prefix_len);
+	tbl_sink_close(&sink);
 
-	return 0;
+	return ret;
+}
+
+int print_table_all_rows_sink(struct tbl_sink *sink, void **v,
+			      enum format_type pFormat, const char *pre,
+			      struct table_column **cs, bool use_color,
+			      int humanize, size_t pre_len)
+{
+	struct tbl_layout layout;
+	int ret;
+
+	ret = tbl_layout_init(&layout, cs);
+	if (ret)
+		return ret;
+
+	ret = tbl_layout_print_rows_sink(&layout, sink, v, pFormat, pre, use_color,
+					 humanize, pre_len);
+	tbl_layout_store(&layout);
+	tbl_layout_release(&layout);
+
+	return ret;
 }
 
 int print_table_all_rows(void **v, enum format_type pFormat, const char *pre,
 			   struct table_column **cs, bool use_color, int humanize,
 			   size_t pre_len)
 {
-	int i, ret;
+	char buf[STDOUT_SINK_SIZE];
+	struct tbl_sink sink;
+	int ret;
+
+	/* a large batch buffer pays off for whole tables */
+	if (tbl_sink_init_file(&sink, stdout, NULL, 0))
+		stdout_sink_init(&sink, buf, sizeof(buf));
+
+	ret = print_table_all_rows_sink(&sink, v, pFormat, pre, cs, use_color,
+					humanize, pre_len);
+	tbl_sink_close(&sink);
+	tbl_sink_release(&sink);
+
+	return ret;
+}
+
+int print_table_strided(const void *base, size_t stride, size_t count,
+			enum format_type pFormat, const char *pre,
+			struct table_column **cs, bool use_color, int humanize,
+			size_t pre_len)
+{
+	char buf[STDOUT_SINK_SIZE];
+	struct tbl_sink sink;
+	int ret;
 
-	for (i = 0; v[i]; i++) {
-		if (i && pFormat == FORMAT_JSON)
-			printf(",\n");
-		ret = print_table_single_row(v[i], pFormat, pre, cs, use_color, humanize, pre_len);
-		if (ret)
-			return ret;
+	if (tbl_sink_init_file(&sink, stdout, NULL, 0))
+		stdout_sink_init(&sink, buf, sizeof(buf));
+
+	ret = print_table_strided_sink(&sink, base, stride, count, pFormat, pre,
+				       cs, use_color, humanize, pre_len);
+	tbl_sink_close(&sink);
+	tbl_sink_release(&sink);
+
+	return ret;
+}
+
+int print_table_row_line_sink(struct tbl_sink *sink, const char *prefix,
+			      struct table_column **pColumns, bool use_color,
+			      size_t prefix_len)
+{
+	struct tbl_cell stack_cells[ROW_STACK_CELLS], *cells = stack_cells;
+	int count = table_column_count(pColumns), width = 0, i, ret;
+	struct table_column *column;
+	char text[ROW_STACK_TEXT];
+	struct tbl_arena arena;
+	char *dashes;
+
+	if (count > ROW_STACK_CELLS) {
+		cells = malloc(count * sizeof(*cells));
+		if (!cells)
+			return -ENOMEM;
 	}
+	tbl_arena_init_buf(&arena, text, sizeof(text));
+
+	/* the cells of the number columns share one run of dashes */
+	for (i = 0; (column = pColumns[i]); i++) {
+		cells[i] = (struct tbl_cell){ 0, 0, CNRM };
+		if (table_type_is_number(column->m_type) && column->m_width > 0) {
+			cells[i].len = column->m_width;
+			if (width < column->m_width)
+				width = column->m_width;
+		}
+	}
+	dashes = tbl_arena_reserve(&arena, width + 1);
+	if (!dashes) {
+		ret = -ENOMEM;
+		goto out;
+	}
+	memset(dashes, '-', width);
+	dashes[width] = '\0';
+	arena.used = width + 1;
 
-	return 0;
+	ret = print_table_cells_sink(sink, FORMAT_TERM, prefix, &arena, cells,
+				     pColumns, use_color, prefix_len);
+out:
+	tbl_arena_release(&arena);
+	if (cells != stack_cells)
+		free(cells);
+
+	return ret;
 }
 
 int print_table_row_line(const char *prefix, struct table_column **pColumns,
 				bool use_color, size_t prefix_len)
 {
-	struct table_field fields[MAX_COLUMN_COUNT];
-	struct table_column *column;
-	struct table_column **cs = pColumns;
-	int columnCount;
-
-	for (column = *cs, columnCount = 0; column; column = *++cs, columnCount++) {
-		fields[columnCount].mColor = CNRM;
-		if (column->m_type == FIELD_NUM)
-			get_dashed_line(fields[columnCount].mName, MAX_COLUMN_WIDTH, column->m_width);
-		else
-			fields[columnCount].mName[0] = '\0';
-	}
+	char buf[STDOUT_SINK_SIZE];
+	struct tbl_sink sink;
+	int ret;
 
-	print_table_fields(FORMAT_TERM, prefix, fields, pColumns, use_color, prefix_len);
+	stdout_sink_init(&sink, buf, sizeof(buf));
+	ret = print_table_row_line_sink(&sink, prefix, pColumns, use_color, prefix_len);
+	tbl_sink_close(&sink);
 
-	return 0;
+	return ret;
 }
 
 bool table_contains_number(struct table_column **pColumns)
@@ -347,63 +564,112 @@ void table_delete_non_number_fields(struct table_field *pFields,
 	int i;
 
 	for (column = *pColumns, i = 0; column; column = *++pColumns, i++)
-		if (column->m_type != FIELD_NUM) {
+		if (!table_type_is_number(column->m_type)) {
 			pFields[i].mName[0] = '\0';
 			pFields[i].mColor = CNRM;
 		}
 }
 
-int print_table_header_term(const char *prefix, struct table_column **pColumns,
-			    bool use_color, char align)
+static inline int column_width(struct table_column *column, const int *widths,
+			       int i)
+{
+	return widths ? widths[i] : column->m_width;
+}
+
+int print_header_term_widths(struct tbl_sink *sink, const char *prefix,
+			     struct table_column **pColumns, const int *widths,
+			     bool use_color, char align)
 {
 	struct table_column *column;
+	enum color pColor;
+	size_t hdr_len;
 	char al = align;
+	int width, i;
 
-	if (prefix && *prefix != '\0')
-		print_color(use_color, *pColumns ? (*pColumns)->hdr_color : CNRM, "%s", prefix);
+	if (prefix && *prefix != '\0') {
+		pColor = *pColumns ? (*pColumns)->hdr_color : CNRM;
+		sink_color_on(sink, use_color, pColor);
+		tbl_sink_puts(sink, prefix);
+		sink_color_off(sink, use_color, pColor);
+	}
 
-	for (column = *pColumns; column; column = *++pColumns) {
+	for (column = *pColumns, i = 0; column; column = *++pColumns, i++) {
 		if (align == 'a')
 			al = column->column_align;
 
-		if (al == 'c')
-			print_color(use_color, column->hdr_color, "%*s%*s" COLUMN_DELIMITER,
-				  (column->m_width + column->hdr_width) / 2, column->m_header,
-				  (column->m_width - column->hdr_width + 1) / 2, "");
-		else if (al == 'r')
-			print_color(use_color, column->hdr_color, "%*s" COLUMN_DELIMITER,
-				  column->m_width, column->m_header);
-		else
-			print_color(use_color, column->hdr_color, "%-*s" COLUMN_DELIMITER,
-				  column->m_width, column->m_header);
+		width = column_width(column, widths, i);
+		hdr_len = strlen(column->m_header);
+		sink_color_on(sink, use_color, column->hdr_color);
+		if (al == 'c') {
+			sink_pad(sink, column->m_header, hdr_len,
+				 (width + column->hdr_width) / 2, false);
+			sink_pad(sink, "", 0, (width - column->hdr_width + 1) / 2, false);
+		} else {
+			sink_pad(sink, column->m_header, hdr_len, width, al != 'r');
+		}
+		tbl_sink_write(sink, COLUMN_DELIMITER, sizeof(COLUMN_DELIMITER) - 1);
+		sink_color_off(sink, use_color, column->hdr_color);
 	}
-	printf("\n");
+	tbl_sink_putc(sink, '\n');
 
-	return 0;
+	return sink->error;
 }
 
-void print_table_header_csv(struct table_column **pColumns)
+int print_table_header_term_sink(struct tbl_sink *sink, const char *prefix,
+				 struct table_column **pColumns, bool use_color,
+				 char align)
+{
+	return print_header_term_widths(sink, prefix, pColumns, NULL, use_color, align);
+}
+
+int print_table_header_term(const char *prefix, struct table_column **pColumns,
+			    bool use_color, char align)
+{
+	char buf[STDOUT_SINK_SIZE];
+	struct tbl_sink sink;
+	int ret;
+
+	stdout_sink_init(&sink, buf, sizeof(buf));
+	ret = print_table_header_term_sink(&sink, prefix, pColumns, use_color, align);
+	tbl_sink_close(&sink);
+
+	return ret;
+}
+
+void print_table_header_csv_sink(struct tbl_sink *sink, struct table_column **pColumns)
 {
 	struct table_column *column = *pColumns;
 
 	if (column)
-		printf("%s", column->m_name);
+		tbl_sink_puts(sink, column->m_name);
 
-	for (column = *++pColumns; column; column = *++pColumns)
-		printf(",%s", column->m_name);
+	for (column = *++pColumns; column; column = *++pColumns) {
+		tbl_sink_putc(sink, ',');
+		tbl_sink_puts(sink, column->m_name);
+	}
 
-	printf("\n");
+	tbl_sink_putc(sink, '\n');
+}
+
+void print_table_header_csv(struct table_column **pColumns)
+{
+	char buf[STDOUT_SINK_SIZE];
+	struct tbl_sink sink;
+
+	stdout_sink_init(&sink, buf, sizeof(buf));
+	print_table_header_csv_sink(&sink, pColumns);
+	tbl_sink_close(&sink);
 }
 
 /*
  * Find column with the name @name in the NULL terminated array
  * of columns @pColumns
  */
-static struct table_column *table_find_column(const char *name,
+static struct table_column *table_find_column(const char *name, size_t len,
 					      struct table_column **pColumns)
 {
 	while (*pColumns) {
-		if (!strcmp((*pColumns)->m_name, name))
+		if (tbl_name_eq((*pColumns)->m_name, name, len))
 			break;
 		pColumns++;
 	}
@@ -441,34 +707,25 @@ static int table_select_columns(const char *names, const char *delim,
 			 struct table_column **sub,
 			 int sub_len)
 {
-	char *name, *str;
 	struct table_column *clm;
+	const char *name, *p;
+	size_t len;
 	int i = 0;
 
-	str = strdup(names);
-	if (!str)
-		return -ENOMEM;
-
-	remove_spaces(str);
-
-	if (!strlen(str))
+	for (p = names; *p && isspace((unsigned char)*p); p++)
+		;
+	if (!*p)
 		return -EINVAL;
 
-	name = strtok(str, delim);
-	while (name && i < sub_len) {
-		clm = table_find_column(name, all);
-		if (!clm) {
-			free(str);
+	while (i < sub_len && (name = tbl_next_name(&names, delim, &len))) {
+		clm = table_find_column(name, len, all);
+		if (!clm)
 			return -EINVAL;
-		}
 		sub[i++] = clm;
-		name = strtok(NULL, delim);
 	}
 
 	sub[i] = NULL;
 
-	free(str);
-
 	return 0;
 }
 
@@ -487,16 +744,23 @@ int table_extend_columns(const char *arg, const char *delim,
 			 struct table_column **cs,
 			 int sub_len)
 {
-	struct table_column *sub[MAX_COLUMN_COUNT];
+	struct table_column **sub;
 	const char *names = arg;
 	int rc, i;
 
 	if (*arg == '+' || *arg == '-')
 		names = arg + 1;
 
+	if (sub_len < 0)
+		return -EINVAL;
+
+	sub = malloc((sub_len + 1) * sizeof(*sub));
+	if (!sub)
+		return -ENOMEM;
+
 	rc = table_select_columns(names, delim, all, sub, sub_len);
 	if (rc)
-		return rc;
+		goto out;
 
 	if (*arg == '-') {
 		int k = 0;
@@ -513,8 +777,10 @@ int table_extend_columns(const char *arg, const char *delim,
 			cs[i] = sub[i];
 		cs[i] = NULL;
 	}
+out:
+	free(sub);
 
-	return 0;
+	return rc;
 }
 
 #define CLM_LST(m_name, m_header, m_type, tostr, align, h_color, \
@@ -541,31 +807,70 @@ static struct table_column *columnsList[] = {
 };
 
 /*
-* Print table header and table for format TERM 
-*/
-int print_table_term(const char *prefix, struct table_column **pColumn, bool use_color)
+ * Print the description table of the columns @pColumn into @sink. The
+ * widths are measured in a layout, columnsList is shared by all callers.
+ */
+int print_table_term_sink(struct tbl_sink *sink, const char *prefix,
+			  struct table_column **pColumn, bool use_color)
 {
-	struct table_field *fields;
-	int row = 0;
+	struct tbl_layout layout;
+	struct tbl_arena arena = {};
+	struct tbl_cell *cells;
+	struct tbl_plan plan;
 	int number_of_columns;
+	int row, ret;
 
 	number_of_columns = (sizeof(columnsList) / sizeof(*columnsList) -1);
 
-	fields = malloc(sizeof(*fields) * number_of_columns * table_column_count(pColumn));
-	if (!fields)
+	cells = malloc(sizeof(*cells) * number_of_columns * (table_column_count(pColumn) ?: 1));
+	if (!cells)
 		return -ENOMEM;
 
-	for (row = 0; pColumn[row]; row++)
-		table_row_stringify((void *)pColumn[row],
-				    fields + row * number_of_columns,
-				    columnsList, true, 0);
+	ret = tbl_layout_init(&layout, columnsList);
+	if (ret) {
+		free(cells);
+		return ret;
+	}
+	ret = tbl_plan_compile(&plan, FORMAT_TERM, prefix, columnsList, use_color, 0);
+	if (ret)
+		goto out;
+
+	for (row = 0; pColumn[row] && !ret; row++)
+		ret = tbl_layout_row_stringify(&layout, (void *)pColumn[row], &arena,
+					       cells + row * number_of_columns, true, 0);
+	if (ret)
+		goto release;
+
+	tbl_layout_print_header_sink(&layout, sink, prefix, use_color, 'a');
+
+	for (row = 0; pColumn[row]; row++) {
+		tbl_layout_print_cells_sink(&layout, sink, &plan, &arena,
+					    cells + row * number_of_columns);
+		tbl_sink_row_end(sink);
+	}
+	ret = sink->error;
+release:
+	tbl_plan_release(&plan);
+out:
+	tbl_layout_release(&layout);
+	tbl_arena_release(&arena);
+	free(cells);
 
-	print_table_header_term(prefix, columnsList, use_color, 'a');
+	return ret;
+}
 
-	for (row = 0; pColumn[row]; row++)
-		print_table_fields_term(prefix, fields + row * number_of_columns,
-				      columnsList, use_color, 0);
-	free(fields);
+/*
+* Print table header and table for format TERM 
+*/
+int print_table_term(const char *prefix, struct table_column **pColumn, bool use_color)
+{
+	char buf[STDOUT_SINK_SIZE];
+	struct tbl_sink sink;
+	int ret;
 
-	return 0;
+	stdout_sink_init(&sink, buf, sizeof(buf));
+	ret = print_table_term_sink(&sink, prefix, pColumn, use_color);
+	tbl_sink_close(&sink);
+
+	return ret;
 }
@@ -0,0 +1,217 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+#include "libtbl.h"
+#include "libtbl_helper.h"
+#include <errno.h>
+#include <string.h>
+
+/* terminal synchronized output: the frame is shown once it is complete */
+#define SYNC_BEGIN	"\x1B[?2026h"
+#define SYNC_END	"\x1B[?2026l"
+#define HOME_CLEAR	"\x1B[H\x1B[2J"
+#define CLEAR_BELOW	"\x1B[J"
+
+int tbl_live_init(struct tbl_live *live, struct tbl_sink *sink,
+		  const char *prefix, struct table_column **pColumns,
+		  bool use_color, int humanize, size_t pre_len, char align)
+{
+	struct table_column *column;
+	int i, ret;
+
+	memset(live, 0, sizeof(*live));
+	live->sink = sink;
+	live->prefix = prefix ?: "";
+	live->pre_len = pre_len;
+	live->use_color = use_color;
+	live->humanize = humanize;
+	live->align = align ?: 'a';
+	live->redraw = true;
+
+	ret = tbl_layout_init(&live->layout, pColumns);
+	if (ret)
+		return ret;
+
+	live->cols = malloc(2 * (live->layout.count ?: 1) * sizeof(*live->cols));
+	if (!live->cols) {
+		tbl_layout_release(&live->layout);
+		return -ENOMEM;
+	}
+
+	/* the header is never rewritten in place, it must not stick out */
+	for (i = 0; (column = pColumns[i]); i++)
+		if (live->layout.widths[i] < column->hdr_width)
+			live->layout.widths[i] = column->hdr_width;
+
+	ret = tbl_plan_compile(&live->plan, FORMAT_TERM, live->prefix, pColumns,
+			       use_color, pre_len);
+	if (ret)
+		tbl_live_release(live);
+
+	return ret;
+}
+
+void tbl_live_release(struct tbl_live *live)
+{
+	tbl_plan_release(&live->plan);
+	tbl_layout_release(&live->layout);
+	free(live->cols);
+	live->cols = NULL;
+	tbl_arena_release(&live->arena[0]);
+	tbl_arena_release(&live->arena[1]);
+	free(live->cells[0]);
+	free(live->cells[1]);
+	live->cells[0] = live->cells[1] = NULL;
+	live->cap = 0;
+}
+
+void tbl_live_invalidate(struct tbl_live *live)
+{
+	live->redraw = true;
+}
+
+/* Move the cursor to the 1-based @row and @col */
+static void live_goto(struct tbl_sink *sink, int row, int col)
+{
+	char *p = tbl_sink_reserve(sink, 2 * TBL_INT_BUF_SIZE + 4);
+
+	if (!p)
+		return;
+
+	p[0] = '\x1B';
+	p[1] = '[';
+	p += 2;
+	p += tbl_u64toa(p, row);
+	*p++ = ';';
+	p += tbl_u64toa(p, col);
+	*p++ = 'H';
+	sink->len = p - sink->buf;
+}
+
+static int live_reserve(struct tbl_live *live, int rows)
+{
+	size_t size;
+	void *cells;
+	int i;
+
+	if (rows <= live->cap)
+		return 0;
+
+	size = (size_t)rows * (live->layout.count ?: 1) * sizeof(struct tbl_cell);
+	for (i = 0; i < 2; i++) {
+		cells = realloc(live->cells[i], size);
+		if (!cells)
+			return -ENOMEM;
+		live->cells[i] = cells;
+	}
+	live->cap = rows;
+
+	return 0;
+}
+
+static bool cell_changed(const struct tbl_arena *a, const struct tbl_cell *x,
+			 const struct tbl_arena *b, const struct tbl_cell *y)
+{
+	return x->len != y->len || x->mColor != y->mColor ||
+	       memcmp(a->base + x->off, b->base + y->off, x->len);
+}
+
+/* Rewrite cell @i in place, the same bytes tbl_plan_emit() prints for it */
+static void live_cell(struct tbl_live *live, int i, const struct tbl_cell *cell,
+		      const struct tbl_arena *arena)
+{
+	struct table_column *column = live->layout.columns[i];
+	struct tbl_sink *sink = live->sink;
+	int width = live->layout.widths[i];
+
+	sink_color_on(sink, live->use_color, cell->mColor);
+	if (!i) {
+		tbl_sink_puts(sink, live->prefix);
+		width -= live->pre_len;
+	}
+	sink_pad(sink, arena->base + cell->off, cell->len, width,
+		 column->column_align == 'l');
+	tbl_sink_write(sink, COLUMN_DELIMITER, sizeof(COLUMN_DELIMITER) - 1);
+	sink_color_off(sink, live->use_color, cell->mColor);
+}
+
+int tbl_live_frame(struct tbl_live *live, void **v)
+{
+	int count = live->layout.count;
+	int *old = live->cols, *col = live->cols + count;
+	int next = !live->last, last = live->last;
+	struct tbl_sink *sink = live->sink;
+	const struct tbl_cell *a, *b;
+	struct tbl_cell *cells;
+	bool redraw;
+	int n, r, i, ret;
+
+	for (n = 0; v[n]; n++)
+		;
+
+	ret = live_reserve(live, n);
+	if (ret)
+		return ret;
+
+	memcpy(old, live->layout.widths, count * sizeof(*old));
+	tbl_arena_reset(&live->arena[next]);
+	for (r = 0; r < n; r++) {
+		cells = live->cells[next] + r * count;
+		ret = tbl_layout_row_stringify(&live->layout, v[r], &live->arena[next],
+					       cells, live->humanize, live->pre_len);
+		if (ret) {
+			/* the widths may have grown already */
+			live->redraw = true;
+			return ret;
+		}
+	}
+	redraw = live->redraw || memcmp(old, live->layout.widths, count * sizeof(*old));
+
+	tbl_sink_puts(sink, SYNC_BEGIN);
+	if (redraw) {
+		tbl_sink_puts(sink, HOME_CLEAR);
+		tbl_layout_print_header_sink(&live->layout, sink, live->prefix,
+					     live->use_color, live->align);
+		for (r = 0; r < n; r++)
+			tbl_layout_print_cells_sink(&live->layout, sink, &live->plan,
+						    &live->arena[next],
+						    live->cells[next] + r * count);
+		live->redraws++;
+	} else {
+		for (i = 0, col[0] = 1; i + 1 < count; i++)
+			col[i + 1] = col[i] + live->layout.widths[i] +
+				     sizeof(COLUMN_DELIMITER) - 1;
+
+		/* the header is line 1 */
+		for (r = 0; r < n && r < live->rows; r++) {
+			a = live->cells[next] + r * count;
+			b = live->cells[last] + r * count;
+			for (i = 0; i < count; i++) {
+				if (!cell_changed(&live->arena[next], &a[i],
+						  &live->arena[last], &b[i]))
+					continue;
+				live_goto(sink, r + 2, col[i]);
+				live_cell(live, i, &a[i], &live->arena[next]);
+				live->updates++;
+			}
+		}
+
+		for (r = live->rows; r < n; r++) {
+			live_goto(sink, r + 2, 1);
+			tbl_layout_print_cells_sink(&live->layout, sink, &live->plan,
+						    &live->arena[next],
+						    live->cells[next] + r * count);
+		}
+
+		/* park below the table, clearing the rows which went away */
+		live_goto(sink, n + 2, 1);
+		if (n < live->rows)
+			tbl_sink_puts(sink, CLEAR_BELOW);
+	}
+	tbl_sink_puts(sink, SYNC_END);
+
+	live->last = next;
+	live->rows = n;
+	live->redraw = false;
+	live->frames++;
+
+	return tbl_sink_flush(sink);
+}
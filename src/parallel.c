@@ -0,0 +1,442 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+#include "libtbl.h"
+#include "libtbl_helper.h"
+#include <errno.h>
+#include <pthread.h>
+#include <string.h>
+#include <unistd.h>
+
+/* rows per chunk and chunks per thread processed between two emissions */
+#define PAR_CHUNK_ROWS 1024
+#define PAR_WAVE_CHUNKS 4
+
+struct par_chunk {
+	void			**rows;
+	int			nrows;
+	int			nkept;		/* rows passing the filter */
+	unsigned long		first;		/* rows printed before the chunk */
+	struct tbl_arena	arena;
+	struct tbl_cell		*cells;
+	int			*max;		/* widest cell of each column */
+	int			*widths;	/* widths before the first row */
+	struct tbl_totals	totals;		/* of the rows kept */
+	struct tbl_sink		out;
+	int			error;
+};
+
+struct par_render {
+	enum format_type	format;
+	const char		*pre;
+	struct table_column	**cs;
+	int			count;
+	bool			use_color;
+	int			humanize;
+	size_t			pre_len;
+	const struct tbl_hot	*hot;
+	const struct tbl_filter	*filter;
+	bool			totals;
+	struct tbl_stats	*stats;		/* of the calling thread */
+	struct tbl_plan		plan;		/* shared by all threads */
+	bool			color_runs;
+	struct par_chunk	*chunks;
+	int			nchunks;
+
+	/* worker pool */
+	pthread_mutex_t		lock;
+	pthread_cond_t		work;
+	pthread_cond_t		done;
+	pthread_t		*threads;
+	int			nthreads;
+	unsigned		gen;
+	int			busy;
+	bool			stop;
+	void			(*job)(struct par_render *pr, struct par_chunk *chunk);
+	int			next;
+	int			todo;
+};
+
+static void par_run_chunks(struct par_render *pr)
+{
+	int i;
+
+	tbl_stats_cur = pr->stats;
+	while ((i = __atomic_fetch_add(&pr->next, 1, __ATOMIC_RELAXED)) < pr->todo)
+		pr->job(pr, &pr->chunks[i]);
+}
+
+static void *par_worker(void *arg)
+{
+	struct par_render *pr = arg;
+	unsigned gen = 0;
+
+	pthread_mutex_lock(&pr->lock);
+	for (;;) {
+		while (gen == pr->gen && !pr->stop)
+			pthread_cond_wait(&pr->work, &pr->lock);
+		if (pr->stop)
+			break;
+		gen = pr->gen;
+		pthread_mutex_unlock(&pr->lock);
+
+		par_run_chunks(pr);
+
+		pthread_mutex_lock(&pr->lock);
+		if (!--pr->busy)
+			pthread_cond_signal(&pr->done);
+	}
+	pthread_mutex_unlock(&pr->lock);
+
+	return NULL;
+}
+
+/* Run @job on the first @todo chunks using the pool and the calling thread */
+static void par_dispatch(struct par_render *pr,
+			 void (*job)(struct par_render *pr, struct par_chunk *chunk),
+			 int todo)
+{
+	pthread_mutex_lock(&pr->lock);
+	pr->job = job;
+	pr->todo = todo;
+	pr->next = 0;
+	pr->busy = pr->nthreads;
+	pr->gen++;
+	pthread_cond_broadcast(&pr->work);
+	pthread_mutex_unlock(&pr->lock);
+
+	par_run_chunks(pr);
+
+	pthread_mutex_lock(&pr->lock);
+	while (pr->busy)
+		pthread_cond_wait(&pr->done, &pr->lock);
+	pthread_mutex_unlock(&pr->lock);
+}
+
+/*
+ * Phase 1: filter and stringify a chunk and find the widest cell of each
+ * column. The cells of the rows kept are stored one row after the other.
+ */
+static void par_stringify(struct par_render *pr, struct par_chunk *chunk)
+{
+	struct tbl_cell *cells;
+	int i, c, len;
+
+	tbl_arena_reset(&chunk->arena);
+	memset(chunk->max, 0, pr->count * sizeof(*chunk->max));
+	chunk->totals.rows = 0;
+
+	for (i = 0, chunk->nkept = 0; i < chunk->nrows; i++) {
+		if (pr->filter && !tbl_filter_match(pr->filter, chunk->rows[i]))
+			continue;
+		if (pr->totals)
+			tbl_totals_add(&chunk->totals, pr->cs, chunk->rows[i]);
+
+		cells = chunk->cells + chunk->nkept++ * pr->count;
+		chunk->error = arena_row_stringify(chunk->rows[i], &chunk->arena, cells,
+						   pr->hot, pr->humanize);
+		if (chunk->error)
+			return;
+
+		for (c = 0; c < pr->count; c++) {
+			len = tbl_str_width(chunk->arena.base + cells[c].off,
+					    cells[c].len) + (c ? 0 : pr->pre_len);
+			if (chunk->max[c] < len)
+				chunk->max[c] = len;
+		}
+	}
+}
+
+/*
+ * Phase 2: render a chunk into its own buffer. The widths grow row by row
+ * starting from the widths left by all previous chunks, exactly like the
+ * serial print_table_all_rows() grows m_width.
+ */
+static void par_render_chunk(struct par_render *pr, struct par_chunk *chunk)
+{
+	struct tbl_row_cells row = { .arena = &chunk->arena };
+	int *widths = chunk->widths;
+	int i, c, len;
+
+	chunk->out.len = 0;
+	chunk->out.flushed = 0;
+	chunk->out.color_runs = pr->color_runs;
+	chunk->out.color_saved = 0;
+
+	for (i = 0; i < chunk->nkept && !chunk->error; i++) {
+		row.cells = chunk->cells + i * pr->count;
+
+		for (c = 0; c < pr->count; c++) {
+			len = tbl_str_width(chunk->arena.base + row.cells[c].off,
+					    row.cells[c].len) + (c ? 0 : pr->pre_len);
+			if (widths[c] < len)
+				widths[c] = len;
+		}
+
+		if ((chunk->first + i) && pr->format == FORMAT_JSON)
+			tbl_sink_write(&chunk->out, ",\n", 2);
+
+		chunk->error = tbl_plan_emit(&chunk->out, &pr->plan, &row, widths);
+	}
+}
+
+static void par_release(struct par_render *pr)
+{
+	struct par_chunk *chunk;
+	int i;
+
+	if (pr->threads) {
+		pthread_mutex_lock(&pr->lock);
+		pr->stop = true;
+		pthread_cond_broadcast(&pr->work);
+		pthread_mutex_unlock(&pr->lock);
+		for (i = 0; i < pr->nthreads; i++)
+			pthread_join(pr->threads[i], NULL);
+		free(pr->threads);
+	}
+
+	for (i = 0; pr->chunks && i < pr->nchunks; i++) {
+		chunk = &pr->chunks[i];
+		tbl_arena_release(&chunk->arena);
+		tbl_sink_release(&chunk->out);
+		free(chunk->rows);
+		free(chunk->cells);
+		free(chunk->max);
+		free(chunk->widths);
+		tbl_totals_release(&chunk->totals);
+	}
+	free(pr->chunks);
+
+	pthread_cond_destroy(&pr->done);
+	pthread_cond_destroy(&pr->work);
+	pthread_mutex_destroy(&pr->lock);
+}
+
+static int par_init(struct par_render *pr, int nthreads)
+{
+	struct par_chunk *chunk;
+	int i;
+
+	pthread_mutex_init(&pr->lock, NULL);
+	pthread_cond_init(&pr->work, NULL);
+	pthread_cond_init(&pr->done, NULL);
+
+	pr->nchunks = nthreads * PAR_WAVE_CHUNKS;
+	pr->chunks = calloc(pr->nchunks, sizeof(*pr->chunks));
+	if (!pr->chunks)
+		return -ENOMEM;
+
+	for (i = 0; i < pr->nchunks; i++) {
+		chunk = &pr->chunks[i];
+		chunk->rows = malloc(PAR_CHUNK_ROWS * sizeof(*chunk->rows));
+		chunk->cells = malloc(PAR_CHUNK_ROWS * (pr->count ?: 1) * sizeof(*chunk->cells));
+		chunk->max = calloc(pr->count ?: 1, sizeof(*chunk->max));
+		chunk->widths = calloc(pr->count ?: 1, sizeof(*chunk->widths));
+		if (!chunk->rows || !chunk->cells || !chunk->max || !chunk->widths ||
+		    tbl_sink_init_heap(&chunk->out, 0) ||
+		    (pr->totals && tbl_totals_init(&chunk->totals, pr->count)))
+			return -ENOMEM;
+	}
+
+	/* the calling thread is a worker as well */
+	pr->threads = calloc(nthreads, sizeof(*pr->threads));
+	if (!pr->threads)
+		return -ENOMEM;
+	for (i = 0; i < nthreads - 1; i++) {
+		if (pthread_create(&pr->threads[i], NULL, par_worker, pr))
+			break;
+		pr->nthreads++;
+	}
+
+	return 0;
+}
+
+/* Workers asked for, one per online CPU if @nthreads <= 0 */
+static int par_threads(int nthreads)
+{
+	return nthreads > 0 ? nthreads : sysconf(_SC_NPROCESSORS_ONLN);
+}
+
+/* Pull up to PAR_CHUNK_ROWS rows of @src into @chunk, true at the end of @src */
+static bool par_fill(struct par_chunk *chunk, const struct tbl_row_source *src,
+		     unsigned long *pulled)
+{
+	void *row;
+
+	for (chunk->nrows = 0; chunk->nrows < PAR_CHUNK_ROWS; chunk->nrows++) {
+		if (src->limit && *pulled == src->limit)
+			return true;
+		row = src->next(src->state);
+		if (!row)
+			return true;
+		chunk->rows[chunk->nrows] = row;
+		(*pulled)++;
+	}
+
+	return false;
+}
+
+int tbl_layout_print_source_parallel_sink(struct tbl_layout *layout,
+					  struct tbl_sink *sink,
+					  const struct tbl_row_source *src,
+					  enum format_type pFormat, const char *pre,
+					  bool use_color, int humanize,
+					  size_t pre_len, int nthreads)
+{
+	struct par_render pr = {
+		.format = pFormat,
+		.pre = pre,
+		.cs = layout->columns,
+		.count = layout->count,
+		.use_color = use_color,
+		.humanize = humanize,
+		.pre_len = pre_len,
+		.hot = &layout->hot,
+		.filter = layout->filter,
+		.totals = layout->totals,
+		.color_runs = sink->color_runs,
+		.stats = tbl_stats_cur,
+	};
+	unsigned long pulled = 0, emitted = 0;
+	int *widths = layout->widths;
+	struct par_chunk *chunk;
+	int todo, i, c, ret;
+	bool end = false;
+
+	if (pFormat != FORMAT_TERM && pFormat != FORMAT_CSV &&
+	    pFormat != FORMAT_JSON && pFormat != FORMAT_XML &&
+	    pFormat != FORMAT_ARROW && pFormat != FORMAT_JSONL)
+		return -EINVAL;
+	if (tbl_totals_short(layout))
+		return -EINVAL;
+
+	nthreads = par_threads(nthreads);
+	/* no more threads than chunks of rows to expect */
+	if (src->size_hint &&
+	    (unsigned long)nthreads > (src->size_hint - 1) / PAR_CHUNK_ROWS + 1)
+		nthreads = (src->size_hint - 1) / PAR_CHUNK_ROWS + 1;
+	/* the rows kept up to a limit are only known after filtering them */
+	if (nthreads <= 1 || pFormat == FORMAT_ARROW ||
+	    (layout->filter && src->limit))
+		return tbl_layout_print_source_sink(layout, sink, src, pFormat, pre,
+						    use_color, humanize, pre_len);
+
+	ret = tbl_plan_compile(&pr.plan, pFormat, pre, layout->columns, use_color,
+			       pre_len);
+	if (ret)
+		return ret;
+
+	ret = par_init(&pr, nthreads);
+	if (ret)
+		goto out;
+
+	while (!end) {
+		for (todo = 0; todo < pr.nchunks && !end; todo++) {
+			chunk = &pr.chunks[todo];
+			end = par_fill(chunk, src, &pulled);
+			if (!chunk->nrows)
+				break;
+		}
+
+		par_dispatch(&pr, par_stringify, todo);
+
+		/* prefix maximum: the widths each chunk starts from */
+		for (i = 0; i < todo; i++) {
+			chunk = &pr.chunks[i];
+			chunk->first = emitted;
+			emitted += chunk->nkept;
+			layout->scanned += chunk->nrows;
+			layout->emitted += chunk->nkept;
+			if (layout->totals)
+				tbl_totals_merge(layout->totals, &chunk->totals, pr.cs);
+			memcpy(chunk->widths, widths, pr.count * sizeof(*widths));
+			for (c = 0; c < pr.count; c++)
+				if (widths[c] < chunk->max[c])
+					widths[c] = chunk->max[c];
+		}
+
+		par_dispatch(&pr, par_render_chunk, todo);
+
+		for (i = 0; i < todo; i++) {
+			chunk = &pr.chunks[i];
+			if (chunk->error) {
+				ret = chunk->error;
+				goto out;
+			}
+			tbl_sink_write(sink, chunk->out.buf, chunk->out.len);
+			sink->color_saved += chunk->out.color_saved;
+			tbl_sink_row_end(sink);
+		}
+	}
+
+	ret = sink->error;
+out:
+	par_release(&pr);
+	tbl_plan_release(&pr.plan);
+
+	return ret;
+}
+
+int tbl_layout_print_rows_parallel_sink(struct tbl_layout *layout,
+					struct tbl_sink *sink, void **v,
+					enum format_type pFormat, const char *pre,
+					bool use_color, int humanize,
+					size_t pre_len, int nthreads)
+{
+	struct tbl_row_source src;
+	unsigned long n, cap;
+
+	/* count as far as it can cap the threads, a chunk or less is serial */
+	cap = (unsigned long)par_threads(nthreads) * PAR_CHUNK_ROWS;
+	for (n = 0; n < cap && v[n]; n++)
+		;
+	if (n <= PAR_CHUNK_ROWS)
+		nthreads = 1;
+
+	tbl_row_source_array(&src, &v);
+	src.size_hint = n;
+
+	return tbl_layout_print_source_parallel_sink(layout, sink, &src, pFormat,
+						     pre, use_color, humanize,
+						     pre_len, nthreads);
+}
+
+int print_table_all_rows_parallel_sink(struct tbl_sink *sink, void **v,
+				       enum format_type pFormat, const char *pre,
+				       struct table_column **cs, bool use_color,
+				       int humanize, size_t pre_len, int nthreads)
+{
+	struct tbl_layout layout;
+	int ret;
+
+	ret = tbl_layout_init(&layout, cs);
+	if (ret)
+		return ret;
+
+	/* leave the columns as wide as the serial path does */
+	ret = tbl_layout_print_rows_parallel_sink(&layout, sink, v, pFormat, pre,
+						  use_color, humanize, pre_len,
+						  nthreads);
+	tbl_layout_store(&layout);
+	tbl_layout_release(&layout);
+
+	return ret;
+}
+
+int print_table_all_rows_parallel(void **v, enum format_type pFormat,
+				  const char *pre, struct table_column **cs,
+				  bool use_color, int humanize, size_t pre_len,
+				  int nthreads)
+{
+	struct tbl_sink sink;
+	int ret;
+
+	ret = tbl_sink_init_file(&sink, stdout, NULL, 0);
+	if (ret)
+		return ret;
+
+	ret = print_table_all_rows_parallel_sink(&sink, v, pFormat, pre, cs, use_color,
+						 humanize, pre_len, nthreads);
+	ret = tbl_sink_close(&sink) ?: ret;
+	tbl_sink_release(&sink);
+
+	return ret;
+}
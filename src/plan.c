@@ -0,0 +1,473 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+#include "libtbl.h"
+#include "libtbl_helper.h"
+#include <errno.h>
+#include <string.h>
+
+#define PLAN_PAD	0x01	/* pad to the column width */
+#define PLAN_LEFT	0x02	/* left aligned */
+#define PLAN_NULL	0x04	/* empty uncolored cells are printed as null */
+#define PLAN_ESCAPE	0x08	/* escape the cell for plan->format */
+#define PLAN_NUMBER	0x10	/* quoted unless the cell is a JSON number */
+
+/*
+ * One cell of a row: @head is written before the color sequence, @lead
+ * and @trail around the cell inside of it. The literals are stored one
+ * after the other at @off in plan->lit.
+ */
+struct tbl_plan_slot {
+	uint32_t	off;
+	uint32_t	head;
+	uint32_t	lead;
+	uint32_t	trail;
+	uint32_t	flags;
+};
+
+/* Close the literal segment started at @start and return its length */
+static uint32_t plan_seg(struct tbl_plan *plan, size_t *start)
+{
+	size_t end = tbl_sink_bytes(&plan->lit);
+	uint32_t len = end - *start;
+
+	*start = end;
+
+	return len;
+}
+
+/* Cells of @column are quoted in @pFormat */
+static bool plan_quoted(enum format_type pFormat, const struct table_column *column)
+{
+	if (pFormat == FORMAT_JSONL)
+		return !table_type_is_int(column->m_type);
+
+	return column->m_type == FIELD_STR;
+}
+
+/*
+ * The literals between the previous cell and cell @i of @pColumns, after
+ * the last cell if @i is @count. Nothing is written unless plan_has_head().
+ */
+static void plan_head(struct tbl_sink *out, enum format_type pFormat,
+		      const char *prefix, struct table_column **pColumns,
+		      int i, int count)
+{
+	struct table_column *column = pColumns[i];
+
+	if (i == count) {
+		switch (pFormat) {
+		case FORMAT_TERM:
+			if (count)
+				tbl_sink_putc(out, '\n');
+			break;
+		case FORMAT_CSV:
+			tbl_sink_putc(out, '\n');
+			break;
+		case FORMAT_JSON:
+			if (!count) {
+				tbl_sink_puts(out, prefix);
+				tbl_sink_putc(out, '{');
+			}
+			tbl_sink_putc(out, '\n');
+			tbl_sink_puts(out, prefix);
+			tbl_sink_putc(out, '}');
+			break;
+		case FORMAT_JSONL:
+			tbl_sink_puts(out, count ? "}\n" : "{}\n");
+			break;
+		case FORMAT_XML:
+			if (count) {
+				tbl_sink_puts(out, "</");
+				tbl_sink_puts(out, pColumns[count - 1]->m_name);
+				tbl_sink_puts(out, ">\n");
+			}
+			break;
+		default:
+			break;
+		}
+		return;
+	}
+
+	switch (pFormat) {
+	case FORMAT_CSV:
+		if (i)
+			tbl_sink_putc(out, ',');
+		break;
+	case FORMAT_JSON:
+		if (!i) {
+			tbl_sink_puts(out, prefix);
+			tbl_sink_putc(out, '{');
+		}
+		tbl_sink_puts(out, i ? ",\n" : "\n");
+		tbl_sink_puts(out, prefix);
+		tbl_sink_puts(out, "\t\"");
+		tbl_sink_puts(out, column->m_name);
+		tbl_sink_puts(out, "\": ");
+		break;
+	case FORMAT_JSONL:
+		tbl_sink_puts(out, i ? ",\"" : "{\"");
+		tbl_escape_sink(out, FORMAT_JSON, column->m_name,
+				strlen(column->m_name));
+		tbl_sink_puts(out, "\":");
+		break;
+	case FORMAT_XML:
+		if (i) {
+			tbl_sink_puts(out, "</");
+			tbl_sink_puts(out, pColumns[i - 1]->m_name);
+			tbl_sink_puts(out, ">\n");
+		}
+		tbl_sink_puts(out, prefix);
+		tbl_sink_putc(out, '<');
+		tbl_sink_puts(out, column->m_name);
+		tbl_sink_putc(out, '>');
+		break;
+	default:
+		break;
+	}
+}
+
+static bool plan_has_head(enum format_type pFormat, int i, int count)
+{
+	switch (pFormat) {
+	case FORMAT_TERM:
+		return i == count && count;
+	case FORMAT_CSV:
+		return i || !count;
+	case FORMAT_XML:
+		return count;
+	default:
+		return true;
+	}
+}
+
+/* The literals in front of cell @i, inside of its color */
+static void plan_lead(struct tbl_sink *out, enum format_type pFormat,
+		      const char *prefix, int i, bool quoted)
+{
+	if (pFormat == FORMAT_TERM && !i)
+		tbl_sink_puts(out, prefix);
+	else if (pFormat != FORMAT_TERM && quoted)
+		tbl_sink_putc(out, '"');
+}
+
+static void plan_trail(struct tbl_sink *out, enum format_type pFormat, bool quoted)
+{
+	if (pFormat == FORMAT_TERM)
+		tbl_sink_puts(out, COLUMN_DELIMITER);
+	else if (quoted)
+		tbl_sink_putc(out, '"');
+}
+
+static uint32_t plan_flags(enum format_type pFormat,
+			   const struct table_column *column, bool quoted)
+{
+	uint32_t flags = 0;
+
+	if (pFormat == FORMAT_TERM) {
+		flags = PLAN_PAD;
+		if (column->column_align == 'l')
+			flags |= PLAN_LEFT;
+	} else if (pFormat == FORMAT_XML || quoted) {
+		flags = PLAN_ESCAPE;
+	} else if (pFormat == FORMAT_JSON) {
+		flags = PLAN_NULL;
+		if (table_type_is_unit(column->m_type))
+			flags |= PLAN_NUMBER;
+	} else if (pFormat == FORMAT_JSONL) {
+		flags = PLAN_NULL | PLAN_NUMBER;
+	}
+
+	return flags;
+}
+
+/* The fields of @plan, without literals; *@prefix is adjusted to @pFormat */
+static int plan_setup(struct tbl_plan *plan, enum format_type pFormat,
+		      const char **prefix, struct table_column **pColumns,
+		      bool use_color, int pwidth)
+{
+	if (pFormat != FORMAT_TERM && pFormat != FORMAT_CSV &&
+	    pFormat != FORMAT_JSON && pFormat != FORMAT_XML &&
+	    pFormat != FORMAT_JSONL)
+		return -EINVAL;
+
+	/* log records: no prefix, no escape sequences */
+	if (pFormat == FORMAT_JSONL) {
+		*prefix = NULL;
+		use_color = false;
+	}
+
+	memset(plan, 0, sizeof(*plan));
+	plan->format = pFormat;
+	plan->columns = pColumns;
+	plan->count = table_column_count(pColumns);
+	plan->use_color = use_color;
+	plan->pwidth = pwidth;
+	*prefix = *prefix ?: "";
+
+	return 0;
+}
+
+int tbl_plan_compile(struct tbl_plan *plan, enum format_type pFormat,
+		     const char *prefix, struct table_column **pColumns,
+		     bool use_color, int pwidth)
+{
+	struct tbl_plan_slot *slot;
+	size_t pos = 0;
+	bool quoted;
+	int i, ret;
+
+	ret = plan_setup(plan, pFormat, &prefix, pColumns, use_color, pwidth);
+	if (ret)
+		return ret;
+
+	plan->slots = calloc(plan->count + 1, sizeof(*plan->slots));
+	if (!plan->slots || tbl_sink_init_heap(&plan->lit, 256)) {
+		tbl_plan_release(plan);
+		return -ENOMEM;
+	}
+
+	for (i = 0; i < plan->count; i++) {
+		slot = &plan->slots[i];
+		slot->off = pos;
+		quoted = plan_quoted(pFormat, pColumns[i]);
+		plan_head(&plan->lit, pFormat, prefix, pColumns, i, plan->count);
+		slot->head = plan_seg(plan, &pos);
+		plan_lead(&plan->lit, pFormat, prefix, i, quoted);
+		slot->lead = plan_seg(plan, &pos);
+		plan_trail(&plan->lit, pFormat, quoted);
+		slot->trail = plan_seg(plan, &pos);
+		slot->flags = plan_flags(pFormat, pColumns[i], quoted);
+	}
+
+	/* the row tail is the head of the extra slot */
+	slot = &plan->slots[plan->count];
+	slot->off = pos;
+	plan_head(&plan->lit, pFormat, prefix, pColumns, plan->count, plan->count);
+	slot->head = plan_seg(plan, &pos);
+
+	if (plan->lit.error) {
+		tbl_plan_release(plan);
+		return -ENOMEM;
+	}
+
+	return 0;
+}
+
+void tbl_plan_release(struct tbl_plan *plan)
+{
+	free(plan->slots);
+	plan->slots = NULL;
+	tbl_sink_release(&plan->lit);
+}
+
+static size_t skip_digits(const char *str, size_t i, size_t len)
+{
+	while (i < len && str[i] >= '0' && str[i] <= '9')
+		i++;
+
+	return i;
+}
+
+static inline bool json_number(const char *str, size_t len)
+{
+	size_t i = 0, j;
+
+	if (i < len && str[i] == '-')
+		i++;
+	if (i < len && str[i] == '0')
+		i++;
+	else if (i < len && str[i] >= '1' && str[i] <= '9')
+		i = skip_digits(str, i + 1, len);
+	else
+		return false;
+
+	if (i < len && str[i] == '.') {
+		j = skip_digits(str, i + 1, len);
+		if (j == i + 1)
+			return false;
+		i = j;
+	}
+	if (i < len && (str[i] == 'e' || str[i] == 'E')) {
+		i++;
+		if (i < len && (str[i] == '+' || str[i] == '-'))
+			i++;
+		j = skip_digits(str, i, len);
+		if (j == i)
+			return false;
+		i = j;
+	}
+
+	return i == len;
+}
+
+static inline bool color_is_fg(enum color pColor)
+{
+	return (pColor >= CRED && pColor <= CWHT) || pColor == CDGR;
+}
+
+static inline size_t color_switch(struct tbl_sink *sink, enum color *cur,
+				  enum color want)
+{
+	size_t n = 0;
+
+	if (*cur == want)
+		return 0;
+
+	if (*cur != CNRM && (want == CNRM || !color_is_fg(*cur) || !color_is_fg(want))) {
+		sink_color(sink, CNRM);
+		n += color_lens[CNRM];
+	}
+	if (want != CNRM) {
+		sink_color(sink, want);
+		n += color_lens[want];
+	}
+	*cur = want;
+
+	return n;
+}
+
+/* The emit loop inlines the static versions, libtbl.hpp calls these */
+bool tbl_json_number(const char *str, size_t len)
+{
+	return json_number(str, len);
+}
+
+size_t tbl_sink_color_switch(struct tbl_sink *sink, enum color *cur,
+			     enum color want)
+{
+	return color_switch(sink, cur, want);
+}
+
+/*
+ * Emit @row following @plan. Without compiled slots (@direct) the literals
+ * are written to @sink as they are needed, following @prefix, which saves
+ * compiling a plan for a single row.
+ */
+static inline __attribute__((always_inline))
+int plan_emit(struct tbl_sink *sink, const struct tbl_plan *plan, bool direct,
+	      const char *prefix, const struct tbl_row_cells *row,
+	      const int *widths)
+{
+	const struct tbl_plan_slot *slot = NULL;
+	struct tbl_stats *stats = tbl_stats_get();
+	enum color pColor, cur = CNRM;
+	size_t len, hits, plain = 0, used = 0;
+	const char *lit = NULL, *str;
+	bool on, quoted = false;
+	uint64_t start = 0;
+	uint32_t flags;
+	int width, i;
+
+	if (stats)
+		start = tbl_stats_clock();
+
+	for (i = 0; i < plan->count; i++) {
+		str = tbl_row_cell(row, i, &len, &pColor);
+		on = color_used(plan->use_color, pColor);
+		if (on)
+			plain += color_lens[pColor] + color_lens[CNRM];
+		if (direct) {
+			quoted = plan_quoted(plan->format, plan->columns[i]);
+			flags = plan_flags(plan->format, plan->columns[i], quoted);
+		} else {
+			slot = &plan->slots[i];
+			lit = plan->lit.buf + slot->off;
+			flags = slot->flags;
+		}
+
+		/* literals outside of the cells are never colored */
+		if (direct ? plan_has_head(plan->format, i, plan->count) : slot->head) {
+			used += color_switch(sink, &cur, CNRM);
+			if (direct) {
+				plan_head(sink, plan->format, prefix, plan->columns,
+					  i, plan->count);
+			} else {
+				tbl_sink_write(sink, lit, slot->head);
+				lit += slot->head;
+			}
+		}
+
+		if (!len && !on && (flags & PLAN_NULL)) {
+			used += color_switch(sink, &cur, CNRM);
+			tbl_sink_write(sink, "null", 4);
+			continue;
+		}
+
+		used += color_switch(sink, &cur, on ? pColor : CNRM);
+		if (direct) {
+			plan_lead(sink, plan->format, prefix, i, quoted);
+		} else {
+			tbl_sink_write(sink, lit, slot->lead);
+			lit += slot->lead;
+		}
+
+		if (flags & PLAN_PAD) {
+			width = widths ? widths[i] : plan->columns[i]->m_width;
+			if (!i)
+				width -= plan->pwidth;
+			sink_pad(sink, str, len, width, flags & PLAN_LEFT);
+		} else if (flags & PLAN_ESCAPE) {
+			hits = tbl_escape_sink(sink, plan->format == FORMAT_JSONL ?
+					       FORMAT_JSON : plan->format, str, len);
+			if (stats && hits && i < stats->count)
+				tbl_stats_add(&stats->columns[i].escapes, hits);
+		} else if ((flags & PLAN_NUMBER) && !json_number(str, len)) {
+			/* e.g. humanized "1.5K" */
+			tbl_sink_putc(sink, '"');
+			tbl_escape_sink(sink, FORMAT_JSON, str, len);
+			tbl_sink_putc(sink, '"');
+		} else {
+			tbl_sink_write(sink, str, len);
+		}
+
+		if (direct)
+			plan_trail(sink, plan->format, quoted);
+		else
+			tbl_sink_write(sink, lit, slot->trail);
+		if (!sink->color_runs)
+			used += color_switch(sink, &cur, CNRM);
+	}
+	used += color_switch(sink, &cur, CNRM);
+	if (direct) {
+		plan_head(sink, plan->format, prefix, plan->columns, plan->count,
+			  plan->count);
+	} else {
+		slot = &plan->slots[plan->count];
+		tbl_sink_write(sink, plan->lit.buf + slot->off, slot->head);
+	}
+	sink->color_saved += plain - used;
+	if (stats) {
+		tbl_stats_add(&stats->emitted, 1);
+		tbl_stats_add(&stats->emit_cycles, tbl_stats_clock() - start);
+	}
+
+	return sink->error;
+}
+
+int tbl_plan_emit(struct tbl_sink *sink, const struct tbl_plan *plan,
+		  const struct tbl_row_cells *row, const int *widths)
+{
+	return plan_emit(sink, plan, false, NULL, row, widths);
+}
+
+int print_row_cells_sink(struct tbl_sink *sink, enum format_type pFormat,
+			 const char *prefix, const struct tbl_row_cells *row,
+			 struct table_column **pColumns, bool use_color, int pwidth)
+{
+	struct tbl_plan plan;
+	int ret;
+
+	ret = plan_setup(&plan, pFormat, &prefix, pColumns, use_color, pwidth);
+	if (ret)
+		return ret;
+
+	return plan_emit(sink, &plan, true, prefix, row, NULL);
+}
+
+int tbl_plan_print_cells(struct tbl_sink *sink, const struct tbl_plan *plan,
+			 const struct tbl_arena *arena,
+			 const struct tbl_cell *pCells)
+{
+	struct tbl_row_cells row = { .arena = arena, .cells = pCells };
+
+	return tbl_plan_emit(sink, plan, &row, NULL);
+}
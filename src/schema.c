@@ -0,0 +1,227 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+#include "libtbl.h"
+#include "libtbl_helper.h"
+#include <ctype.h>
+#include <errno.h>
+#include <string.h>
+
+static bool all_space(const char *s, const char *end)
+{
+	for (; s < end; s++)
+		if (!isspace((unsigned char)*s))
+			return false;
+
+	return true;
+}
+
+const char *tbl_next_name(const char **s, const char *delim, size_t *len)
+{
+	const char *p = *s;
+	const char *start;
+
+	do {
+		p += strspn(p, delim);
+		if (!*p) {
+			*s = p;
+			return NULL;
+		}
+		start = p;
+		p += strcspn(p, delim);
+	} while (all_space(start, p));
+
+	*s = p;
+	*len = p - start;
+
+	return start;
+}
+
+bool tbl_name_eq(const char *name, const char *tok, size_t len)
+{
+	const char *end = tok + len;
+
+	for (; tok < end; tok++) {
+		if (isspace((unsigned char)*tok))
+			continue;
+		if (*name++ != *tok)
+			return false;
+	}
+
+	return *name == '\0';
+}
+
+/* FNV-1a of @len bytes of @s ignoring white space like tbl_name_eq() */
+static uint32_t name_hash(const char *s, size_t len)
+{
+	uint32_t h = 2166136261u;
+	size_t i;
+
+	for (i = 0; i < len; i++) {
+		if (isspace((unsigned char)s[i]))
+			continue;
+		h ^= (unsigned char)s[i];
+		h *= 16777619u;
+	}
+
+	return h;
+}
+
+struct tbl_schema *tbl_schema_create(struct table_column **all)
+{
+	struct tbl_schema *schema;
+	const char *name;
+	uint32_t h;
+	int i;
+
+	schema = calloc(1, sizeof(*schema));
+	if (!schema)
+		return NULL;
+
+	schema->all = all;
+	schema->count = table_column_count(all);
+	schema->words = (schema->count + 63) / 64;
+
+	/* power of two with a load factor of at most 1/2 */
+	for (schema->mask = 1; schema->mask < 2u * schema->count; schema->mask <<= 1)
+		;
+	schema->index = calloc(schema->mask, sizeof(*schema->index));
+	if (!schema->index) {
+		free(schema);
+		return NULL;
+	}
+	schema->mask--;
+
+	for (i = 0; i < schema->count; i++) {
+		name = all[i]->m_name;
+		h = name_hash(name, strlen(name)) & schema->mask;
+		while (schema->index[h]) {
+			/* the first of several columns with the same name wins */
+			if (!strcmp(all[schema->index[h] - 1]->m_name, name))
+				break;
+			h = (h + 1) & schema->mask;
+		}
+		if (!schema->index[h])
+			schema->index[h] = i + 1;
+	}
+
+	return schema;
+}
+
+void tbl_schema_destroy(struct tbl_schema *schema)
+{
+	if (!schema)
+		return;
+	free(schema->index);
+	free(schema);
+}
+
+int tbl_schema_find(const struct tbl_schema *schema, const char *name, size_t len)
+{
+	uint32_t h = name_hash(name, len) & schema->mask;
+	int i;
+
+	while ((i = schema->index[h])) {
+		if (tbl_name_eq(schema->all[i - 1]->m_name, name, len))
+			return i - 1;
+		h = (h + 1) & schema->mask;
+	}
+
+	return -ENOENT;
+}
+
+int tbl_selection_init(struct tbl_selection *sel, const struct tbl_schema *schema)
+{
+	sel->bits = calloc(schema->words ?: 1, sizeof(*sel->bits));
+	sel->order = calloc(schema->count ?: 1, sizeof(*sel->order));
+	sel->count = 0;
+	if (!sel->bits || !sel->order) {
+		tbl_selection_release(sel);
+		return -ENOMEM;
+	}
+
+	return 0;
+}
+
+void tbl_selection_release(struct tbl_selection *sel)
+{
+	free(sel->bits);
+	free(sel->order);
+	sel->bits = NULL;
+	sel->order = NULL;
+	sel->count = 0;
+}
+
+static inline bool sel_test(const struct tbl_selection *sel, int i)
+{
+	return sel->bits[i / 64] & (1ULL << (i % 64));
+}
+
+static inline void sel_set(struct tbl_selection *sel, int i)
+{
+	sel->bits[i / 64] |= 1ULL << (i % 64);
+}
+
+static inline void sel_clear(struct tbl_selection *sel, int i)
+{
+	sel->bits[i / 64] &= ~(1ULL << (i % 64));
+}
+
+int tbl_schema_select(const struct tbl_schema *schema, struct tbl_selection *sel,
+		      const char *arg, const char *delim)
+{
+	const char *names, *name;
+	size_t len;
+	int i, k;
+
+	if (*arg == '+' || *arg == '-')
+		names = arg + 1;
+	else
+		names = arg;
+
+	if (all_space(names, names + strlen(names)))
+		return -EINVAL;
+
+	/* validate first so that a bad name leaves @sel untouched */
+	for (const char *p = names; (name = tbl_next_name(&p, delim, &len)); )
+		if (tbl_schema_find(schema, name, len) < 0)
+			return -EINVAL;
+
+	if (*arg != '+' && *arg != '-') {
+		memset(sel->bits, 0, schema->words * sizeof(*sel->bits));
+		sel->count = 0;
+	}
+
+	while ((name = tbl_next_name(&names, delim, &len))) {
+		i = tbl_schema_find(schema, name, len);
+		if (*arg == '-') {
+			sel_clear(sel, i);
+		} else if (!sel_test(sel, i)) {
+			sel_set(sel, i);
+			sel->order[sel->count++] = i;
+		}
+	}
+
+	if (*arg == '-') {
+		for (i = 0, k = 0; i < sel->count; i++)
+			if (sel_test(sel, sel->order[i]))
+				sel->order[k++] = sel->order[i];
+		sel->count = k;
+	}
+
+	return 0;
+}
+
+int tbl_selection_columns(const struct tbl_schema *schema,
+			  const struct tbl_selection *sel,
+			  struct table_column **cs, int cs_len)
+{
+	int i;
+
+	if (cs_len <= sel->count)
+		return -ENOSPC;
+
+	for (i = 0; i < sel->count; i++)
+		cs[i] = schema->all[sel->order[i]];
+	cs[i] = NULL;
+
+	return sel->count;
+}
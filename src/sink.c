@@ -0,0 +1,588 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+#include "libtbl.h"
+#include "libtbl_helper.h"
+#include <errno.h>
+#include <limits.h>
+#include <pthread.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/uio.h>
+#include <time.h>
+#include <unistd.h>
+
+/*
+ * Buffers of an ASYNC sink: the queued ones from @head on are written by
+ * the writer thread, the one after them is filled by the sink.
+ */
+struct tbl_sink_async {
+	struct tbl_sink		out;		/* unbuffered FILE or fd sink */
+	char			*mem;		/* @nbufs buffers of @size bytes */
+	size_t			*lens;
+	size_t			size;
+	unsigned		nbufs;
+	unsigned		head;
+	unsigned		queued;
+	int			error;		/* first write error */
+	unsigned long		nwrites;
+	bool			stop;
+	bool			running;
+	pthread_t		thread;
+	pthread_mutex_t		lock;
+	pthread_cond_t		cond;		/* queue changed */
+};
+
+static int sink_drain(struct tbl_sink *sink, const void *data, size_t len);
+
+static void sink_init(struct tbl_sink *sink, enum tbl_sink_type type,
+		      char *buf, size_t size)
+{
+	memset(sink, 0, sizeof(*sink));
+	sink->type = type;
+	sink->fd = -1;
+	sink->buf = buf;
+	sink->size = size;
+	sink->batch = size - size / 4;
+}
+
+static int sink_init_buffered(struct tbl_sink *sink, enum tbl_sink_type type,
+			      char *buf, size_t size)
+{
+	bool own = false;
+
+	if (!buf) {
+		size = size ?: TBL_SINK_BUF_SIZE;
+		buf = malloc(size);
+		if (!buf)
+			return -ENOMEM;
+		own = true;
+	}
+
+	if (!size)
+		return -EINVAL;
+
+	sink_init(sink, type, buf, size);
+	sink->own_buf = own;
+
+	return 0;
+}
+
+int tbl_sink_init_file(struct tbl_sink *sink, FILE *file, char *buf, size_t size)
+{
+	int rc;
+
+	rc = sink_init_buffered(sink, TBL_SINK_FILE, buf, size);
+	if (rc)
+		return rc;
+	sink->file = file;
+
+	return 0;
+}
+
+int tbl_sink_init_fd(struct tbl_sink *sink, int fd, char *buf, size_t size)
+{
+	int rc;
+
+	rc = sink_init_buffered(sink, TBL_SINK_FD, buf, size);
+	if (rc)
+		return rc;
+	sink->fd = fd;
+
+	return 0;
+}
+
+int tbl_sink_init_mem(struct tbl_sink *sink, char *buf, size_t size)
+{
+	if (!buf || !size)
+		return -EINVAL;
+
+	/* keep one byte for the terminating '\0' written by tbl_sink_close() */
+	sink_init(sink, TBL_SINK_MEM, buf, size - 1);
+
+	return 0;
+}
+
+int tbl_sink_init_heap(struct tbl_sink *sink, size_t size_hint)
+{
+	char *buf;
+
+	size_hint = size_hint ?: 4096;
+	buf = malloc(size_hint + 1);
+	if (!buf)
+		return -ENOMEM;
+
+	sink_init(sink, TBL_SINK_HEAP, buf, size_hint);
+	sink->own_buf = true;
+
+	return 0;
+}
+
+static int sink_set_error(struct tbl_sink *sink, int err)
+{
+	if (!sink->error)
+		sink->error = err;
+
+	return sink->error;
+}
+
+static uint64_t async_now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static void *async_writer(void *arg)
+{
+	struct tbl_sink_async *as = arg;
+	unsigned i;
+	int rc;
+
+	pthread_mutex_lock(&as->lock);
+	for (;;) {
+		while (!as->queued && !as->stop)
+			pthread_cond_wait(&as->cond, &as->lock);
+		if (!as->queued)
+			break;
+
+		i = as->head;
+		pthread_mutex_unlock(&as->lock);
+		rc = sink_drain(&as->out, as->mem + i * as->size, as->lens[i]);
+		pthread_mutex_lock(&as->lock);
+
+		if (rc && !as->error)
+			as->error = rc;
+		as->nwrites = as->out.nwrites;
+		as->head = (i + 1) % as->nbufs;
+		as->queued--;
+		pthread_cond_broadcast(&as->cond);
+	}
+	pthread_mutex_unlock(&as->lock);
+
+	return NULL;
+}
+
+/*
+ * Queue the pending bytes of @sink and switch it to the next buffer. Waits
+ * for a free buffer, or until all buffers are written if @all is set.
+ */
+static int async_submit(struct tbl_sink *sink, bool all)
+{
+	struct tbl_sink_async *as = sink->async;
+	unsigned limit = all ? 0 : as->nbufs - 1;
+	uint64_t start;
+
+	/* the writer is gone after tbl_sink_close(), drop the bytes */
+	if (!as->running) {
+		sink->flushed += sink->len;
+		sink->len = 0;
+		return sink_set_error(sink, -EPIPE);
+	}
+
+	pthread_mutex_lock(&as->lock);
+	if (sink->len) {
+		as->lens[(as->head + as->queued) % as->nbufs] = sink->len;
+		as->queued++;
+		pthread_cond_broadcast(&as->cond);
+		sink->flushed += sink->len;
+		sink->len = 0;
+	}
+
+	if (as->queued > limit) {
+		start = async_now();
+		while (as->queued > limit)
+			pthread_cond_wait(&as->cond, &as->lock);
+		sink->wait_ns += async_now() - start;
+	}
+
+	sink->buf = as->mem + ((as->head + as->queued) % as->nbufs) * as->size;
+	sink->nwrites = as->nwrites;
+	if (as->error)
+		sink_set_error(sink, as->error);
+	pthread_mutex_unlock(&as->lock);
+
+	return sink->error;
+}
+
+/* Queue the pending bytes and @data, in pieces of at most a buffer */
+static int async_drain(struct tbl_sink *sink, const void *data, size_t len)
+{
+	size_t n;
+	int rc;
+
+	rc = async_submit(sink, false);
+	while (len) {
+		n = len < sink->size ? len : sink->size;
+		memcpy(sink->buf, data, n);
+		sink->len = n;
+		data = (const char *)data + n;
+		len -= n;
+		rc = async_submit(sink, false);
+	}
+
+	return rc;
+}
+
+static void async_stop(struct tbl_sink_async *as)
+{
+	if (!as->running)
+		return;
+
+	pthread_mutex_lock(&as->lock);
+	as->stop = true;
+	pthread_cond_broadcast(&as->cond);
+	pthread_mutex_unlock(&as->lock);
+
+	pthread_join(as->thread, NULL);
+	as->running = false;
+}
+
+static void async_free(struct tbl_sink_async *as)
+{
+	async_stop(as);
+	pthread_cond_destroy(&as->cond);
+	pthread_mutex_destroy(&as->lock);
+	free(as->lens);
+	free(as->mem);
+	free(as);
+}
+
+int tbl_sink_init_async(struct tbl_sink *sink, FILE *file, int fd, size_t size,
+			unsigned nbufs)
+{
+	struct tbl_sink_async *as;
+	int rc;
+
+	size = size ?: TBL_SINK_BUF_SIZE;
+	nbufs = nbufs < 2 ? 2 : nbufs;
+	if (size > SIZE_MAX / nbufs)
+		return -EINVAL;
+
+	as = calloc(1, sizeof(*as));
+	if (!as)
+		return -ENOMEM;
+
+	pthread_mutex_init(&as->lock, NULL);
+	pthread_cond_init(&as->cond, NULL);
+	as->size = size;
+	as->nbufs = nbufs;
+	as->mem = malloc(size * nbufs);
+	as->lens = calloc(nbufs, sizeof(*as->lens));
+	if (!as->mem || !as->lens) {
+		async_free(as);
+		return -ENOMEM;
+	}
+
+	sink_init(&as->out, file ? TBL_SINK_FILE : TBL_SINK_FD, NULL, 0);
+	as->out.file = file;
+	as->out.fd = fd;
+
+	rc = pthread_create(&as->thread, NULL, async_writer, as);
+	if (rc) {
+		async_free(as);
+		return -rc;
+	}
+	as->running = true;
+
+	sink_init(sink, TBL_SINK_ASYNC, as->mem, size);
+	sink->file = file;
+	sink->fd = fd;
+	sink->async = as;
+
+	return 0;
+}
+
+/*
+ * Write @cnt iovecs to the file descriptor of @sink, restarting on short
+ * writes and EINTR.
+ */
+static int sink_writev_fd(struct tbl_sink *sink, struct iovec *iov, int cnt)
+{
+	ssize_t ret;
+
+	while (cnt) {
+		ret = writev(sink->fd, iov, cnt);
+		sink->nwrites++;
+		if (ret < 0) {
+			if (errno == EINTR)
+				continue;
+			return sink_set_error(sink, -errno);
+		}
+
+		while (cnt && (size_t)ret >= iov->iov_len) {
+			ret -= iov->iov_len;
+			iov++;
+			cnt--;
+		}
+		if (cnt) {
+			iov->iov_base = (char *)iov->iov_base + ret;
+			iov->iov_len -= ret;
+		}
+	}
+
+	return 0;
+}
+
+static int sink_write_file(struct tbl_sink *sink, const void *data, size_t len)
+{
+	if (!len)
+		return 0;
+
+	sink->nwrites++;
+	errno = 0;
+	if (fwrite(data, 1, len, sink->file) != len)
+		return sink_set_error(sink, -(errno ?: EIO));
+
+	return 0;
+}
+
+/*
+ * Hand the pending bytes of @sink plus the optional @data of @len bytes to
+ * the underlying FILE or file descriptor with as few calls as possible.
+ */
+static int sink_drain(struct tbl_sink *sink, const void *data, size_t len)
+{
+	struct iovec iov[2];
+	int cnt = 0;
+	int rc = 0;
+
+	if (sink->error) {
+		sink->flushed += sink->len + len;
+		sink->len = 0;
+		return sink->error;
+	}
+
+	switch (sink->type) {
+	case TBL_SINK_ASYNC:
+		return async_drain(sink, data, len);
+	case TBL_SINK_FILE:
+		rc = sink_write_file(sink, sink->buf, sink->len);
+		if (!rc)
+			rc = sink_write_file(sink, data, len);
+		break;
+	case TBL_SINK_FD:
+		if (sink->len) {
+			iov[cnt].iov_base = sink->buf;
+			iov[cnt++].iov_len = sink->len;
+		}
+		if (len) {
+			iov[cnt].iov_base = (void *)data;
+			iov[cnt++].iov_len = len;
+		}
+		rc = sink_writev_fd(sink, iov, cnt);
+		break;
+	default:
+		break;
+	}
+
+	sink->flushed += sink->len + len;
+	sink->len = 0;
+
+	return rc;
+}
+
+static int sink_grow(struct tbl_sink *sink, size_t need)
+{
+	size_t size = sink->size;
+	char *buf;
+
+	while (size - sink->len < need) {
+		if (size > SIZE_MAX / 2)
+			return sink_set_error(sink, -ENOMEM);
+		size *= 2;
+	}
+
+	buf = realloc(sink->buf, size + 1);
+	if (!buf)
+		return sink_set_error(sink, -ENOMEM);
+
+	sink->buf = buf;
+	sink->size = size;
+
+	return 0;
+}
+
+int tbl_sink_write_slow(struct tbl_sink *sink, const void *data, size_t len)
+{
+	size_t room;
+
+	switch (sink->type) {
+	case TBL_SINK_HEAP:
+		if (sink_grow(sink, len)) {
+			sink->flushed += len;
+			return sink->error;
+		}
+		break;
+	case TBL_SINK_MEM:
+		room = sink->size - sink->len;
+		if (len > room) {
+			memcpy(sink->buf + sink->len, data, room);
+			sink->len += room;
+			sink->flushed += len - room;
+			return sink_set_error(sink, -ENOSPC);
+		}
+		break;
+	default:
+		/* chunks larger than the buffer go out together with it */
+		if (len >= sink->size)
+			return sink_drain(sink, data, len);
+		sink_drain(sink, NULL, 0);
+		break;
+	}
+
+	memcpy(sink->buf + sink->len, data, len);
+	sink->len += len;
+
+	return sink->error;
+}
+
+char *tbl_sink_reserve(struct tbl_sink *sink, size_t len)
+{
+	if (sink->size - sink->len >= len)
+		return sink->buf + sink->len;
+
+	switch (sink->type) {
+	case TBL_SINK_HEAP:
+		if (sink_grow(sink, len))
+			return NULL;
+		break;
+	case TBL_SINK_MEM:
+		return NULL;
+	default:
+		sink_drain(sink, NULL, 0);
+		if (sink->size < len)
+			return NULL;
+		break;
+	}
+
+	return sink->buf + sink->len;
+}
+
+int tbl_sink_fill(struct tbl_sink *sink, char c, size_t count)
+{
+	size_t n;
+
+	while (count) {
+		n = sink->size - sink->len;
+		if (!n) {
+			if (!tbl_sink_reserve(sink, 1)) {
+				sink->flushed += count;
+				return sink_set_error(sink, -ENOSPC);
+			}
+			n = sink->size - sink->len;
+		}
+		n = n < count ? n : count;
+		memset(sink->buf + sink->len, c, n);
+		sink->len += n;
+		count -= n;
+	}
+
+	return sink->error;
+}
+
+int tbl_sink_vprintf(struct tbl_sink *sink, const char *format, va_list args)
+{
+	va_list cp;
+	size_t room;
+	char *tmp;
+	int len;
+
+	room = sink->size - sink->len;
+	va_copy(cp, args);
+	len = vsnprintf(sink->buf + sink->len, room, format, cp);
+	va_end(cp);
+	if (len < 0)
+		return sink_set_error(sink, -EINVAL);
+
+	/* vsnprintf() wants room for the '\0' as well */
+	if ((size_t)len < room) {
+		sink->len += len;
+		return len;
+	}
+
+	tmp = tbl_sink_reserve(sink, len + 1);
+	if (tmp) {
+		vsnprintf(tmp, len + 1, format, args);
+		sink->len += len;
+		return len;
+	}
+
+	tmp = malloc(len + 1);
+	if (!tmp)
+		return sink_set_error(sink, -ENOMEM);
+	vsnprintf(tmp, len + 1, format, args);
+	tbl_sink_write_slow(sink, tmp, len);
+	free(tmp);
+
+	return len;
+}
+
+int tbl_sink_printf(struct tbl_sink *sink, const char *format, ...)
+{
+	va_list args;
+	int ret;
+
+	va_start(args, format);
+	ret = tbl_sink_vprintf(sink, format, args);
+	va_end(args);
+
+	return ret;
+}
+
+int tbl_sink_row_end(struct tbl_sink *sink)
+{
+	if (sink->len < sink->batch)
+		return sink->error;
+
+	if (sink->type == TBL_SINK_FILE || sink->type == TBL_SINK_FD ||
+	    sink->type == TBL_SINK_ASYNC)
+		return sink_drain(sink, NULL, 0);
+
+	return sink->error;
+}
+
+int tbl_sink_flush(struct tbl_sink *sink)
+{
+	if (sink->type == TBL_SINK_FILE || sink->type == TBL_SINK_FD)
+		return sink_drain(sink, NULL, 0);
+
+	/* wait until everything queued is written */
+	if (sink->type == TBL_SINK_ASYNC)
+		return async_submit(sink, true);
+
+	return sink->error;
+}
+
+int tbl_sink_close(struct tbl_sink *sink)
+{
+	int rc = tbl_sink_flush(sink);
+
+	if (sink->type == TBL_SINK_MEM || sink->type == TBL_SINK_HEAP)
+		sink->buf[sink->len] = '\0';
+	if (sink->type == TBL_SINK_ASYNC) {
+		async_stop(sink->async);
+		sink_set_error(sink, -EPIPE);
+	}
+
+	return rc;
+}
+
+void tbl_sink_release(struct tbl_sink *sink)
+{
+	if (sink->async) {
+		async_free(sink->async);
+		sink->async = NULL;
+	}
+	if (sink->own_buf)
+		free(sink->buf);
+	sink->buf = NULL;
+	sink->len = 0;
+	sink->size = 0;
+	sink->own_buf = false;
+}
+
+size_t tbl_sink_bytes(const struct tbl_sink *sink)
+{
+	return sink->flushed + sink->len;
+}
@@ -0,0 +1,187 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+#define _GNU_SOURCE	/* qsort_r() */
+#include "libtbl.h"
+#include "libtbl_helper.h"
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+
+enum sort_kind {
+	SORT_SIGNED,
+	SORT_UNSIGNED,
+	SORT_STRING,
+};
+
+/* The keys resolved once per call: where the value is and how to compare */
+struct sort_ctx {
+	int nkeys;
+	struct {
+		unsigned long	off;
+		enum field_type	type;
+		enum sort_kind	kind;
+		int		dir;
+	} key[TBL_SORT_MAX_KEYS];
+};
+
+static int sort_prepare(struct sort_ctx *ctx, const struct tbl_sort_key *keys,
+			int nkeys)
+{
+	struct table_column *column;
+	int i;
+
+	if (nkeys <= 0 || nkeys > TBL_SORT_MAX_KEYS)
+		return -EINVAL;
+
+	for (i = 0; i < nkeys; i++) {
+		column = keys[i].column;
+		if (table_type_is_int(column->m_type))
+			ctx->key[i].kind = table_type_is_signed(column->m_type) ?
+					   SORT_SIGNED : SORT_UNSIGNED;
+		else if (column->m_type == FIELD_STR && !column->m_tostr)
+			ctx->key[i].kind = SORT_STRING;
+		else
+			return -EINVAL;
+
+		ctx->key[i].off = column->s_off + column->m_offset;
+		ctx->key[i].type = column->m_type;
+		ctx->key[i].dir = keys[i].desc ? -1 : 1;
+	}
+	ctx->nkeys = nkeys;
+
+	return 0;
+}
+
+static int sort_cmp(const void *a, const void *b, const struct sort_ctx *ctx)
+{
+	const char *x, *y;
+	uint64_t u, w;
+	int i, d;
+
+	for (i = 0; i < ctx->nkeys; i++) {
+		x = (const char *)a + ctx->key[i].off;
+		y = (const char *)b + ctx->key[i].off;
+
+		switch (ctx->key[i].kind) {
+		case SORT_STRING:
+			d = strcmp(x, y);
+			break;
+		case SORT_SIGNED:
+			u = table_int_raw(ctx->key[i].type, x);
+			w = table_int_raw(ctx->key[i].type, y);
+			d = ((int64_t)u > (int64_t)w) - ((int64_t)u < (int64_t)w);
+			break;
+		default:
+			u = table_int_raw(ctx->key[i].type, x);
+			w = table_int_raw(ctx->key[i].type, y);
+			d = (u > w) - (u < w);
+			break;
+		}
+
+		if (d)
+			return d * ctx->key[i].dir;
+	}
+
+	return 0;
+}
+
+static int sort_cmp_rows(const void *a, const void *b, void *ctx)
+{
+	return sort_cmp(*(void * const *)a, *(void * const *)b, ctx);
+}
+
+int tbl_sort_parse(const char *spec, const char *delim, struct table_column **all,
+		   struct tbl_sort_key *keys, int max)
+{
+	const char *name;
+	size_t len;
+	bool desc;
+	int n = 0, i;
+
+	while ((name = tbl_next_name(&spec, delim, &len))) {
+		while (len && isspace((unsigned char)*name)) {
+			name++;
+			len--;
+		}
+		desc = *name == '-';
+		if (*name == '-' || *name == '+') {
+			name++;
+			len--;
+		}
+
+		for (i = 0; all[i]; i++)
+			if (tbl_name_eq(all[i]->m_name, name, len))
+				break;
+		if (!all[i] || n == max)
+			return -EINVAL;
+
+		keys[n].column = all[i];
+		keys[n].desc = desc;
+		n++;
+	}
+
+	return n ?: -EINVAL;
+}
+
+int tbl_sort_rows(void **v, const struct tbl_sort_key *keys, int nkeys)
+{
+	struct sort_ctx ctx;
+	size_t n;
+	int ret;
+
+	ret = sort_prepare(&ctx, keys, nkeys);
+	if (ret)
+		return ret;
+
+	for (n = 0; v[n]; n++)
+		;
+	qsort_r(v, n, sizeof(*v), sort_cmp_rows, &ctx);
+
+	return 0;
+}
+
+/* Restore the heap below @i of @n rows, the row sorting last is at the root */
+static void heap_down(void **heap, long n, long i, const struct sort_ctx *ctx)
+{
+	void *row = heap[i];
+	long child;
+
+	while ((child = 2 * i + 1) < n) {
+		if (child + 1 < n && sort_cmp(heap[child + 1], heap[child], ctx) > 0)
+			child++;
+		if (sort_cmp(heap[child], row, ctx) <= 0)
+			break;
+		heap[i] = heap[child];
+		i = child;
+	}
+	heap[i] = row;
+}
+
+long tbl_top_rows(void **v, const struct tbl_sort_key *keys, int nkeys,
+		  void **top, long k)
+{
+	struct sort_ctx ctx;
+	long n, i;
+	int ret;
+
+	ret = sort_prepare(&ctx, keys, nkeys);
+	if (ret)
+		return ret;
+
+	for (n = 0; n < k && v[n]; n++)
+		top[n] = v[n];
+	for (i = n / 2 - 1; i >= 0; i--)
+		heap_down(top, n, i, &ctx);
+
+	/* a row only enters if it sorts before the last of the current top */
+	for (i = n; n && v[i]; i++) {
+		if (sort_cmp(v[i], top[0], &ctx) >= 0)
+			continue;
+		top[0] = v[i];
+		heap_down(top, n, 0, &ctx);
+	}
+
+	qsort_r(top, n, sizeof(*top), sort_cmp_rows, &ctx);
+	top[n] = NULL;
+
+	return n;
+}
@@ -0,0 +1,146 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+#include "libtbl.h"
+#include "libtbl_helper.h"
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+
+__thread struct tbl_stats *tbl_stats_cur;
+
+int tbl_stats_attach(struct tbl_stats *stats)
+{
+#ifdef TBL_NO_STATS
+	if (stats)
+		return -EOPNOTSUPP;
+#endif
+	tbl_stats_cur = stats;
+
+	return 0;
+}
+
+int tbl_stats_init(struct tbl_stats *stats, int count)
+{
+	memset(stats, 0, sizeof(*stats));
+	stats->count = count;
+	stats->columns = calloc(count ?: 1, sizeof(*stats->columns));
+
+	return stats->columns ? 0 : -ENOMEM;
+}
+
+void tbl_stats_reset(struct tbl_stats *stats)
+{
+	stats->rows = 0;
+	stats->emitted = 0;
+	stats->stringify_cycles = 0;
+	stats->emit_cycles = 0;
+	memset(stats->columns, 0, stats->count * sizeof(*stats->columns));
+}
+
+void tbl_stats_release(struct tbl_stats *stats)
+{
+	free(stats->columns);
+	stats->columns = NULL;
+	stats->count = 0;
+}
+
+struct stats_row {
+	char		name[32];
+	uint64_t	calls;
+	uint64_t	cycles;
+	uint64_t	per_call;
+	uint64_t	bytes;
+	uint64_t	escapes;
+	uint64_t	truncated;
+};
+
+#define CLM_STATS(name, header, type, align) \
+	static CLM(stats_row, name, header, type, NULL, align, CBLD, CNRM, "", \
+		   sizeof(header) - 1, 0)
+
+CLM_STATS(name, "Column", FIELD_STR, 'l');
+CLM_STATS(calls, "Calls", FIELD_U64, 'r');
+CLM_STATS(cycles, "Cycles", FIELD_U64, 'r');
+CLM_STATS(per_call, "Per call", FIELD_U64, 'r');
+CLM_STATS(bytes, "Bytes", FIELD_U64, 'r');
+CLM_STATS(escapes, "Escapes", FIELD_U64, 'r');
+CLM_STATS(truncated, "Truncated", FIELD_U64, 'r');
+
+int tbl_stats_print_sink(struct tbl_sink *sink, enum format_type format,
+			 const struct tbl_stats *stats,
+			 struct table_column **pColumns)
+{
+	struct table_column clm[] = {
+		clm_stats_row_name, clm_stats_row_calls, clm_stats_row_cycles,
+		clm_stats_row_per_call, clm_stats_row_bytes, clm_stats_row_escapes,
+		clm_stats_row_truncated,
+	};
+	struct table_column *cs[] = {
+		&clm[0], &clm[1], &clm[2], &clm[3], &clm[4], &clm[5], &clm[6], NULL
+	};
+	struct tbl_stats *attached = tbl_stats_cur;
+	const struct tbl_column_stats *c;
+	struct stats_row *rows;
+	int i, n, ret;
+	void **v;
+
+	n = table_column_count(pColumns);
+	if (n > stats->count)
+		n = stats->count;
+
+	/* a row per column and phase, NULL terminated */
+	rows = calloc(n + 2, sizeof(*rows));
+	v = malloc((n + 3) * sizeof(*v));
+	if (!rows || !v) {
+		ret = -ENOMEM;
+		goto out;
+	}
+
+	for (i = 0; i < n; i++) {
+		c = &stats->columns[i];
+		snprintf(rows[i].name, sizeof(rows[i].name), "%s", pColumns[i]->m_name);
+		rows[i].calls = c->calls;
+		rows[i].cycles = c->cycles;
+		rows[i].per_call = c->calls ? c->cycles / c->calls : 0;
+		rows[i].bytes = c->bytes;
+		rows[i].escapes = c->escapes;
+		rows[i].truncated = c->truncated;
+	}
+
+	/* the phases, per row */
+	snprintf(rows[n].name, sizeof(rows[n].name), "[stringify]");
+	rows[n].calls = stats->rows;
+	rows[n].cycles = stats->stringify_cycles;
+	rows[n].per_call = stats->rows ? stats->stringify_cycles / stats->rows : 0;
+	n++;
+	snprintf(rows[n].name, sizeof(rows[n].name), "[emit]");
+	rows[n].calls = stats->emitted;
+	rows[n].cycles = stats->emit_cycles;
+	rows[n].per_call = stats->emitted ? stats->emit_cycles / stats->emitted : 0;
+	n++;
+
+	for (i = 0; i < n; i++)
+		v[i] = &rows[i];
+	v[n] = NULL;
+
+	/* not a render to account for */
+	tbl_stats_cur = NULL;
+
+	/* measure first so that the header is as wide as the rows */
+	if (format == FORMAT_TERM) {
+		struct table_field fields[sizeof(clm) / sizeof(clm[0])];
+
+		for (i = 0; i < n; i++)
+			table_row_stringify(v[i], fields, cs, 0, 0);
+		print_table_header_term_sink(sink, "", cs, false, 'a');
+	} else if (format == FORMAT_CSV) {
+		print_table_header_csv_sink(sink, cs);
+	}
+
+	ret = print_table_all_rows_sink(sink, v, format, "", cs, false, 0, 0);
+	tbl_stats_cur = attached;
+out:
+	free(rows);
+	free(v);
+
+	return ret;
+}
@@ -0,0 +1,249 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+#include "libtbl.h"
+#include "libtbl_helper.h"
+#include <errno.h>
+#include <string.h>
+
+/* Widest text of the built-in numeric types, used with @type_widths */
+static int type_max_width(struct table_column *column)
+{
+	if (column->m_tostr)
+		return 0;
+
+	switch (column->m_type) {
+	case FIELD_I8:
+		return sizeof("-128") - 1;
+	case FIELD_U8:
+		return sizeof("255") - 1;
+	case FIELD_I16:
+		return sizeof("-32768") - 1;
+	case FIELD_U16:
+		return sizeof("65535") - 1;
+	case FIELD_NUM:
+	case FIELD_VAL:
+	case FIELD_I32:
+		return sizeof("-2147483648") - 1;
+	case FIELD_U32:
+		return sizeof("4294967295") - 1;
+	case FIELD_I64:
+		return sizeof("-9223372036854775808") - 1;
+	case FIELD_LLU:
+	case FIELD_U64:
+	case FIELD_BYTES:
+	case FIELD_BYTES_RATE:
+	case FIELD_NSEC:
+	case FIELD_SI:
+		return sizeof("18446744073709551615") - 1;
+	default:
+		return 0;
+	}
+}
+
+int tbl_stream_init(struct tbl_stream *st, struct tbl_sink *sink,
+		    const char *prefix, struct table_column **pColumns,
+		    bool use_color, int humanize, size_t pre_len,
+		    const struct tbl_stream_opts *opts)
+{
+	struct table_column *column;
+	int i, w;
+
+	memset(st, 0, sizeof(*st));
+	st->sink = sink;
+	st->columns = pColumns;
+	st->count = table_column_count(pColumns);
+	st->prefix = prefix;
+	st->pre_len = pre_len;
+	st->use_color = use_color;
+	st->humanize = humanize;
+
+	if (opts) {
+		st->opts = *opts;
+	} else {
+		st->opts.lookahead = TBL_STREAM_LOOKAHEAD;
+		st->opts.align = 'a';
+	}
+	if (!st->opts.marker)
+		st->opts.marker = "~";
+	if (st->opts.block <= 0)
+		st->opts.block = TBL_STREAM_BLOCK;
+	if (st->opts.lookahead < 0)
+		return -EINVAL;
+
+	st->widths = calloc(st->count ?: 1, sizeof(*st->widths));
+	st->cells = calloc((st->opts.lookahead ?: 1) * (st->count ?: 1), sizeof(*st->cells));
+	if (!st->widths || !st->cells || tbl_hot_compile(&st->hot, pColumns) ||
+	    tbl_plan_compile(&st->plan, FORMAT_TERM, prefix, pColumns, use_color,
+			     pre_len)) {
+		tbl_stream_release(st);
+		return -ENOMEM;
+	}
+
+	for (i = 0; (column = pColumns[i]); i++) {
+		w = column->m_width > column->hdr_width ? column->m_width : column->hdr_width;
+		if (st->opts.type_widths && type_max_width(column) > w)
+			w = type_max_width(column);
+		if (!i)
+			w += pre_len;
+		st->widths[i] = w;
+	}
+
+	return 0;
+}
+
+/* Grow the widths to fit the cells of one row, returns true if any grew */
+static bool stream_measure(struct tbl_stream *st, const struct tbl_cell *cells)
+{
+	bool grew = false;
+	int i, len;
+
+	for (i = 0; i < st->count; i++) {
+		len = tbl_str_width(st->arena.base + cells[i].off, cells[i].len) +
+		      (i ? 0 : st->pre_len);
+		if (st->widths[i] < len) {
+			st->widths[i] = len;
+			grew = true;
+		}
+	}
+
+	return grew;
+}
+
+/*
+ * Cut the cells of one row which do not fit into their column, never in
+ * the middle of a character.
+ */
+static void stream_truncate(struct tbl_stream *st, struct tbl_cell *cells)
+{
+	size_t mlen = strlen(st->opts.marker);
+	size_t mwidth = tbl_str_width(st->opts.marker, mlen);
+	size_t width, keep;
+	char *str;
+	int i;
+
+	for (i = 0; i < st->count; i++) {
+		width = st->widths[i] - (i ? 0 : st->pre_len);
+		str = st->arena.base + cells[i].off;
+		if (tbl_str_width(str, cells[i].len) <= width)
+			continue;
+
+		st->truncated++;
+		if (width > mwidth) {
+			keep = tbl_str_truncate(str, cells[i].len, width - mwidth, NULL);
+			if (keep + mlen <= cells[i].len) {
+				memcpy(str + keep, st->opts.marker, mlen);
+				cells[i].len = keep + mlen;
+				continue;
+			}
+		}
+		cells[i].len = tbl_str_truncate(str, cells[i].len, width, NULL);
+	}
+}
+
+static int stream_header(struct tbl_stream *st)
+{
+	st->since_header = 0;
+	st->dirty = false;
+
+	return print_header_term_widths(st->sink, st->prefix, st->columns, st->widths,
+					st->use_color, st->opts.align ?: 'a');
+}
+
+static int stream_emit(struct tbl_stream *st, struct tbl_cell *cells)
+{
+	struct tbl_row_cells row = { .arena = &st->arena, .cells = cells };
+
+	if (st->dirty && st->since_header >= (unsigned long)st->opts.block)
+		stream_header(st);
+
+	tbl_plan_emit(st->sink, &st->plan, &row, st->widths);
+	st->since_header++;
+	st->rows++;
+
+	return tbl_sink_row_end(st->sink);
+}
+
+/* Measure the look-ahead rows, print the header and the buffered rows */
+static int stream_start(struct tbl_stream *st)
+{
+	int i;
+
+	for (i = 0; i < st->pending; i++)
+		stream_measure(st, st->cells + i * st->count);
+
+	stream_header(st);
+	for (i = 0; i < st->pending; i++)
+		stream_emit(st, st->cells + i * st->count);
+
+	st->pending = 0;
+	st->started = true;
+	tbl_arena_reset(&st->arena);
+
+	/* get the first screen out without waiting for a full batch */
+	return tbl_sink_flush(st->sink);
+}
+
+int tbl_stream_push(struct tbl_stream *st, void *row)
+{
+	struct tbl_cell *cells;
+	int ret;
+
+	if (!st->started && st->pending < st->opts.lookahead) {
+		cells = st->cells + st->pending * st->count;
+		ret = arena_row_stringify(row, &st->arena, cells, &st->hot,
+					  st->humanize);
+		if (ret)
+			return ret;
+		if (++st->pending == st->opts.lookahead)
+			return stream_start(st);
+		return 0;
+	}
+
+	if (!st->started) {
+		ret = stream_start(st);
+		if (ret)
+			return ret;
+	}
+
+	tbl_arena_reset(&st->arena);
+	ret = arena_row_stringify(row, &st->arena, st->cells, &st->hot, st->humanize);
+	if (ret)
+		return ret;
+
+	switch (st->opts.overflow) {
+	case TBL_OVERFLOW_TRUNCATE:
+		stream_truncate(st, st->cells);
+		break;
+	case TBL_OVERFLOW_REFLOW:
+		if (stream_measure(st, st->cells))
+			st->dirty = true;
+		break;
+	default:
+		stream_measure(st, st->cells);
+		break;
+	}
+
+	return stream_emit(st, st->cells);
+}
+
+int tbl_stream_finish(struct tbl_stream *st)
+{
+	int ret = 0;
+
+	if (!st->started)
+		ret = stream_start(st);
+	ret = st->sink->error ?: ret;
+	tbl_stream_release(st);
+
+	return ret;
+}
+
+void tbl_stream_release(struct tbl_stream *st)
+{
+	free(st->widths);
+	free(st->cells);
+	tbl_hot_release(&st->hot);
+	tbl_plan_release(&st->plan);
+	tbl_arena_release(&st->arena);
+	st->widths = NULL;
+	st->cells = NULL;
+}
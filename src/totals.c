@@ -0,0 +1,417 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+#include "libtbl.h"
+#include "libtbl_helper.h"
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* by bit number of the TBL_AGG_* flags */
+static const char * const agg_names[] = {
+	"count", "sum", "min", "max", "avg"
+};
+
+#define AGG_COUNT (sizeof(agg_names) / sizeof(agg_names[0]))
+
+/* room for a 64 bit integer or an average with two decimals */
+#define TOTAL_BUF_SIZE 32
+
+int tbl_totals_init(struct tbl_totals *totals, int count)
+{
+	totals->rows = 0;
+	totals->count = count;
+	totals->columns = calloc(count ?: 1, sizeof(*totals->columns));
+
+	return totals->columns ? 0 : -ENOMEM;
+}
+
+void tbl_totals_reset(struct tbl_totals *totals)
+{
+	totals->rows = 0;
+	memset(totals->columns, 0, totals->count * sizeof(*totals->columns));
+}
+
+void tbl_totals_release(struct tbl_totals *totals)
+{
+	free(totals->columns);
+	totals->columns = NULL;
+	totals->count = 0;
+}
+
+static inline bool total_less(bool is_signed, uint64_t a, uint64_t b)
+{
+	return is_signed ? (int64_t)a < (int64_t)b : a < b;
+}
+
+void tbl_totals_add(struct tbl_totals *totals, struct table_column **pColumns,
+		    const void *row)
+{
+	struct table_column *column;
+	struct tbl_total *t;
+	bool is_signed;
+	uint64_t v;
+	int i;
+
+	for (i = 0; i < totals->count && (column = pColumns[i]); i++) {
+		if (!table_type_is_number(column->m_type))
+			continue;
+
+		v = table_int_raw(column->m_type,
+				  (const char *)row + column->s_off + column->m_offset);
+		t = &totals->columns[i];
+		if (!totals->rows) {
+			t->sum = t->min = t->max = v;
+			continue;
+		}
+
+		is_signed = table_type_is_signed(column->m_type);
+		t->sum += v;
+		if (total_less(is_signed, v, t->min))
+			t->min = v;
+		if (total_less(is_signed, t->max, v))
+			t->max = v;
+	}
+	totals->rows++;
+}
+
+void tbl_totals_merge(struct tbl_totals *totals, const struct tbl_totals *from,
+		      struct table_column **pColumns)
+{
+	const struct tbl_total *f;
+	struct tbl_total *t;
+	int i, count = totals->count < from->count ? totals->count : from->count;
+	bool is_signed;
+
+	if (!from->rows)
+		return;
+	if (!totals->rows) {
+		memcpy(totals->columns, from->columns,
+		       count * sizeof(*totals->columns));
+		totals->rows = from->rows;
+		return;
+	}
+
+	for (i = 0; i < count && pColumns[i]; i++) {
+		if (!table_type_is_number(pColumns[i]->m_type))
+			continue;
+
+		is_signed = table_type_is_signed(pColumns[i]->m_type);
+		t = &totals->columns[i];
+		f = &from->columns[i];
+		t->sum += f->sum;
+		if (total_less(is_signed, f->min, t->min))
+			t->min = f->min;
+		if (total_less(is_signed, t->max, f->max))
+			t->max = f->max;
+	}
+	totals->rows += from->rows;
+}
+
+/*
+ * @sum / @rows with two decimals rounded half up, in 64 bit integers so
+ * that sums beyond 2^53 keep all their digits.
+ */
+static int total_avg(char *buf, uint64_t sum, bool is_signed, uint64_t rows)
+{
+	bool neg = is_signed && (int64_t)sum < 0;
+	uint64_t mag = neg ? -sum : sum;
+	uint64_t q = mag / rows, r = mag % rows, frac = 0;
+	int len = 0, d;
+
+	/* r < rows, so r * 10 only overflows past 1.8e18 rows */
+	for (d = 0; d < 2; d++) {
+		r *= 10;
+		frac = frac * 10 + r / rows;
+		r %= rows;
+	}
+	if (r >= rows - r && ++frac == 100) {
+		frac = 0;
+		q++;
+	}
+
+	if (neg)
+		buf[len++] = '-';
+	len += tbl_u64toa(buf + len, q);
+	buf[len++] = '.';
+	buf[len++] = '0' + frac / 10;
+	buf[len++] = '0' + frac % 10;
+
+	return len;
+}
+
+/* Text of aggregate @agg (bit number) of column @i, empty if there are no rows */
+static int total_format(char *buf, const struct tbl_totals *totals,
+			struct table_column *column, int i, int agg)
+{
+	const struct tbl_total *t = &totals->columns[i];
+	bool is_signed = table_type_is_signed(column->m_type);
+	uint64_t v;
+
+	if (agg == 0)
+		return tbl_u64toa(buf, totals->rows);
+	if (!totals->rows)
+		return 0;
+
+	switch (1 << agg) {
+	case TBL_AGG_SUM:
+		v = t->sum;
+		break;
+	case TBL_AGG_MIN:
+		v = t->min;
+		break;
+	case TBL_AGG_MAX:
+		v = t->max;
+		break;
+	default:
+		return total_avg(buf, t->sum, is_signed, totals->rows);
+	}
+
+	return is_signed ? tbl_i64toa(buf, v) : tbl_u64toa(buf, v);
+}
+
+/* Index of the column labelling the footer rows, the first non numeric one */
+static int totals_label(const struct tbl_layout *layout)
+{
+	int i;
+
+	for (i = 0; i < layout->count; i++)
+		if (!table_type_is_number(layout->columns[i]->m_type))
+			return i;
+
+	return -1;
+}
+
+/* Text of column @i in the footer row of aggregate @agg */
+static int totals_cell(char *buf, const struct tbl_layout *layout, int i,
+		       int agg, int label)
+{
+	struct table_column *column = layout->columns[i];
+	int len = 0;
+
+	if (table_type_is_number(column->m_type)) {
+		len = total_format(buf, layout->totals, column, i, agg);
+	} else if (i == label) {
+		len = strlen(agg_names[agg]);
+		memcpy(buf, agg_names[agg], len);
+	}
+	buf[len] = '\0';
+
+	return len;
+}
+
+int tbl_layout_fit_totals(struct tbl_layout *layout, size_t pre_len, unsigned aggs)
+{
+	int i, len, label = totals_label(layout);
+	char buf[TOTAL_BUF_SIZE];
+	unsigned agg;
+
+	if (!layout->totals || tbl_totals_short(layout))
+		return -EINVAL;
+
+	for (agg = 0; agg < AGG_COUNT; agg++) {
+		if (!(aggs & (1 << agg)))
+			continue;
+
+		for (i = 0; i < layout->count; i++) {
+			len = totals_cell(buf, layout, i, agg, label) + (i ? 0 : pre_len);
+			if (layout->widths[i] < len)
+				layout->widths[i] = len;
+		}
+	}
+
+	return 0;
+}
+
+/* A row of cells per aggregate (after a separator line for TERM) */
+static int totals_rows(const struct tbl_layout *layout, struct tbl_sink *sink,
+		       enum format_type format, const char *prefix,
+		       bool use_color, size_t pre_len, unsigned aggs)
+{
+	int i, len, ret, label = totals_label(layout);
+	struct tbl_arena arena = {};
+	struct tbl_cell *cells;
+	struct tbl_plan plan;
+	unsigned agg;
+	char *str;
+
+	cells = malloc((layout->count ?: 1) * sizeof(*cells));
+	if (!cells)
+		return -ENOMEM;
+
+	ret = tbl_plan_compile(&plan, format, prefix, layout->columns, use_color,
+			       pre_len);
+	if (ret) {
+		free(cells);
+		return ret;
+	}
+
+	if (format == FORMAT_TERM) {
+		for (i = 0; i < layout->count; i++) {
+			len = 0;
+			if (table_type_is_number(layout->columns[i]->m_type))
+				len = layout->widths[i] - (i ? 0 : pre_len);
+			str = tbl_arena_reserve(&arena, len + 1);
+			if (!str) {
+				ret = -ENOMEM;
+				goto out;
+			}
+			memset(str, '-', len);
+			cells[i] = (struct tbl_cell){ arena.used, len, CNRM };
+			arena.used += len + 1;
+		}
+		tbl_layout_print_cells_sink(layout, sink, &plan, &arena, cells);
+		tbl_sink_row_end(sink);
+	}
+
+	for (agg = 0; agg < AGG_COUNT; agg++) {
+		if (!(aggs & (1 << agg)))
+			continue;
+
+		tbl_arena_reset(&arena);
+		for (i = 0; i < layout->count; i++) {
+			str = tbl_arena_reserve(&arena, TOTAL_BUF_SIZE);
+			if (!str) {
+				ret = -ENOMEM;
+				goto out;
+			}
+
+			len = totals_cell(str, layout, i, agg, label);
+			cells[i] = (struct tbl_cell){ arena.used, len,
+						      layout->columns[i]->hdr_color };
+			arena.used += len + 1;
+		}
+		tbl_layout_print_cells_sink(layout, sink, &plan, &arena, cells);
+		tbl_sink_row_end(sink);
+	}
+	ret = sink->error;
+out:
+	tbl_arena_release(&arena);
+	tbl_plan_release(&plan);
+	free(cells);
+
+	return ret;
+}
+
+/*
+ * A {"summary": ...} object for JSON (@compact false, indented by @prefix
+ * like the rows) or JSONL (@compact true, on one line).
+ */
+static void totals_json(const struct tbl_layout *layout, struct tbl_sink *sink,
+			const char *prefix, bool compact, unsigned aggs)
+{
+	const char *nl = compact ? "" : "\n", *sp = compact ? "" : " ";
+	const char *in = compact ? "" : "\t";
+	struct table_column *column;
+	char buf[TOTAL_BUF_SIZE];
+	bool first = true, col_first;
+	unsigned agg;
+	int i, len;
+
+	prefix = compact || !prefix ? "" : prefix;
+	tbl_sink_printf(sink, "%s{%s%s%s\"summary\":%s{", prefix, nl, prefix, in, sp);
+
+	for (agg = 0; agg < AGG_COUNT; agg++) {
+		if (!(aggs & (1 << agg)))
+			continue;
+
+		tbl_sink_printf(sink, "%s%s%s%s%s\"%s\":%s", first ? "" : ",", nl,
+				prefix, in, in, agg_names[agg], sp);
+		first = false;
+		if (agg == 0) {
+			tbl_sink_write(sink, buf, tbl_u64toa(buf, layout->totals->rows));
+			continue;
+		}
+
+		tbl_sink_putc(sink, '{');
+		for (i = 0, col_first = true; i < layout->count; i++) {
+			column = layout->columns[i];
+			if (!table_type_is_number(column->m_type))
+				continue;
+
+			tbl_sink_printf(sink, "%s%s%s%s%s%s\"", col_first ? "" : ",", nl,
+					prefix, in, in, in);
+			tbl_escape_sink(sink, FORMAT_JSON, column->m_name,
+					strlen(column->m_name));
+			tbl_sink_printf(sink, "\":%s", sp);
+			col_first = false;
+
+			len = total_format(buf, layout->totals, column, i, agg);
+			if (len)
+				tbl_sink_write(sink, buf, len);
+			else
+				tbl_sink_puts(sink, "null");
+		}
+		tbl_sink_printf(sink, "%s%s%s%s}", nl, col_first ? "" : prefix,
+				col_first ? "" : in, col_first ? "" : in);
+	}
+
+	tbl_sink_printf(sink, "%s%s%s}%s%s}%s", nl, first ? "" : prefix,
+			first ? "" : in, nl, prefix, compact ? "\n" : "");
+}
+
+static void totals_xml(const struct tbl_layout *layout, struct tbl_sink *sink,
+		       const char *prefix, unsigned aggs)
+{
+	struct table_column *column;
+	char buf[TOTAL_BUF_SIZE];
+	unsigned agg;
+	int i, len;
+
+	prefix = prefix ?: "";
+	tbl_sink_printf(sink, "%s<summary>\n", prefix);
+
+	for (agg = 0; agg < AGG_COUNT; agg++) {
+		if (!(aggs & (1 << agg)))
+			continue;
+
+		if (agg == 0) {
+			len = tbl_u64toa(buf, layout->totals->rows);
+			tbl_sink_printf(sink, "%s\t<count>%.*s</count>\n", prefix, len, buf);
+			continue;
+		}
+
+		tbl_sink_printf(sink, "%s\t<%s>\n", prefix, agg_names[agg]);
+		for (i = 0; i < layout->count; i++) {
+			column = layout->columns[i];
+			if (!table_type_is_number(column->m_type))
+				continue;
+
+			len = total_format(buf, layout->totals, column, i, agg);
+			tbl_sink_printf(sink, "%s\t\t<%s>%.*s</%s>\n", prefix,
+					column->m_name, len, buf, column->m_name);
+		}
+		tbl_sink_printf(sink, "%s\t</%s>\n", prefix, agg_names[agg]);
+	}
+
+	tbl_sink_printf(sink, "%s</summary>\n", prefix);
+}
+
+int tbl_layout_print_totals_sink(struct tbl_layout *layout,
+				 struct tbl_sink *sink, enum format_type format,
+				 const char *prefix, bool use_color,
+				 size_t pre_len, unsigned aggs)
+{
+	if (!layout->totals || tbl_totals_short(layout))
+		return -EINVAL;
+
+	switch (format) {
+	case FORMAT_TERM:
+		tbl_layout_fit_totals(layout, pre_len, aggs);
+		/* fall through */
+	case FORMAT_CSV:
+		return totals_rows(layout, sink, format, prefix, use_color, pre_len,
+				   aggs);
+	case FORMAT_JSON:
+	case FORMAT_JSONL:
+		totals_json(layout, sink, prefix, format == FORMAT_JSONL, aggs);
+		break;
+	case FORMAT_XML:
+		totals_xml(layout, sink, prefix, aggs);
+		break;
+	default:
+		return -EINVAL;
+	}
+	tbl_sink_row_end(sink);
+
+	return sink->error;
+}
@@ -0,0 +1,194 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+#include "libtbl.h"
+#include "libtbl_helper.h"
+#include <stdint.h>
+#include <string.h>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#define WIDTH_SSE2
+#endif
+
+struct width_range {
+	uint32_t	first;
+	uint32_t	last;
+};
+
+/* Combining marks, joiners and other characters taking no column */
+static const struct width_range zero_width[] = {
+	{ 0x0300, 0x036f }, { 0x0483, 0x0489 }, { 0x0591, 0x05bd },
+	{ 0x05bf, 0x05bf }, { 0x05c1, 0x05c2 }, { 0x05c4, 0x05c5 },
+	{ 0x05c7, 0x05c7 }, { 0x0610, 0x061a }, { 0x064b, 0x065f },
+	{ 0x0670, 0x0670 }, { 0x06d6, 0x06dc }, { 0x06df, 0x06e4 },
+	{ 0x06e7, 0x06e8 }, { 0x06ea, 0x06ed }, { 0x0711, 0x0711 },
+	{ 0x0730, 0x074a }, { 0x07a6, 0x07b0 }, { 0x0900, 0x0902 },
+	{ 0x093a, 0x093a }, { 0x093c, 0x093c }, { 0x0941, 0x0948 },
+	{ 0x094d, 0x094d }, { 0x0951, 0x0957 }, { 0x0e31, 0x0e31 },
+	{ 0x0e34, 0x0e3a }, { 0x0e47, 0x0e4e }, { 0x1160, 0x11ff },
+	{ 0x1ab0, 0x1aff }, { 0x1dc0, 0x1dff }, { 0x200b, 0x200f },
+	{ 0x202a, 0x202e }, { 0x2060, 0x2064 }, { 0x20d0, 0x20ff },
+	{ 0xfe00, 0xfe0f }, { 0xfe20, 0xfe2f }, { 0xfeff, 0xfeff },
+	{ 0xe0001, 0xe0001 }, { 0xe0020, 0xe007f }, { 0xe0100, 0xe01ef },
+};
+
+/* East Asian wide and fullwidth characters and emoji, two columns */
+static const struct width_range wide[] = {
+	{ 0x1100, 0x115f }, { 0x231a, 0x231b }, { 0x2329, 0x232a },
+	{ 0x23e9, 0x23ec }, { 0x23f0, 0x23f0 }, { 0x23f3, 0x23f3 },
+	{ 0x25fd, 0x25fe }, { 0x2614, 0x2615 }, { 0x2648, 0x2653 },
+	{ 0x267f, 0x267f }, { 0x2693, 0x2693 }, { 0x26a1, 0x26a1 },
+	{ 0x26aa, 0x26ab }, { 0x26bd, 0x26be }, { 0x26c4, 0x26c5 },
+	{ 0x26ce, 0x26ce }, { 0x26d4, 0x26d4 }, { 0x26ea, 0x26ea },
+	{ 0x26f2, 0x26f3 }, { 0x26f5, 0x26f5 }, { 0x26fa, 0x26fa },
+	{ 0x26fd, 0x26fd }, { 0x2705, 0x2705 }, { 0x270a, 0x270b },
+	{ 0x2728, 0x2728 }, { 0x274c, 0x274c }, { 0x274e, 0x274e },
+	{ 0x2753, 0x2755 }, { 0x2757, 0x2757 }, { 0x2795, 0x2797 },
+	{ 0x27b0, 0x27b0 }, { 0x27bf, 0x27bf }, { 0x2b1b, 0x2b1c },
+	{ 0x2b50, 0x2b50 }, { 0x2b55, 0x2b55 }, { 0x2e80, 0x303e },
+	{ 0x3041, 0x4dbf }, { 0x4e00, 0xa4cf }, { 0xa960, 0xa97f },
+	{ 0xac00, 0xd7a3 }, { 0xf900, 0xfaff }, { 0xfe10, 0xfe19 },
+	{ 0xfe30, 0xfe6f }, { 0xff00, 0xff60 }, { 0xffe0, 0xffe6 },
+	{ 0x16fe0, 0x16fe4 }, { 0x17000, 0x18cff }, { 0x1b000, 0x1b2ff },
+	{ 0x1f004, 0x1f004 }, { 0x1f0cf, 0x1f0cf }, { 0x1f18e, 0x1f18e },
+	{ 0x1f191, 0x1f19a }, { 0x1f200, 0x1f251 }, { 0x1f300, 0x1f64f },
+	{ 0x1f680, 0x1f6ff }, { 0x1f7e0, 0x1f7eb }, { 0x1f900, 0x1f9ff },
+	{ 0x1fa70, 0x1faff }, { 0x20000, 0x2fffd }, { 0x30000, 0x3fffd },
+};
+
+static bool in_ranges(const struct width_range *r, size_t n, uint32_t cp)
+{
+	size_t lo = 0, hi = n;
+
+	if (cp < r[0].first || cp > r[n - 1].last)
+		return false;
+
+	while (lo < hi) {
+		size_t mid = (lo + hi) / 2;
+
+		if (cp > r[mid].last)
+			lo = mid + 1;
+		else if (cp < r[mid].first)
+			hi = mid;
+		else
+			return true;
+	}
+
+	return false;
+}
+
+static int cp_width(uint32_t cp)
+{
+	if (in_ranges(zero_width, sizeof(zero_width) / sizeof(zero_width[0]), cp))
+		return 0;
+	if (in_ranges(wide, sizeof(wide) / sizeof(wide[0]), cp))
+		return 2;
+
+	return 1;
+}
+
+/*
+ * Decode the character at @s of at most @len (> 0) bytes into @cp. Returns
+ * its length, 1 with @cp U+FFFD for a byte which starts no valid sequence.
+ */
+static int utf8_decode(const unsigned char *s, size_t len, uint32_t *cp)
+{
+	int n, i;
+
+	if (s[0] < 0x80) {
+		*cp = s[0];
+		return 1;
+	}
+
+	if (s[0] >= 0xc2 && s[0] <= 0xdf) {
+		n = 2;
+		*cp = s[0] & 0x1f;
+	} else if (s[0] >= 0xe0 && s[0] <= 0xef) {
+		n = 3;
+		*cp = s[0] & 0x0f;
+	} else if (s[0] >= 0xf0 && s[0] <= 0xf4) {
+		n = 4;
+		*cp = s[0] & 0x07;
+	} else {
+		goto invalid;
+	}
+
+	if ((size_t)n > len)
+		goto invalid;
+	for (i = 1; i < n; i++) {
+		if ((s[i] & 0xc0) != 0x80)
+			goto invalid;
+		*cp = *cp << 6 | (s[i] & 0x3f);
+	}
+
+	/* overlong forms, surrogates and beyond U+10FFFF */
+	if ((n == 3 && *cp < 0x800) || (n == 4 && *cp < 0x10000) ||
+	    (*cp >= 0xd800 && *cp <= 0xdfff) || *cp > 0x10ffff)
+		goto invalid;
+
+	return n;
+invalid:
+	*cp = 0xfffd;
+	return 1;
+}
+
+/* Length of the leading run of ASCII bytes of @str */
+static size_t ascii_prefix(const char *str, size_t len)
+{
+	size_t i = 0;
+	uint64_t w;
+
+#ifdef WIDTH_SSE2
+	unsigned mask;
+
+	for (; i + 16 <= len; i += 16) {
+		mask = _mm_movemask_epi8(_mm_loadu_si128((const __m128i *)(str + i)));
+		if (mask)
+			return i + __builtin_ctz(mask);
+	}
+#endif
+	for (; i + 8 <= len; i += 8) {
+		memcpy(&w, str + i, 8);
+		if (w & 0x8080808080808080ULL)
+			break;
+	}
+	for (; i < len; i++)
+		if (str[i] & 0x80)
+			break;
+
+	return i;
+}
+
+size_t tbl_str_width(const char *str, size_t len)
+{
+	size_t i = ascii_prefix(str, len), width = i;
+	uint32_t cp;
+
+	while (i < len) {
+		i += utf8_decode((const unsigned char *)str + i, len - i, &cp);
+		width += cp_width(cp);
+	}
+
+	return width;
+}
+
+size_t tbl_str_truncate(const char *str, size_t len, size_t width, size_t *cols)
+{
+	size_t i = ascii_prefix(str, len < width ? len : width), w = i;
+	uint32_t cp;
+	int n, cw;
+
+	/* zero width characters stay with the character they follow */
+	while (i < len) {
+		n = utf8_decode((const unsigned char *)str + i, len - i, &cp);
+		cw = cp_width(cp);
+		if (w + cw > width)
+			break;
+		w += cw;
+		i += n;
+	}
+
+	if (cols)
+		*cols = w;
+
+	return i;
+}
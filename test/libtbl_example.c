@@ -78,7 +78,7 @@ static void print_usage(char *prog)
 	print_color(1, CBLD, prog);
 	printf(" [option]\n\nOptions:\n");
 	printf("Select one of the following formats to print table: \n");
-	printf(" terminal, json, xml, csv, help \n");
+	printf(" terminal, json, jsonl, xml, csv, help \n");
 }
 
 int main(int argc, char **argv)
@@ -89,18 +89,21 @@ int main(int argc, char **argv)
 	is_terminal = (isatty(STDOUT_FILENO) == 1);
 
 	if ((argc <= 1) || ((argc > 1) && (!strcmp("terminal", argv[1])))) {
-		struct table_field fields[NUMBER_OF_ROWS * NUMBER_OF_COLUMNS];
+		struct tbl_cell cells[NUMBER_OF_ROWS * NUMBER_OF_COLUMNS];
+		struct tbl_arena arena = {};
 
 		for (i = 0; rows[i]; i++)
-			table_row_stringify((void *)rows[i], fields + i * NUMBER_OF_COLUMNS,
-					    		columns, true, 0);
+			table_row_stringify_arena((void *)rows[i], &arena,
+						  cells + i * NUMBER_OF_COLUMNS,
+						  columns, true, 0);
 
 		print_table_header_term("", columns, is_terminal, 'a');
 
 		for (i = 0; rows[i]; i++)
-			print_table_fields(FORMAT_TERM, " ",
-							fields + i * NUMBER_OF_COLUMNS,
-					      	columns, CBLD, 0);
+			print_table_cells(FORMAT_TERM, " ", &arena,
+					  cells + i * NUMBER_OF_COLUMNS,
+					  columns, CBLD, 0);
+		tbl_arena_release(&arena);
 	} else if (!strcmp("help", argv[1])) {
 
 		print_usage(argv[0]);
@@ -122,6 +125,11 @@ int main(int argc, char **argv)
 				"\t\t", columns, 0, 0, 0);
 		printf("\n\t]\n}\n");
 
+	} else if (!strcmp("jsonl", argv[1])) {
+
+		print_table_all_rows((void **)rows, FORMAT_JSONL,
+				NULL, columns, 0, 0, 0);
+
 	} else if (!strcmp("xml", argv[1])) {
 
 		printf("<rows>\n");
@@ -26,6 +26,17 @@ def check_json_output(binary_path):
             os.rename('result.txt', 'json_output.txt')
             exit(1)
 
+def check_jsonl_output(binary_path):
+    with open('result.txt',"w") as outfile:
+        subprocess.check_call([binary_path + "/libtbl_example", "jsonl"],stdout=outfile)
+
+        if filecmp.cmp('result.txt', 'expected_output/jsonl_expected_output.txt'):
+            print("Pass")
+        else:
+            print("Error: Compare expected_output/jsonl_expected_output.txt and test/jsonl_output.txt")
+            os.rename('result.txt', 'jsonl_output.txt')
+            exit(1)
+
 def check_xml_output(binary_path):
     with open('result.txt',"w") as outfile:
         subprocess.check_call([binary_path + "/libtbl_example", "xml"],stdout=outfile)
@@ -61,6 +72,9 @@ def main():
     print("Check JSON output::")
     check_json_output(args.binary_path)
 
+    print("Check JSON Lines output::")
+    check_jsonl_output(args.binary_path)
+
     print("Check XML output::")
     check_xml_output(args.binary_path)
 
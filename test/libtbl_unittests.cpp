@@ -1,6 +1,12 @@
 // SPDX-License-Identifier: GPL-2.0-or-later
 #include <gtest/gtest.h>
 #include <string.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <errno.h>
+#include <functional>
+#include <thread>
+#include <vector>
 
 using namespace std;
 
@@ -10,6 +16,7 @@ extern "C"{
   #include "../include/libtbl.h"
   #include "../include/libtbl_helper.h"
 }
+#include "../include/libtbl.hpp"
 
 TEST(LibtblUnitTests, RemoveSpaces) {
   char str[15] = "Hello World   ";
@@ -157,4 +164,1528 @@ TEST(LibtblUnitTests, PrintColor)
     freopen ("/dev/tty", "a", stdout);
     ASSERT_STREQ(buf, result);
   }
-}
\ No newline at end of file
+}
+struct unit_row {
+  char name[16];
+  int count;
+  uint64_t bytes;
+};
+
+#define CLM_UNIT(m_name, m_header, m_type, align) \
+  static CLM(unit_row, m_name, m_header, m_type, NULL, align, CBLD, CNRM, \
+             "", sizeof(m_header) - 1, 0)
+
+CLM_UNIT(name, "Name", FIELD_STR, 'l');
+CLM_UNIT(count, "Count", FIELD_NUM, 'r');
+CLM_UNIT(bytes, "Bytes", FIELD_LLU, 'r');
+
+static struct table_column *unit_columns[] = {
+  &clm_unit_row_name,
+  &clm_unit_row_count,
+  NULL
+};
+
+static struct unit_row unit_a = {"foo", 1, 10};
+static struct unit_row unit_b = {"b\"ar", -23, 20};
+
+static void *unit_rows[] = {&unit_a, &unit_b, NULL};
+
+/*
+ * Private copies of the unit_row columns at their declared widths (the
+ * legacy functions grow the static ones) and @n rows "row<i>", i.
+ */
+struct unit_table {
+  struct table_column name = clm_unit_row_name, count = clm_unit_row_count;
+  struct table_column bytes = clm_unit_row_bytes;
+  struct table_column *cs[3] = {&name, &count, NULL};
+  struct table_column *all[4] = {&name, &count, &bytes, NULL};
+  std::vector<struct unit_row> data;
+  std::vector<void *> rows;
+
+  explicit unit_table(int n = 0) : data(n), rows(n + 1)
+  {
+    reset_widths();
+    for (int i = 0; i < n; i++) {
+      snprintf(data[i].name, sizeof(data[i].name), "row%d", i);
+      data[i].count = i;
+      rows[i] = &data[i];
+    }
+    rows[n] = NULL;
+  }
+
+  unit_table(const unit_table &) = delete;
+
+  void reset_widths()
+  {
+    name.m_width = 4;
+    count.m_width = 5;
+    bytes.m_width = 5;
+  }
+};
+
+/*
+ * Render the same table @ways ways, render(&sink, way) into a heap sink
+ * for way = 0 ... @ways - 1, and check that each output and the color
+ * bytes saved equal those of way 0. Returns the output of way 0.
+ */
+static std::string render_alike(int ways,
+                                const std::function<void(struct tbl_sink *, int)> &render)
+{
+  std::string first;
+  size_t saved = 0;
+
+  for (int way = 0; way < ways; way++) {
+    struct tbl_sink sink;
+
+    tbl_sink_init_heap(&sink, 0);
+    render(&sink, way);
+    std::string out(sink.buf, sink.len);
+    if (!way) {
+      first = out;
+      saved = sink.color_saved;
+    } else {
+      EXPECT_EQ(out, first) << "way " << way;
+      EXPECT_EQ(sink.color_saved, saved) << "way " << way;
+    }
+    tbl_sink_release(&sink);
+  }
+
+  return first;
+}
+
+TEST(LibtblUnitTests, SinkMem)
+{
+  {
+    char buf[8];
+    struct tbl_sink sink;
+    tbl_sink_init_mem(&sink, buf, sizeof(buf));
+    tbl_sink_puts(&sink, "abc");
+    tbl_sink_fill(&sink, '-', 2);
+    ASSERT_EQ(tbl_sink_close(&sink), 0);
+    ASSERT_STREQ(buf, "abc--");
+  }
+
+  {
+    char buf[4];
+    struct tbl_sink sink;
+    tbl_sink_init_mem(&sink, buf, sizeof(buf));
+    tbl_sink_printf(&sink, "%d", 123456);
+    ASSERT_EQ(tbl_sink_close(&sink), -ENOSPC);
+    ASSERT_STREQ(buf, "123");
+    ASSERT_EQ(tbl_sink_bytes(&sink), 6u);
+  }
+}
+
+TEST(LibtblUnitTests, SinkHeapAllRows)
+{
+  struct tbl_sink sink;
+  const char result[] = "name,count\n\"foo\",1\n\"b\"\"ar\",-23\n";
+
+  ASSERT_EQ(tbl_sink_init_heap(&sink, 4), 0);
+  print_table_header_csv_sink(&sink, unit_columns);
+  ASSERT_EQ(print_table_all_rows_sink(&sink, unit_rows, FORMAT_CSV, NULL,
+                                      unit_columns, false, 0, 0), 0);
+  ASSERT_EQ(tbl_sink_close(&sink), 0);
+  ASSERT_STREQ(sink.buf, result);
+  tbl_sink_release(&sink);
+}
+
+TEST(LibtblUnitTests, SinkFdBatches)
+{
+  int fds[2];
+  char out[256];
+  ssize_t len;
+  struct tbl_sink sink;
+
+  ASSERT_EQ(pipe(fds), 0);
+  ASSERT_EQ(tbl_sink_init_fd(&sink, fds[1], NULL, 0), 0);
+  print_table_all_rows_sink(&sink, unit_rows, FORMAT_JSON, "", unit_columns,
+                            false, 0, 0);
+  ASSERT_EQ(sink.nwrites, 0u);
+  ASSERT_EQ(tbl_sink_close(&sink), 0);
+  ASSERT_EQ(sink.nwrites, 1u);
+  tbl_sink_release(&sink);
+  close(fds[1]);
+
+  len = read(fds[0], out, sizeof(out) - 1);
+  close(fds[0]);
+  ASSERT_GT(len, 0);
+  out[len] = '\0';
+  ASSERT_STREQ(out, "{\n\t\"name\": \"foo\",\n\t\"count\": 1\n},\n"
+                    "{\n\t\"name\": \"b\\\"ar\",\n\t\"count\": -23\n}");
+}
+
+static int long_to_str(char *str, size_t len, enum color *pColor, void *v,
+                       int humanize)
+{
+  *pColor = CNRM;
+  return snprintf(str, len, "%0200d", 0);
+}
+
+static struct table_column clm_unit_row_long =
+  _CLM(unit_row, "long", name, "Long", FIELD_STR, long_to_str, 'l', CNRM, CNRM,
+       "", 4, 0);
+
+static struct table_column *unit_long_columns[] = {
+  &clm_unit_row_long,
+  NULL
+};
+
+TEST(LibtblUnitTests, StringifyArena)
+{
+  struct unit_row long_row = {};
+  struct tbl_cell cells[3];
+  struct tbl_arena arena = {};
+  char buf[STRING_SIZE];
+  struct tbl_sink sink;
+  int len_a;
+
+  memset(long_row.name, 'x', sizeof(long_row.name) - 1);
+  long_row.count = 7;
+
+  ASSERT_EQ(table_row_stringify_arena(&unit_a, &arena, cells, unit_columns, 0, 0), 0);
+  ASSERT_STREQ(tbl_cell_str(&arena, &cells[0]), "foo");
+  ASSERT_STREQ(tbl_cell_str(&arena, &cells[1]), "1");
+  ASSERT_EQ(cells[1].len, 1u);
+  len_a = arena.used;
+  ASSERT_EQ(len_a, 6);
+
+  tbl_arena_reset(&arena);
+  ASSERT_EQ(table_row_stringify_arena(&long_row, &arena, cells, unit_columns, 0, 0), 0);
+  ASSERT_EQ(cells[0].len, sizeof(long_row.name) - 1);
+  ASSERT_EQ(cells[0].off, 0u);
+
+  tbl_sink_init_mem(&sink, buf, sizeof(buf));
+  print_table_cells_sink(&sink, FORMAT_CSV, NULL, &arena, cells, unit_columns,
+                         false, 0);
+  tbl_sink_close(&sink);
+  ASSERT_STREQ(buf, "\"xxxxxxxxxxxxxxx\",7\n");
+
+  /* callback output beyond MAX_COLUMN_WIDTH is not truncated */
+  tbl_arena_reset(&arena);
+  ASSERT_EQ(table_row_stringify_arena(&unit_a, &arena, cells, unit_long_columns,
+                                      0, 0), 0);
+  ASSERT_EQ(cells[0].len, 200u);
+  ASSERT_EQ(strlen(tbl_cell_str(&arena, &cells[0])), 200u);
+  tbl_arena_release(&arena);
+
+  /* a caller buffer is used until the text outgrows it */
+  char text[64];
+
+  tbl_arena_init_buf(&arena, text, sizeof(text));
+  ASSERT_EQ(table_row_stringify_arena(&unit_b, &arena, cells, unit_columns, 0, 0), 0);
+  ASSERT_EQ(arena.base, text);
+  ASSERT_EQ(table_row_stringify_arena(&unit_a, &arena, cells + 2, unit_long_columns,
+                                      0, 0), 0);
+  ASSERT_NE(arena.base, text);
+  ASSERT_FALSE(arena.borrowed);
+  ASSERT_STREQ(tbl_cell_str(&arena, &cells[0]), "b\"ar");
+  ASSERT_EQ(cells[2].len, 200u);
+  tbl_arena_release(&arena);
+}
+
+static struct table_column clm_stream_name =
+  _CLM(unit_row, "name", name, "Name", FIELD_STR, NULL, 'l', CNRM, CNRM, "", 4, 0);
+static struct table_column clm_stream_count =
+  _CLM(unit_row, "count", count, "N", FIELD_NUM, NULL, 'r', CNRM, CNRM, "", 1, 0);
+
+static struct table_column *stream_columns[] = {
+  &clm_stream_name,
+  &clm_stream_count,
+  NULL
+};
+
+static void stream_render(char *buf, size_t size, enum tbl_overflow overflow,
+                          int lookahead, int block)
+{
+  struct unit_row r[] = {{"ab", 1, 0}, {"abcde", 22, 0}, {"abcdefgh", 3, 0}};
+  struct tbl_stream_opts opts = {};
+  struct tbl_stream st;
+  struct tbl_sink sink;
+
+  opts.lookahead = lookahead;
+  opts.overflow = overflow;
+  opts.block = block;
+  tbl_sink_init_mem(&sink, buf, size);
+  ASSERT_EQ(tbl_stream_init(&st, &sink, NULL, stream_columns, false, 0, 0,
+                            &opts), 0);
+  for (auto &row : r)
+    ASSERT_EQ(tbl_stream_push(&st, &row), 0);
+  ASSERT_EQ(tbl_stream_finish(&st), 0);
+  tbl_sink_close(&sink);
+}
+
+TEST(LibtblUnitTests, StreamTerm)
+{
+  char buf[STRING_SIZE];
+
+  stream_render(buf, sizeof(buf), TBL_OVERFLOW_WIDEN, 2, 0);
+  ASSERT_STREQ(buf, "Name    N  \n"
+                    "ab      1  \n"
+                    "abcde  22  \n"
+                    "abcdefgh   3  \n");
+
+  stream_render(buf, sizeof(buf), TBL_OVERFLOW_TRUNCATE, 2, 0);
+  ASSERT_STREQ(buf, "Name    N  \n"
+                    "ab      1  \n"
+                    "abcde  22  \n"
+                    "abcd~   3  \n");
+
+  stream_render(buf, sizeof(buf), TBL_OVERFLOW_REFLOW, 1, 1);
+  ASSERT_STREQ(buf, "Name  N  \n"
+                    "ab    1  \n"
+                    "Name    N  \n"
+                    "abcde  22  \n"
+                    "Name       N  \n"
+                    "abcdefgh   3  \n");
+
+  /* look-ahead over all rows gives the widths of the whole table */
+  stream_render(buf, sizeof(buf), TBL_OVERFLOW_WIDEN, 10, 0);
+  ASSERT_STREQ(buf, "Name       N  \n"
+                    "ab         1  \n"
+                    "abcde     22  \n"
+                    "abcdefgh   3  \n");
+}
+
+/* Returns the width left in the name column */
+static int render_rows(struct tbl_sink *sink, void **rows, enum format_type format,
+                       int nthreads)
+{
+  struct table_column name = clm_stream_name, count = clm_stream_count;
+  struct table_column *cs[] = {&name, &count, NULL};
+
+  if (nthreads)
+    print_table_all_rows_parallel_sink(sink, rows, format, " ", cs, true, 0, 1,
+                                       nthreads);
+  else
+    print_table_all_rows_sink(sink, rows, format, " ", cs, true, 0, 1);
+
+  return name.m_width;
+}
+
+TEST(LibtblUnitTests, ParallelAllRows)
+{
+  const int n = 5000;
+  std::vector<struct unit_row> data(n);
+  std::vector<void *> rows(n + 1);
+  enum format_type formats[] = {FORMAT_TERM, FORMAT_CSV, FORMAT_JSON, FORMAT_XML};
+
+  for (int i = 0; i < n; i++) {
+    /* the widest name shows up late so widths grow between chunks */
+    memset(data[i].name, 'a', 1 + (i * 7 / n) + (i == 3000 ? 7 : 0));
+    data[i].count = i * 31;
+    rows[i] = &data[i];
+  }
+  rows[n] = NULL;
+
+  for (enum format_type format : formats) {
+    int width[2];
+
+    render_alike(2, [&](struct tbl_sink *sink, int way) {
+      width[way] = render_rows(sink, rows.data(), format, way ? 4 : 0);
+    });
+    ASSERT_EQ(width[0], width[1]);
+  }
+}
+
+static int render_threads;
+
+/* threads of the process while a cell is stringified */
+static int count_threads(char *str, size_t len, enum color *pColor, void *v,
+                         int humanize)
+{
+  DIR *dir = opendir("/proc/self/task");
+  int n = 0;
+
+  while (dir && readdir(dir))
+    n++;
+  if (dir)
+    closedir(dir);
+  if (n - 2 > render_threads)
+    render_threads = n - 2;
+  *pColor = CNRM;
+  return snprintf(str, len, "%d", *(int *)v);
+}
+
+TEST(LibtblUnitTests, ParallelSmallTable)
+{
+  unit_table t;
+
+  /* two rows: no worker threads, whatever is asked for */
+  t.count.m_tostr = count_threads;
+  std::string out = render_alike(2, [&](struct tbl_sink *sink, int way) {
+    render_threads = 0;
+    ASSERT_EQ(print_table_all_rows_parallel_sink(sink, unit_rows, FORMAT_CSV,
+                                                 NULL, t.cs, false, 0, 0,
+                                                 way ? 4 : 0), 0);
+    ASSERT_EQ(render_threads, 1);
+  });
+  ASSERT_EQ(out, "\"foo\",1\n\"b\"\"ar\",-23\n");
+}
+
+static std::string itoa_u64(uint64_t v)
+{
+  char buf[TBL_INT_BUF_SIZE];
+  return std::string(buf, tbl_u64toa(buf, v));
+}
+
+static std::string itoa_i64(int64_t v)
+{
+  char buf[TBL_INT_BUF_SIZE];
+  return std::string(buf, tbl_i64toa(buf, v));
+}
+
+TEST(LibtblUnitTests, IntegerToText)
+{
+  uint64_t p = 1;
+
+  ASSERT_EQ(itoa_u64(0), "0");
+  ASSERT_EQ(itoa_u64(UINT64_MAX), "18446744073709551615");
+  ASSERT_EQ(itoa_i64(INT64_MIN), "-9223372036854775808");
+  ASSERT_EQ(itoa_i64(-1), "-1");
+  for (int i = 0; i < 19; i++, p *= 10) {
+    ASSERT_EQ(itoa_u64(p), std::to_string(p));
+    ASSERT_EQ(itoa_u64(p - 1), std::to_string(p - 1));
+  }
+}
+
+struct int_row {
+  int8_t i8;
+  uint8_t u8;
+  int16_t i16;
+  uint16_t u16;
+  uint32_t u32;
+  int64_t i64;
+  uint64_t llu;
+};
+
+#define CLM_INT(m_name, m_type) \
+  static CLM(int_row, m_name, #m_name, m_type, NULL, 'r', CNRM, CNRM, "", 1, 0)
+
+CLM_INT(i8, FIELD_I8);
+CLM_INT(u8, FIELD_U8);
+CLM_INT(i16, FIELD_I16);
+CLM_INT(u16, FIELD_U16);
+CLM_INT(u32, FIELD_U32);
+CLM_INT(i64, FIELD_I64);
+CLM_INT(llu, FIELD_LLU);
+
+TEST(LibtblUnitTests, IntegerFields)
+{
+  struct int_row r = {-128, 255, -32768, 65535, 4294967295u, INT64_MIN,
+                      UINT64_MAX};
+  struct table_column *cs[] = {&clm_int_row_i8, &clm_int_row_u8,
+                               &clm_int_row_i16, &clm_int_row_u16,
+                               &clm_int_row_u32, &clm_int_row_i64,
+                               &clm_int_row_llu, NULL};
+  struct table_field fields[8];
+  char buf[STRING_SIZE];
+  struct tbl_sink sink;
+
+  table_row_stringify(&r, fields, cs, 0, 0);
+  tbl_sink_init_mem(&sink, buf, sizeof(buf));
+  print_table_fields_sink(&sink, FORMAT_CSV, NULL, fields, cs, false, 0);
+  tbl_sink_close(&sink);
+  ASSERT_STREQ(buf, "-128,255,-32768,65535,4294967295,-9223372036854775808,"
+                    "18446744073709551615\n");
+  ASSERT_EQ(clm_int_row_llu.m_width, 20);
+}
+
+static std::string escape(enum format_type format, const std::string &str)
+{
+  struct tbl_sink sink;
+  std::string ret;
+
+  tbl_sink_init_heap(&sink, 0);
+  tbl_escape_sink(&sink, format, str.data(), str.size());
+  tbl_sink_close(&sink);
+  ret.assign(sink.buf, sink.len);
+  tbl_sink_release(&sink);
+
+  return ret;
+}
+
+TEST(LibtblUnitTests, EscapeFormats)
+{
+  std::string clean(100, 'a');
+  std::string tail = clean + "\"";
+
+  ASSERT_EQ(escape(FORMAT_CSV, "a\"b\"\""), "a\"\"b\"\"\"\"");
+  ASSERT_EQ(escape(FORMAT_JSON, "a\"\\\n\t\x01\xc3\xa4"),
+            "a\\\"\\\\\\n\\t\\u0001\xc3\xa4");
+  ASSERT_EQ(escape(FORMAT_XML, "<a & b>\""), "&lt;a &amp; b&gt;\"");
+
+  /* clean runs of every length around the vector widths */
+  for (size_t i = 0; i < clean.size(); i++) {
+    std::string s = clean.substr(0, i) + "\x1f" + clean.substr(0, i);
+    ASSERT_EQ(tbl_escape_scan(FORMAT_JSON, s.data(), s.size()), i);
+    ASSERT_EQ(tbl_escape_scan(FORMAT_CSV, s.data(), s.size()), s.size());
+    ASSERT_EQ(escape(FORMAT_JSON, s), clean.substr(0, i) + "\\u001f" +
+                                      clean.substr(0, i));
+  }
+  ASSERT_EQ(tbl_escape_scan(FORMAT_XML, tail.data(), tail.size()), tail.size());
+  ASSERT_EQ(tbl_escape_scan(FORMAT_CSV, tail.data(), tail.size()), clean.size());
+}
+
+TEST(LibtblUnitTests, SchemaSelect)
+{
+  struct table_column *all[] = {
+    &clm_unit_row_name, &clm_unit_row_count, &clm_unit_row_bytes, NULL
+  };
+  struct table_column *cs[4];
+  struct tbl_selection sel;
+  struct tbl_schema *schema = tbl_schema_create(all);
+
+  ASSERT_NE(schema, nullptr);
+  ASSERT_EQ(tbl_schema_find(schema, "bytes", 5), 2);
+  ASSERT_EQ(tbl_schema_find(schema, " count ", 7), 1);
+  ASSERT_EQ(tbl_schema_find(schema, "nam", 3), -ENOENT);
+  ASSERT_EQ(tbl_selection_init(&sel, schema), 0);
+
+  ASSERT_EQ(tbl_schema_select(schema, &sel, "bytes, name", ","), 0);
+  ASSERT_EQ(tbl_schema_select(schema, &sel, "+count,name", ","), 0);
+  ASSERT_EQ(tbl_selection_columns(schema, &sel, cs, 4), 3);
+  ASSERT_EQ(cs[0], &clm_unit_row_bytes);
+  ASSERT_EQ(cs[1], &clm_unit_row_name);
+  ASSERT_EQ(cs[2], &clm_unit_row_count);
+  ASSERT_EQ(cs[3], nullptr);
+  ASSERT_EQ(tbl_selection_columns(schema, &sel, cs, 3), -ENOSPC);
+
+  ASSERT_EQ(tbl_schema_select(schema, &sel, "-name:bytes", ":"), 0);
+  ASSERT_EQ(tbl_schema_select(schema, &sel, "name,foo", ","), -EINVAL);
+  ASSERT_EQ(tbl_schema_select(schema, &sel, " ", ","), -EINVAL);
+  ASSERT_EQ(tbl_selection_columns(schema, &sel, cs, 4), 1);
+  ASSERT_EQ(cs[0], &clm_unit_row_count);
+
+  tbl_selection_release(&sel);
+  tbl_schema_destroy(schema);
+
+  /* the legacy interface shares the tokenizer */
+  cs[0] = NULL;
+  ASSERT_EQ(table_extend_columns("", ",", all, cs, 3), -EINVAL);
+  ASSERT_EQ(table_extend_columns("na me,,bytes", ",", all, cs, 3), 0);
+  ASSERT_EQ(cs[0], &clm_unit_row_name);
+  ASSERT_EQ(cs[1], &clm_unit_row_bytes);
+  ASSERT_EQ(cs[2], nullptr);
+}
+
+TEST(LibtblUnitTests, RenderPlan)
+{
+  struct table_column *cs[] = {&clm_unit_row_name, &clm_unit_row_count, NULL};
+  struct tbl_cell cells[2];
+  struct tbl_arena arena = {};
+  struct tbl_plan plan;
+  struct tbl_sink sink;
+  char buf[256];
+
+  ASSERT_EQ(table_row_stringify_arena(&unit_b, &arena, cells, cs, 0, 0), 0);
+  cells[1].mColor = CRED;
+
+  ASSERT_EQ(tbl_plan_compile(&plan, FORMAT_XML, "  ", cs, true, 0), 0);
+  tbl_sink_init_mem(&sink, buf, sizeof(buf));
+  ASSERT_EQ(tbl_plan_print_cells(&sink, &plan, &arena, cells), 0);
+  ASSERT_EQ(tbl_plan_print_cells(&sink, &plan, &arena, cells), 0);
+  tbl_sink_close(&sink);
+  ASSERT_STREQ(buf, "  <name>\"b\"ar\"</name>\n  <count>\x1B[31m-23\x1B[0m</count>\n"
+                    "  <name>\"b\"ar\"</name>\n  <count>\x1B[31m-23\x1B[0m</count>\n");
+  tbl_plan_release(&plan);
+
+  cells[1].len = 0;
+  cells[1].mColor = CNRM;
+  ASSERT_EQ(tbl_plan_compile(&plan, FORMAT_JSON, "", cs, false, 0), 0);
+  tbl_sink_init_mem(&sink, buf, sizeof(buf));
+  ASSERT_EQ(tbl_plan_print_cells(&sink, &plan, &arena, cells), 0);
+  tbl_sink_close(&sink);
+  ASSERT_STREQ(buf, "{\n\t\"name\": \"b\\\"ar\",\n\t\"count\": null\n}");
+  tbl_plan_release(&plan);
+
+  /* single rows are emitted without a plan, byte for byte the same */
+  const enum format_type formats[] = {FORMAT_TERM, FORMAT_CSV, FORMAT_JSON,
+                                      FORMAT_XML, FORMAT_JSONL};
+  struct table_column *none[] = {NULL};
+
+  cells[0].mColor = CGRN;
+  cells[1].mColor = CRED;
+  for (enum format_type format : formats) {
+    for (int v = 0; v < 8; v++) {
+      struct table_column **columns = v & 4 ? none : cs;
+
+      SCOPED_TRACE(std::to_string(format) + " " + std::to_string(v));
+      render_alike(2, [&](struct tbl_sink *sink, int way) {
+        sink->color_runs = v & 2;
+        if (way) {
+          ASSERT_EQ(print_table_cells_sink(sink, format, "> ", &arena, cells,
+                                           columns, v & 1, 1), 0);
+        } else {
+          ASSERT_EQ(tbl_plan_compile(&plan, format, "> ", columns, v & 1, 1), 0);
+          ASSERT_EQ(tbl_plan_print_cells(sink, &plan, &arena, cells), 0);
+          tbl_plan_release(&plan);
+        }
+      });
+    }
+  }
+  tbl_arena_release(&arena);
+
+  ASSERT_EQ(get_dashed_line(buf, 4, 10), 3u);
+  ASSERT_STREQ(buf, "---");
+  ASSERT_EQ(get_dashed_line(buf, 4, 0), 0u);
+  ASSERT_STREQ(buf, "");
+}
+
+TEST(LibtblUnitTests, ColorRuns)
+{
+  struct table_column *cs[] = {&clm_unit_row_name, &clm_unit_row_count, NULL};
+  struct tbl_cell cells[2];
+  struct tbl_arena arena = {};
+  struct tbl_row_cells row = { .arena = &arena, .cells = cells };
+  const int widths[] = {4, 3};
+  struct tbl_plan plan;
+  struct tbl_sink sink;
+  char buf[256];
+
+  ASSERT_EQ(table_row_stringify_arena(&unit_b, &arena, cells, cs, 0, 0), 0);
+  ASSERT_EQ(tbl_plan_compile(&plan, FORMAT_TERM, NULL, cs, true, 0), 0);
+
+  cells[0].mColor = CRED;
+  cells[1].mColor = CRED;
+  tbl_sink_init_mem(&sink, buf, sizeof(buf));
+  sink.color_runs = true;
+  tbl_plan_emit(&sink, &plan, &row, widths);
+  cells[1].mColor = CGRN;
+  tbl_plan_emit(&sink, &plan, &row, widths);
+  cells[1].mColor = CBLD;
+  tbl_plan_emit(&sink, &plan, &row, widths);
+  tbl_sink_close(&sink);
+  ASSERT_STREQ(buf, "\x1B[31mb\"ar  -23  \x1B[0m\n"
+                    "\x1B[31mb\"ar  \x1B[32m-23  \x1B[0m\n"
+                    "\x1B[31mb\"ar  \x1B[0m\x1B[1m-23  \x1B[0m\n");
+  ASSERT_EQ(sink.color_saved, 9u + 4u + 0u);
+
+  /* without runs every cell is wrapped */
+  tbl_sink_init_mem(&sink, buf, sizeof(buf));
+  tbl_plan_emit(&sink, &plan, &row, widths);
+  tbl_sink_close(&sink);
+  ASSERT_STREQ(buf, "\x1B[31mb\"ar  \x1B[0m\x1B[1m-23  \x1B[0m\n");
+  ASSERT_EQ(sink.color_saved, 0u);
+
+  tbl_plan_release(&plan);
+  tbl_arena_release(&arena);
+}
+
+/* Minimal flatbuffer and Arrow IPC stream reader to check FORMAT_ARROW */
+static uint64_t le(const uint8_t *p, int size)
+{
+  uint64_t v = 0;
+  for (int i = size - 1; i >= 0; i--)
+    v = v << 8 | p[i];
+  return v;
+}
+
+static const uint8_t *fb_deref(const uint8_t *at)
+{
+  return at + le(at, 4);
+}
+
+static const uint8_t *fb_field(const uint8_t *tbl, int id)
+{
+  const uint8_t *vt = tbl - (int32_t)le(tbl, 4);
+  if (4 + 2 * id >= (int)le(vt, 2))
+    return nullptr;
+  uint16_t off = le(vt + 4 + 2 * id, 2);
+  return off ? tbl + off : nullptr;
+}
+
+TEST(LibtblUnitTests, ArrowRoundTrip)
+{
+  struct table_column *cs[] = {
+    &clm_unit_row_name, &clm_unit_row_count, &clm_unit_row_bytes, NULL
+  };
+  struct unit_row rows[5] = {
+    {"foo", 1, 10}, {"", -2, 1ULL << 40}, {"b\"ar", 3, 0}, {"x", INT32_MIN, 7},
+    {"last", 5, UINT64_MAX}
+  };
+  std::vector<std::string> names;
+  std::vector<int32_t> counts;
+  std::vector<uint64_t> bytes;
+  struct tbl_arrow ar;
+  struct tbl_sink sink;
+  int batches = 0;
+  size_t pos = 0;
+
+  ASSERT_EQ(tbl_sink_init_heap(&sink, 64), 0);
+  ASSERT_EQ(tbl_arrow_init(&ar, &sink, cs, 0, 2), 0);
+  for (auto &r : rows)
+    ASSERT_EQ(tbl_arrow_push(&ar, &r), 0);
+  ASSERT_EQ(tbl_arrow_finish(&ar), 0);
+  const uint8_t *buf = (const uint8_t *)sink.buf;
+
+  for (;;) {
+    ASSERT_EQ(le(buf + pos, 4), 0xffffffffu);
+    size_t len = le(buf + pos + 4, 4);
+    pos += 8;
+    if (!len)
+      break;
+    ASSERT_EQ(len % 8, 0u);
+
+    const uint8_t *msg = fb_deref(buf + pos);
+    ASSERT_EQ(le(fb_field(msg, 0), 2), 4u);
+    int type = *fb_field(msg, 1);
+    const uint8_t *header = fb_deref(fb_field(msg, 2));
+    const uint8_t *body = buf + pos + len;
+    size_t body_len = le(fb_field(msg, 3), 8);
+
+    if (type == 1) {
+      const uint8_t *fields = fb_deref(fb_field(header, 1));
+      const int types[] = {5, 2, 2};
+      ASSERT_EQ(le(fields, 4), 3u);
+      for (int i = 0; i < 3; i++) {
+        const uint8_t *f = fb_deref(fields + 4 + 4 * i);
+        const uint8_t *name = fb_deref(fb_field(f, 0));
+        ASSERT_STREQ((const char *)name + 4, cs[i]->m_name);
+        ASSERT_EQ(*fb_field(f, 2), types[i]);
+        ASSERT_EQ(le(fb_deref(fb_field(f, 5)), 4), 0u);
+      }
+      const uint8_t *count_type = fb_deref(fb_field(fb_deref(fields + 8), 3));
+      ASSERT_EQ(le(fb_field(count_type, 0), 4), 32u);
+      ASSERT_EQ(*fb_field(count_type, 1), 1);
+    } else {
+      ASSERT_EQ(type, 3);
+      size_t n = le(fb_field(header, 0), 8);
+      const uint8_t *b = fb_deref(fb_field(header, 2));
+      ASSERT_EQ(le(b, 4), 7u);
+      b += 4;
+      for (int i = 0; i < 7; i++)
+        ASSERT_EQ(le(b + 16 * i, 8) % 8, 0u);
+      const int32_t *off = (const int32_t *)(body + le(b + 16, 8));
+      const char *text = (const char *)body + le(b + 32, 8);
+      const int32_t *cnt = (const int32_t *)(body + le(b + 64, 8));
+      const uint64_t *byt = (const uint64_t *)(body + le(b + 96, 8));
+      ASSERT_EQ(le(b + 104, 8), n * 8);
+      for (size_t i = 0; i < n; i++) {
+        names.push_back(std::string(text + off[i], off[i + 1] - off[i]));
+        counts.push_back(cnt[i]);
+        bytes.push_back(byt[i]);
+      }
+      batches++;
+    }
+    pos += len + body_len;
+  }
+  ASSERT_EQ(pos, sink.len);
+  ASSERT_EQ(batches, 3);
+  ASSERT_EQ(names.size(), 5u);
+  for (int i = 0; i < 5; i++) {
+    ASSERT_EQ(names[i], rows[i].name);
+    ASSERT_EQ(counts[i], rows[i].count);
+    ASSERT_EQ(bytes[i], rows[i].bytes);
+  }
+  tbl_sink_release(&sink);
+
+  /* FIELD_VAL is an Int32 like FIELD_NUM */
+  struct table_column val = clm_unit_row_count;
+  struct table_column *vcs[] = {&val, NULL};
+
+  val.m_type = FIELD_VAL;
+  ASSERT_EQ(tbl_sink_init_heap(&sink, 64), 0);
+  ASSERT_EQ(tbl_arrow_init(&ar, &sink, vcs, 0, 0), 0);
+  ASSERT_EQ(tbl_arrow_finish(&ar), 0);
+  const uint8_t *schema = fb_deref(fb_field(fb_deref((const uint8_t *)sink.buf + 8), 2));
+  const uint8_t *field = fb_deref(fb_deref(fb_field(schema, 1)) + 4);
+  ASSERT_EQ(*fb_field(field, 2), 2);
+  const uint8_t *val_type = fb_deref(fb_field(field, 3));
+  ASSERT_EQ(le(fb_field(val_type, 0), 4), 32u);
+  ASSERT_EQ(*fb_field(val_type, 1), 1);
+  tbl_sink_release(&sink);
+
+  /* a failed schema releases the encoder */
+  char small[16];
+
+  tbl_sink_init_mem(&sink, small, sizeof(small));
+  ASSERT_LT(tbl_arrow_init(&ar, &sink, cs, 0, 0), 0);
+  ASSERT_EQ(ar.data, nullptr);
+  ASSERT_EQ(ar.meta.buf, nullptr);
+}
+
+TEST(LibtblUnitTests, JsonLines)
+{
+  struct table_column *cs[] = {&clm_unit_row_name, &clm_unit_row_count, NULL};
+  struct tbl_cell cells[2];
+  struct tbl_arena arena = {};
+  struct tbl_sink sink;
+  char buf[256];
+
+  tbl_sink_init_mem(&sink, buf, sizeof(buf));
+  ASSERT_EQ(print_table_all_rows_sink(&sink, unit_rows, FORMAT_JSONL, "\t",
+                                      cs, true, 0, 0), 0);
+
+  /* empty and non numeric text of number columns */
+  ASSERT_EQ(table_row_stringify_arena(&unit_a, &arena, cells, cs, 0, 0), 0);
+  cells[1].len = 0;
+  print_table_cells_sink(&sink, FORMAT_JSONL, NULL, &arena, cells, cs, false, 0);
+  cells[0].len = 0;
+  cells[1].off = cells[0].off;
+  cells[1].len = 2;
+  print_table_cells_sink(&sink, FORMAT_JSONL, NULL, &arena, cells, cs, false, 0);
+  tbl_sink_close(&sink);
+  ASSERT_STREQ(buf, "{\"name\":\"foo\",\"count\":1}\n"
+                    "{\"name\":\"b\\\"ar\",\"count\":-23}\n"
+                    "{\"name\":\"foo\",\"count\":null}\n"
+                    "{\"name\":\"\",\"count\":\"fo\"}\n");
+  tbl_arena_release(&arena);
+
+  /* FIELD_VAL is an int as well */
+  struct table_column val = clm_unit_row_count;
+  struct table_column *vs[] = {&val, NULL};
+
+  val.m_name = "val";
+  val.m_type = FIELD_VAL;
+  tbl_sink_init_mem(&sink, buf, sizeof(buf));
+  ASSERT_EQ(print_table_all_rows_sink(&sink, unit_rows, FORMAT_JSONL, NULL,
+                                      vs, false, 0, 0), 0);
+  tbl_sink_close(&sink);
+  ASSERT_STREQ(buf, "{\"val\":1}\n{\"val\":-23}\n");
+
+  /* callback text of a number column stays unquoted only if it is one */
+  static const char *const texts[] = {"2024-01-05", "1-2", "01", "1e", ".5",
+                                      "-", "1.", "1.5e3", "-0.25", "0",
+                                      "1E+2"};
+  const int n = sizeof(texts) / sizeof(texts[0]);
+  unit_table t(n);
+
+  t.cs[0] = &t.count;
+  t.cs[1] = NULL;
+  t.count.m_name = "d";
+  t.count.m_tostr = [](char *str, size_t len, enum color *pColor, void *v,
+                       int humanize) {
+    *pColor = CNRM;
+    return snprintf(str, len, "%s", texts[*(int *)v]);
+  };
+  std::string out = render_alike(1, [&](struct tbl_sink *sink, int way) {
+    ASSERT_EQ(print_table_all_rows_sink(sink, t.rows.data(), FORMAT_JSONL,
+                                        NULL, t.cs, false, 0, 0), 0);
+  });
+  ASSERT_EQ(out, "{\"d\":\"2024-01-05\"}\n{\"d\":\"1-2\"}\n{\"d\":\"01\"}\n"
+                 "{\"d\":\"1e\"}\n{\"d\":\".5\"}\n{\"d\":\"-\"}\n{\"d\":\"1.\"}\n"
+                 "{\"d\":1.5e3}\n{\"d\":-0.25}\n{\"d\":0}\n{\"d\":1E+2}\n");
+}
+
+static int callback_to_str(char *str, size_t len, enum color *pColor, void *v,
+                           int humanize)
+{
+  *pColor = CNRM;
+  return snprintf(str, len, "%0200d", *(int *)v);
+}
+
+TEST(LibtblUnitTests, RenderStats)
+{
+  unit_table t;
+  struct table_column **cs = t.cs;
+  struct table_field fields[2];
+  struct tbl_stats stats;
+  struct tbl_sink sink;
+
+  t.count.m_tostr = callback_to_str;
+  ASSERT_EQ(tbl_stats_init(&stats, 2), 0);
+  ASSERT_EQ(tbl_stats_attach(&stats), 0);
+
+  ASSERT_EQ(tbl_sink_init_heap(&sink, 0), 0);
+  ASSERT_EQ(print_table_all_rows_sink(&sink, unit_rows, FORMAT_CSV, NULL, cs,
+                                      false, 0, 0), 0);
+  table_row_stringify(&unit_a, fields, cs, 0, 0);
+  ASSERT_EQ(tbl_stats_attach(NULL), 0);
+  print_table_all_rows_sink(&sink, unit_rows, FORMAT_CSV, NULL, cs, false, 0, 0);
+
+  ASSERT_EQ(stats.rows, 3u);
+  ASSERT_EQ(stats.columns[0].calls, 3u);
+  ASSERT_EQ(stats.columns[0].bytes, 3u + 4u + 3u);
+  ASSERT_EQ(stats.columns[0].escapes, 1u);
+  ASSERT_EQ(stats.columns[1].bytes, 200u + 200u + MAX_COLUMN_WIDTH - 1);
+  ASSERT_EQ(stats.columns[1].truncated, 1u);
+  ASSERT_GT(stats.columns[1].cycles, 0u);
+  ASSERT_GT(stats.emit_cycles, 0u);
+
+  sink.len = 0;
+  ASSERT_EQ(tbl_stats_print_sink(&sink, FORMAT_CSV, &stats, cs), 0);
+  tbl_sink_close(&sink);
+  std::string out(sink.buf);
+  ASSERT_EQ(out.find("name,calls,cycles,per_call,bytes,escapes,truncated\n\"name\",3,"), 0u);
+  ASSERT_NE(out.find("\n\"[emit]\",2,"), std::string::npos);
+  tbl_sink_release(&sink);
+
+  tbl_stats_reset(&stats);
+  ASSERT_EQ(stats.rows, 0u);
+  ASSERT_EQ(stats.columns[1].bytes, 0u);
+  tbl_stats_release(&stats);
+}
+
+TEST(LibtblUnitTests, LayoutSharedColumns)
+{
+  const int n = 2000, nthreads = 4;
+  std::vector<struct unit_row> data(n);
+  std::vector<void *> rows(n + 1);
+  std::vector<std::thread> threads;
+  char *out[nthreads];
+  int width, name_width = clm_stream_name.m_width;
+  std::string expected;
+
+  for (int i = 0; i < n; i++) {
+    memset(data[i].name, 'a', 1 + i % 12);
+    data[i].count = i * 31;
+    rows[i] = &data[i];
+  }
+  rows[n] = NULL;
+  expected = render_alike(1, [&](struct tbl_sink *sink, int way) {
+    width = render_rows(sink, rows.data(), FORMAT_TERM, 0);
+  });
+
+  /* every thread renders the static columns with a layout of its own */
+  for (int t = 0; t < nthreads; t++)
+    threads.emplace_back([&, t] {
+      struct tbl_layout layout;
+      struct tbl_sink sink;
+
+      tbl_sink_init_heap(&sink, 0);
+      if (!tbl_layout_init(&layout, stream_columns)) {
+        tbl_layout_print_rows_sink(&layout, &sink, rows.data(), FORMAT_TERM,
+                                   " ", true, 0, 1);
+        tbl_layout_release(&layout);
+      }
+      tbl_sink_close(&sink);
+      out[t] = sink.buf;
+    });
+  for (auto &thread : threads)
+    thread.join();
+
+  for (int t = 0; t < nthreads; t++) {
+    ASSERT_EQ(out[t], expected);
+    free(out[t]);
+  }
+  ASSERT_EQ(clm_stream_name.m_width, name_width);
+  ASSERT_EQ(width, 13);
+}
+
+TEST(LibtblUnitTests, LiveRedraw)
+{
+  struct unit_row b = unit_b, c = {"baz", 7, 0};
+  void *rows[] = {&unit_a, &b, NULL, NULL};
+  struct tbl_live live;
+  struct tbl_sink sink;
+  unit_table t;
+  size_t start;
+
+  tbl_sink_init_heap(&sink, 0);
+  ASSERT_EQ(tbl_live_init(&live, &sink, NULL, t.cs, false, 0, 0, 'l'), 0);
+
+  ASSERT_EQ(tbl_live_frame(&live, rows), 0);
+  ASSERT_EQ(std::string(sink.buf, sink.len),
+            "\x1B[?2026h\x1B[H\x1B[2J"
+            "Name  Count  \n"
+            "foo       1  \n"
+            "b\"ar    -23  \n"
+            "\x1B[?2026l");
+
+  /* only the changed cell is rewritten */
+  start = sink.len;
+  b.count = 42;
+  ASSERT_EQ(tbl_live_frame(&live, rows), 0);
+  ASSERT_EQ(std::string(sink.buf + start, sink.len - start),
+            "\x1B[?2026h\x1B[3;7H   42  \x1B[4;1H\x1B[?2026l");
+
+  /* a row is appended, then removed again */
+  start = sink.len;
+  rows[2] = &c;
+  ASSERT_EQ(tbl_live_frame(&live, rows), 0);
+  ASSERT_EQ(std::string(sink.buf + start, sink.len - start),
+            "\x1B[?2026h\x1B[4;1Hbaz       7  \n\x1B[5;1H\x1B[?2026l");
+  start = sink.len;
+  rows[2] = NULL;
+  ASSERT_EQ(tbl_live_frame(&live, rows), 0);
+  ASSERT_EQ(std::string(sink.buf + start, sink.len - start),
+            "\x1B[?2026h\x1B[4;1H\x1B[J\x1B[?2026l");
+
+  /* a wider cell redraws the whole table */
+  strcpy(b.name, "longer");
+  ASSERT_EQ(tbl_live_frame(&live, rows), 0);
+  ASSERT_EQ(live.frames, 5u);
+  ASSERT_EQ(live.redraws, 2u);
+  ASSERT_EQ(live.updates, 1u);
+  ASSERT_EQ(t.name.m_width, 4);
+
+  tbl_live_release(&live);
+  tbl_sink_release(&sink);
+}
+
+TEST(LibtblUnitTests, SortTopRows)
+{
+  const int n = 1000;
+  std::vector<struct unit_row> data(n);
+  std::vector<void *> rows(n + 1), top(21);
+  struct tbl_sort_key keys[TBL_SORT_MAX_KEYS];
+  struct unit_row *r;
+
+  for (int i = 0; i < n; i++) {
+    snprintf(data[i].name, sizeof(data[i].name), "n%03d", i % 100);
+    data[i].count = (i * 7919) % 1000 - 500;
+    data[i].bytes = i % 3;
+    rows[i] = &data[i];
+  }
+  rows[n] = NULL;
+
+  ASSERT_EQ(tbl_sort_parse("bytes, -count", ",", unit_columns, keys, 2), -EINVAL);
+  struct table_column *all[] = {&clm_unit_row_name, &clm_unit_row_count,
+                                &clm_unit_row_bytes, NULL};
+  ASSERT_EQ(tbl_sort_parse("bytes, -count", ",", all, keys, TBL_SORT_MAX_KEYS), 2);
+  ASSERT_FALSE(keys[0].desc);
+  ASSERT_TRUE(keys[1].desc);
+
+  /* the top rows are the head of the fully sorted rows */
+  ASSERT_EQ(tbl_top_rows(rows.data(), keys, 2, top.data(), 20), 20);
+  ASSERT_EQ(top[20], nullptr);
+  ASSERT_EQ(rows[0], &data[0]);
+  ASSERT_EQ(tbl_sort_rows(rows.data(), keys, 2), 0);
+  for (int i = 0; i < 20; i++)
+    ASSERT_EQ(top[i], rows[i]);
+
+  for (int i = 1; i < n; i++) {
+    struct unit_row *p = (struct unit_row *)rows[i - 1];
+    r = (struct unit_row *)rows[i];
+    ASSERT_TRUE(p->bytes < r->bytes ||
+                (p->bytes == r->bytes && p->count >= r->count));
+  }
+
+  ASSERT_EQ(tbl_sort_parse("name", ",", all, keys, TBL_SORT_MAX_KEYS), 1);
+  ASSERT_EQ(tbl_top_rows(rows.data(), keys, 1, top.data(), 3), 3);
+  for (int i = 0; i < 3; i++)
+    ASSERT_STREQ(((struct unit_row *)top[i])->name, "n000");
+
+  /* fewer rows than asked for */
+  rows[5] = NULL;
+  ASSERT_EQ(tbl_top_rows(rows.data(), keys, 1, top.data(), 20), 5);
+}
+
+TEST(LibtblUnitTests, FilterRows)
+{
+  struct table_column *all[] = {&clm_unit_row_name, &clm_unit_row_count,
+                                &clm_unit_row_bytes, NULL};
+  struct unit_row big = {"nvme0n1", 7, 1ULL << 63};
+  struct tbl_filter filter;
+
+  const char *bad[] = {"", "count >", "nope == 1", "name > 3", "count ^= 1",
+                       "(count == 1", "count == 1 &&", "count == 1x"};
+  for (const char *expr : bad)
+    ASSERT_EQ(tbl_filter_compile(&filter, expr, all), -EINVAL) << expr;
+
+  ASSERT_EQ(tbl_filter_compile(&filter, "count < 0 || name == foo", all), 0);
+  ASSERT_TRUE(tbl_filter_match(&filter, &unit_a));
+  ASSERT_TRUE(tbl_filter_match(&filter, &unit_b));
+  ASSERT_FALSE(tbl_filter_match(&filter, &big));
+  tbl_filter_release(&filter);
+
+  ASSERT_EQ(tbl_filter_compile(&filter,
+            "bytes > 0x7fffffffffffffff && bytes > -1 && !(name ^= \"sd\") && "
+            "name *= me0 && count >= 7 && count <= 7 && count != 8", all), 0);
+  ASSERT_TRUE(tbl_filter_match(&filter, &big));
+  ASSERT_FALSE(tbl_filter_match(&filter, &unit_a));
+  tbl_filter_release(&filter);
+
+  /* rows filtered out are never stringified, in parallel as well */
+  const int n = 5000;
+  unit_table t(n);
+
+  ASSERT_EQ(tbl_filter_compile(&filter, "count >= 4990 || name == row7", t.cs), 0);
+  std::string out = render_alike(2, [&](struct tbl_sink *sink, int way) {
+    struct tbl_layout layout;
+
+    ASSERT_EQ(tbl_layout_init(&layout, t.cs), 0);
+    layout.filter = &filter;
+    ASSERT_EQ(tbl_layout_print_rows_parallel_sink(&layout, sink, t.rows.data(),
+                                                  FORMAT_JSON, "", false, 0, 0,
+                                                  way ? 4 : 1), 0);
+    ASSERT_EQ(layout.scanned, (unsigned long)n);
+    ASSERT_EQ(layout.emitted, 11ul);
+    ASSERT_EQ(layout.widths[0], 7);
+    tbl_layout_release(&layout);
+  });
+  ASSERT_EQ(out.find("{\n\t\"name\": \"row7\""), 0u);
+  tbl_filter_release(&filter);
+}
+
+TEST(LibtblUnitTests, TotalsFooter)
+{
+  const int n = 5000;
+  unit_table t(n);
+
+  for (int i = 0; i < n; i++) {
+    t.data[i].count = i - 1000;
+    t.data[i].bytes = i * 2;
+  }
+
+  std::string out = render_alike(2, [&](struct tbl_sink *sink, int way) {
+    struct tbl_totals totals;
+    struct tbl_layout layout;
+
+    ASSERT_EQ(tbl_totals_init(&totals, 3), 0);
+    ASSERT_EQ(tbl_layout_init(&layout, t.all), 0);
+    layout.totals = &totals;
+    ASSERT_EQ(tbl_layout_print_rows_parallel_sink(&layout, sink, t.rows.data(),
+                                                  FORMAT_CSV, NULL, false, 0, 0,
+                                                  way ? 4 : 1), 0);
+    sink->len = 0;
+    ASSERT_EQ(tbl_layout_print_totals_sink(&layout, sink, FORMAT_CSV, NULL,
+                                           false, 0, TBL_AGG_ALL), 0);
+    ASSERT_EQ(tbl_layout_print_totals_sink(&layout, sink, FORMAT_JSONL, NULL,
+                                           false, 0, TBL_AGG_SUM | TBL_AGG_MIN),
+              0);
+    tbl_layout_release(&layout);
+    tbl_totals_release(&totals);
+  });
+  ASSERT_EQ(out, "\"count\",5000,5000\n"
+                    "\"sum\",7497500,24995000\n"
+                    "\"min\",-1000,0\n"
+                    "\"max\",3999,9998\n"
+                    "\"avg\",1499.50,4999.00\n"
+                    "{\"summary\":{\"sum\":{\"count\":7497500,\"bytes\":24995000},"
+                    "\"min\":{\"count\":-1000,\"bytes\":0}}}\n");
+
+  /* footer cells wider than the rows, averages beyond 2^53 */
+  struct unit_row big[] = {{"a", 60000, (1ULL << 62) + 1},
+                           {"b", 50000, (1ULL << 62) + 2}};
+  void *big_rows[] = {&big[0], &big[1], NULL};
+  struct tbl_totals totals;
+  struct tbl_layout layout;
+  struct tbl_sink sink;
+
+  t.reset_widths();
+  ASSERT_EQ(tbl_totals_init(&totals, 3), 0);
+  ASSERT_EQ(tbl_layout_init(&layout, t.all), 0);
+  layout.totals = &totals;
+  tbl_sink_init_heap(&sink, 0);
+  ASSERT_EQ(tbl_layout_print_rows_sink(&layout, &sink, big_rows, FORMAT_TERM,
+                                       NULL, false, 0, 0), 0);
+  sink.len = 0;
+  ASSERT_EQ(tbl_layout_print_totals_sink(&layout, &sink, FORMAT_TERM, NULL, false,
+                                         0, TBL_AGG_COUNT | TBL_AGG_SUM |
+                                         TBL_AGG_AVG), 0);
+  ASSERT_EQ(tbl_layout_print_totals_sink(&layout, &sink, FORMAT_JSON, NULL, false,
+                                         0, TBL_AGG_COUNT | TBL_AGG_MAX), 0);
+  tbl_sink_close(&sink);
+  ASSERT_STREQ(sink.buf, "       --------  ----------------------  \n"
+                         "count         2                       2  \n"
+                         "sum      110000     9223372036854775811  \n"
+                         "avg    55000.00  4611686018427387905.50  \n"
+                         "{\n"
+                         "\t\"summary\": {\n"
+                         "\t\t\"count\": 2,\n"
+                         "\t\t\"max\": {\n"
+                         "\t\t\t\"count\": 60000,\n"
+                         "\t\t\t\"bytes\": 4611686018427387906\n"
+                         "\t\t}\n"
+                         "\t}\n"
+                         "}");
+  ASSERT_EQ(layout.widths[0], 5);
+  tbl_sink_release(&sink);
+  tbl_layout_release(&layout);
+  tbl_totals_release(&totals);
+
+  /* totals of fewer columns than the layout */
+  ASSERT_EQ(tbl_totals_init(&totals, 2), 0);
+  ASSERT_EQ(tbl_layout_init(&layout, t.all), 0);
+  layout.totals = &totals;
+  tbl_sink_init_heap(&sink, 0);
+  ASSERT_EQ(tbl_layout_print_rows_sink(&layout, &sink, big_rows, FORMAT_CSV,
+                                       NULL, false, 0, 0), -EINVAL);
+  ASSERT_EQ(tbl_layout_print_rows_parallel_sink(&layout, &sink, big_rows,
+                                                FORMAT_CSV, NULL, false, 0, 0, 2),
+            -EINVAL);
+  ASSERT_EQ(tbl_layout_print_totals_sink(&layout, &sink, FORMAT_CSV, NULL, false,
+                                         0, TBL_AGG_ALL), -EINVAL);
+  ASSERT_EQ(tbl_layout_fit_totals(&layout, 0, TBL_AGG_ALL), -EINVAL);
+  ASSERT_EQ(totals.rows, 0UL);
+  ASSERT_EQ(sink.len, 0U);
+  tbl_totals_add(&totals, t.all, &big[0]);
+  tbl_totals_add(&totals, t.all, &big[1]);
+  ASSERT_EQ(totals.rows, 2UL);
+  ASSERT_EQ(totals.columns[1].sum, 110000U);
+  tbl_sink_release(&sink);
+  tbl_layout_release(&layout);
+  tbl_totals_release(&totals);
+}
+
+struct unit_source {
+  struct unit_row *data;
+  int n;
+  int calls;
+};
+
+static void *unit_source_next(void *state)
+{
+  struct unit_source *us = (struct unit_source *)state;
+
+  return us->calls < us->n ? &us->data[us->calls++] : NULL;
+}
+
+TEST(LibtblUnitTests, RowSource)
+{
+  const int n = 5000, limit = 3000;
+  unit_table t(n);
+
+  t.rows[limit] = NULL;
+
+  /* the producer is not asked for rows past the limit */
+  render_alike(3, [&](struct tbl_sink *sink, int way) {
+    struct unit_source us = {t.data.data(), n, 0};
+    struct tbl_row_source src = {unit_source_next, &us, 0, limit};
+    struct tbl_layout layout;
+
+    ASSERT_EQ(tbl_layout_init(&layout, t.cs), 0);
+    if (!way)
+      ASSERT_EQ(tbl_layout_print_rows_sink(&layout, sink, t.rows.data(),
+                                           FORMAT_TERM, "", false, 0, 0), 0);
+    else
+      ASSERT_EQ(tbl_layout_print_source_parallel_sink(&layout, sink, &src,
+                                                      FORMAT_TERM, "", false,
+                                                      0, 0, way > 1 ? 4 : 1), 0);
+    if (way)
+      ASSERT_EQ(us.calls, limit);
+    ASSERT_EQ(layout.emitted, (unsigned long)limit);
+    ASSERT_EQ(layout.widths[0], 7);
+    tbl_layout_release(&layout);
+  });
+}
+
+TEST(LibtblUnitTests, StridedRows)
+{
+  const int n = 3000;
+  unit_table t(n);
+
+  render_alike(2, [&](struct tbl_sink *sink, int way) {
+    t.reset_widths();
+    if (way)
+      ASSERT_EQ(print_table_strided_sink(sink, t.data.data(), sizeof(t.data[0]),
+                                         n, FORMAT_CSV, NULL, t.cs, false, 0, 0),
+                0);
+    else
+      ASSERT_EQ(print_table_all_rows_sink(sink, t.rows.data(), FORMAT_CSV, NULL,
+                                          t.cs, false, 0, 0), 0);
+    ASSERT_EQ(t.name.m_width, 7);
+  });
+
+  struct tbl_row_source src;
+  struct tbl_strided st;
+
+  tbl_row_source_strided(&src, &st, t.data.data(), sizeof(t.data[0]), 0);
+  ASSERT_EQ(src.next(src.state), nullptr);
+}
+
+TEST(LibtblUnitTests, AsyncSink)
+{
+  const int n = 20000;
+  unit_table t(n);
+  std::vector<struct unit_row> &data = t.data;
+  struct table_column **cs = t.cs;
+  struct tbl_sink sink, heap;
+  std::string out;
+  int fds[2];
+
+  tbl_sink_init_heap(&heap, 0);
+  ASSERT_EQ(print_table_strided_sink(&heap, data.data(), sizeof(data[0]), n,
+                                     FORMAT_CSV, NULL, cs, false, 0, 0), 0);
+
+  /* a consumer which starts late: the renderer waits once the pipe is full */
+  ASSERT_EQ(pipe(fds), 0);
+  std::thread reader([&] {
+    char buf[4096];
+    ssize_t len;
+
+    usleep(20000);
+    while ((len = read(fds[0], buf, sizeof(buf))) > 0)
+      out.append(buf, len);
+  });
+  ASSERT_EQ(tbl_sink_init_async(&sink, NULL, fds[1], 4096, 2), 0);
+  ASSERT_EQ(print_table_strided_sink(&sink, data.data(), sizeof(data[0]), n,
+                                     FORMAT_CSV, NULL, cs, false, 0, 0), 0);
+  ASSERT_EQ(tbl_sink_close(&sink), 0);
+  ASSERT_EQ(tbl_sink_bytes(&sink), heap.len);
+  ASSERT_GT(sink.wait_ns, 0u);
+
+  /* the writer thread is gone, later writes fail instead of waiting for it */
+  std::string big(3 * 4096, 'x');
+
+  ASSERT_EQ(tbl_sink_write(&sink, big.data(), big.size()), -EPIPE);
+  ASSERT_EQ(tbl_sink_flush(&sink), -EPIPE);
+  tbl_sink_release(&sink);
+  close(fds[1]);
+  reader.join();
+  close(fds[0]);
+  ASSERT_EQ(out, std::string(heap.buf, heap.len));
+  tbl_sink_release(&heap);
+
+  /* write errors of the writer thread are reported by close */
+  ASSERT_EQ(tbl_sink_init_async(&sink, NULL, -1, 0, 0), 0);
+  tbl_sink_puts(&sink, "lost");
+  ASSERT_EQ(tbl_sink_close(&sink), -EBADF);
+  tbl_sink_release(&sink);
+}
+
+TEST(LibtblUnitTests, HumanizeUnits)
+{
+  const struct {
+    enum field_type type;
+    uint64_t v;
+    const char *str;
+  } cases[] = {
+    {FIELD_BYTES, 0, "0 B"},
+    {FIELD_BYTES, 1023, "1023 B"},
+    {FIELD_BYTES, 1536, "1.5 KiB"},
+    {FIELD_BYTES, 1048575, "1.0 MiB"},
+    {FIELD_BYTES, UINT64_MAX, "16.0 EiB"},
+    {FIELD_BYTES_RATE, 3 << 20, "3.0 MiB/s"},
+    {FIELD_NSEC, 999, "999 ns"},
+    {FIELD_NSEC, 1250000, "1.3 ms"},
+    {FIELD_NSEC, 90000000000ULL, "1.5 min"},
+    {FIELD_SI, 999, "999"},
+    {FIELD_SI, 999999, "1.0M"},
+    {FIELD_SI, 12345678, "12.3M"},
+  };
+  char buf[TBL_INT_BUF_SIZE];
+
+  for (const auto &c : cases) {
+    int len = tbl_humanize(buf, c.type, c.v);
+
+    ASSERT_EQ(std::string(buf, len), c.str);
+  }
+  ASSERT_EQ(tbl_humanize(buf, FIELD_U64, 1), -1);
+
+  /* no callback needed, raw numbers unless humanized */
+  struct table_column bytes = clm_unit_row_bytes;
+  struct table_column *cs[] = {&bytes, NULL};
+  struct unit_row row = {"", 0, 1536};
+  void *rows[] = {&row, NULL};
+  struct tbl_sink sink;
+
+  bytes.m_type = FIELD_BYTES;
+  for (int humanize = 0; humanize < 2; humanize++) {
+    tbl_sink_init_heap(&sink, 0);
+    ASSERT_EQ(print_table_all_rows_sink(&sink, rows, FORMAT_JSONL, NULL, cs,
+                                        false, humanize, 0), 0);
+    ASSERT_EQ(std::string(sink.buf, sink.len),
+              humanize ? "{\"bytes\":\"1.5 KiB\"}\n" : "{\"bytes\":1536}\n");
+    tbl_sink_release(&sink);
+  }
+}
+
+TEST(LibtblUnitTests, Utf8Width)
+{
+  const char *ascii = "0123456789abcdefghijklmnopqrstuvwxyz";
+  size_t cols;
+
+  ASSERT_EQ(tbl_str_width(ascii, strlen(ascii)), strlen(ascii));
+  ASSERT_EQ(tbl_str_width("Z\xc3\xbcrich", 7), 6u);
+  ASSERT_EQ(tbl_str_width("\xe6\x9d\xb1\xe4\xba\xac", 6), 4u);
+  ASSERT_EQ(tbl_str_width("e\xcc\x81", 3), 1u);
+  ASSERT_EQ(tbl_str_width("\xff\xe6\x9d", 3), 3u);
+  /* a 17th byte which is not ASCII, behind a vector of ASCII */
+  ASSERT_EQ(tbl_str_width("0123456789abcdef\xe6\x9d\xb1", 19), 18u);
+
+  /* never split a character, keep the combining mark */
+  ASSERT_EQ(tbl_str_truncate("\xe6\x9d\xb1\xe4\xba\xac", 6, 3, &cols), 3u);
+  ASSERT_EQ(cols, 2u);
+  ASSERT_EQ(tbl_str_truncate("ae\xcc\x81x", 5, 2, &cols), 4u);
+  ASSERT_EQ(cols, 2u);
+
+  /* the terminal table lines up by columns, not bytes */
+  unit_table t;
+  struct table_column **cs = t.cs;
+  struct unit_row a = {"Z\xc3\xbcrich", 1, 0}, b = {"\xe6\x9d\xb1\xe4\xba\xac", 22, 0};
+  struct unit_row c = {"abc", 333, 0};
+  void *rows[] = {&a, &b, &c, NULL};
+  struct tbl_sink sink;
+
+  t.name.m_width = 6;
+  tbl_sink_init_heap(&sink, 0);
+  ASSERT_EQ(print_table_header_term_sink(&sink, "", cs, false, 'a'), 0);
+  ASSERT_EQ(print_table_all_rows_sink(&sink, rows, FORMAT_TERM, "", cs, false,
+                                      0, 0), 0);
+  ASSERT_EQ(t.name.m_width, 6);
+  std::string out(sink.buf, sink.len);
+  std::vector<size_t> widths;
+  for (size_t pos = 0, nl; (nl = out.find('\n', pos)) != std::string::npos;
+       pos = nl + 1)
+    widths.push_back(tbl_str_width(out.data() + pos, nl - pos));
+  ASSERT_EQ(widths.size(), 4u);
+  for (size_t w : widths)
+    ASSERT_EQ(w, widths[0]);
+  tbl_sink_release(&sink);
+}
+
+TEST(LibtblUnitTests, WideTable)
+{
+  const int ncols = 300, nrows = 3000;
+  std::vector<uint64_t> data(ncols * nrows);
+  std::vector<struct table_column> columns(ncols);
+  std::vector<struct table_column *> cs(ncols + 1);
+  std::vector<std::string> names(ncols);
+  std::vector<void *> rows(nrows + 1);
+  std::string expected;
+
+  for (int c = 0; c < ncols; c++) {
+    names[c] = "c" + std::to_string(c);
+    columns[c].m_name = names[c].c_str();
+    columns[c].m_type = FIELD_U64;
+    columns[c].m_offset = c * sizeof(uint64_t);
+    columns[c].column_align = 'r';
+    cs[c] = &columns[c];
+  }
+  cs[ncols] = NULL;
+  for (int r = 0; r < nrows; r++) {
+    for (int c = 0; c < ncols; c++) {
+      data[r * ncols + c] = (uint64_t)r * c;
+      expected += (c ? "," : "") + std::to_string((uint64_t)r * c);
+    }
+    expected += "\n";
+    rows[r] = &data[r * ncols];
+  }
+  rows[nrows] = NULL;
+
+  /* far more columns than MAX_COLUMN_COUNT, serial and parallel */
+  std::string out = render_alike(2, [&](struct tbl_sink *sink, int way) {
+    struct tbl_totals totals;
+    struct tbl_layout layout;
+
+    ASSERT_EQ(tbl_layout_init(&layout, cs.data()), 0);
+    ASSERT_EQ(tbl_totals_init(&totals, ncols), 0);
+    layout.totals = &totals;
+    ASSERT_EQ(tbl_layout_print_rows_parallel_sink(&layout, sink, rows.data(),
+                                                  FORMAT_CSV, NULL, false, 0, 0,
+                                                  way ? 4 : 1), 0);
+    ASSERT_EQ(layout.widths[ncols - 1], 6);
+    ASSERT_EQ(totals.columns[ncols - 1].max, (uint64_t)(nrows - 1) * (ncols - 1));
+    tbl_totals_release(&totals);
+    tbl_layout_release(&layout);
+  });
+  ASSERT_EQ(out, expected);
+
+  /* the single row, row line and column selection functions as well */
+  std::vector<struct table_column *> sel(ncols + 1);
+  std::string line, list;
+  struct tbl_stats stats;
+  struct tbl_sink sink;
+  long dashes = 0;
+
+  for (int c = 0; c < ncols; c++)
+    line += (c ? "," : "") + std::to_string(2 * c);
+  tbl_sink_init_heap(&sink, 0);
+  ASSERT_EQ(tbl_stats_init(&stats, ncols), 0);
+  ASSERT_EQ(tbl_stats_attach(&stats), 0);
+  ASSERT_EQ(print_table_single_row_sink(&sink, rows[2], FORMAT_CSV, NULL,
+                                        cs.data(), false, 0, 0), 0);
+  ASSERT_EQ(tbl_stats_attach(NULL), 0);
+  ASSERT_EQ(std::string(sink.buf, sink.len), line + "\n");
+  ASSERT_EQ(stats.columns[ncols - 1].calls, 1u);
+  ASSERT_EQ(stats.columns[ncols - 1].bytes, 3u);
+  sink.len = 0;
+  ASSERT_EQ(tbl_stats_print_sink(&sink, FORMAT_CSV, &stats, cs.data()), 0);
+  ASSERT_NE(std::string(sink.buf, sink.len).find("\n\"c299\",1,"),
+            std::string::npos);
+  tbl_stats_release(&stats);
+  for (int c = 0; c < ncols; c++)
+    dashes += columns[c].m_width;
+  sink.len = 0;
+  ASSERT_EQ(print_table_row_line_sink(&sink, NULL, cs.data(), false, 0), 0);
+  ASSERT_EQ(std::count(sink.buf, sink.buf + sink.len, '-'), dashes);
+  tbl_sink_release(&sink);
+
+  for (int c = ncols - 1; c >= 0; c--)
+    list += names[c] + (c ? "," : "");
+  sel[0] = NULL;
+  ASSERT_EQ(table_extend_columns(list.c_str(), ",", cs.data(), sel.data(), ncols), 0);
+  ASSERT_EQ(table_column_count(sel.data()), ncols);
+  ASSERT_EQ(sel[0], cs[ncols - 1]);
+  ASSERT_EQ(sel[ncols - 1], cs[0]);
+}
+
+struct cxx_row {
+  char name[16];
+  int count;
+  uint64_t bytes;
+  int state;
+};
+
+static int cxx_state(char *str, size_t len, enum color *pColor, const int &v,
+                     int humanize)
+{
+  *pColor = v ? CRED : CGRN;
+  return snprintf(str, len, "%s", v ? "down" : "up");
+}
+
+static constexpr auto cxx_table = tbl::make_table(
+  tbl::col<&cxx_row::name>("name", "Name").align('l').colors(CBLD, CCYN),
+  tbl::col<&cxx_row::count>("count", "Count"),
+  tbl::col<&cxx_row::bytes>("bytes", "Bytes").type(FIELD_BYTES),
+  tbl::col<&cxx_row::state>("state", "State", cxx_state),
+  tbl::col<&cxx_row::count>("twice", "2x",
+    [](char *str, size_t len, enum color *pColor, const int &v, int humanize) {
+      return snprintf(str, len, "%d", 2 * v);
+    }).type(FIELD_NUM));
+
+TEST(LibtblUnitTests, CxxTable)
+{
+  const enum format_type formats[] = {FORMAT_TERM, FORMAT_CSV, FORMAT_JSON,
+                                      FORMAT_XML, FORMAT_JSONL};
+  std::vector<struct cxx_row> data = {
+    {"foo", 1, 1536, 0}, {"b\"ar", -23, 20, 1}, {"", 7, 3ULL << 30, 0},
+    {"\xe6\x97\xa5\xe6\x9c\xac", 12345, 0, 1},
+  };
+  std::vector<struct cxx_row *> ptrs;
+  std::vector<void *> rows;
+
+  for (auto &row : data) {
+    ptrs.push_back(&row);
+    rows.push_back(&row);
+  }
+  rows.push_back(NULL);
+
+  for (enum format_type format : formats) {
+    for (int v = 0; v < 8; v++) {
+      bool use_color = v & 1, runs = v & 2;
+      int humanize = v & 4 ? 1 : 0;
+      tbl::layout<cxx_table> cxx, c;
+
+      SCOPED_TRACE(std::to_string(format) + " " + std::to_string(v));
+      render_alike(2, [&](struct tbl_sink *sink, int way) {
+        sink->color_runs = runs;
+        if (way)
+          ASSERT_EQ(print_table_all_rows_sink(sink, rows.data(), format, "> ",
+                                              c.columns(), use_color, humanize,
+                                              2), 0);
+        else
+          ASSERT_EQ(cxx.print_rows(sink, data, format, "> ", use_color,
+                                   humanize, 2), 0);
+      });
+      for (int i = 0; i < 5; i++)
+        ASSERT_EQ(cxx.widths()[i], c.columns()[i]->m_width);
+    }
+  }
+
+  /* rows by pointer, and the C functions reading the generated columns */
+  tbl::layout<cxx_table> layout;
+  struct tbl_sink sink;
+
+  ASSERT_EQ(cxx_table.count, 5u);
+  ASSERT_EQ(std::get<1>(cxx_table.columns).hdr_width, 5);
+  tbl_sink_init_heap(&sink, 0);
+  ASSERT_EQ(layout.print_rows(&sink, ptrs.begin(), ptrs.end(), FORMAT_CSV,
+                              NULL, false, 1, 0), 0);
+  ASSERT_EQ(layout.print_header(&sink, NULL, false, 'r'), 0);
+  tbl_sink_close(&sink);
+  ASSERT_STREQ(sink.buf, "\"foo\",1,1.5 KiB,up,2\n"
+                         "\"b\"\"ar\",-23,20 B,down,-46\n"
+                         "\"\",7,3.0 GiB,up,14\n"
+                         "\"\xe6\x97\xa5\xe6\x9c\xac\",12345,0 B,down,24690\n"
+                         "Name  Count    Bytes  State     2x  \n");
+  ASSERT_EQ(layout.columns()[0]->m_width, 4);
+  ASSERT_EQ(layout.columns()[2]->m_tostr, nullptr);
+  ASSERT_NE(layout.columns()[3]->m_tostr, nullptr);
+  ASSERT_EQ(layout.columns()[3]->m_offset, offsetof(struct cxx_row, state));
+  ASSERT_EQ(layout.columns()[5], nullptr);
+  tbl_sink_release(&sink);
+}